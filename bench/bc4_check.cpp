@@ -0,0 +1,112 @@
+// BC4 encoder check: encodes random and edge case blocks with the SSE2 path (bc4_encode()) and the scalar reference
+// (bc4_encode_block()), exits with 1 if the encoded bytes differ or the error stats do not match the decoded blocks
+// usage: bc4_check [--blocks N] [--seed S]
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include "bc4.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "  ok      " : "  FAILED  ") << what << std::endl;
+    if (!ok) ++failures;
+}
+
+static bool operator==(const BC4Stats& a, const BC4Stats& b) {
+    return a.texels == b.texels && a.squared_error == b.squared_error && a.max_error == b.max_error;
+}
+
+static std::string to_string(const BC4Stats& stats) {
+    return std::to_string(stats.texels) + " texels, squared error " + std::to_string(stats.squared_error) + ", max. error " + std::to_string(stats.max_error);
+}
+
+// 16 texels of the given kind, edge cases first
+static void fill_block(int kind, std::mt19937& rng, uint8_t* texels) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    const auto fill = [&](const auto& value) { for (int i = 0; i < 16; ++i) texels[i] = uint8_t(value(i)); };
+    switch (kind) {
+        case 0: fill([](int) { return 0; }); break;
+        case 1: fill([](int) { return 255; }); break;
+        case 2: { const int c = byte(rng); fill([&](int) { return c; }); break; }                          // constant
+        case 3: fill([&](int) { const int r = byte(rng) % 3; return r == 0 ? 0 : r == 1 ? 255 : byte(rng); }); break; // mixed 0/255/interior
+        case 4: fill([&](int) { return byte(rng) & 1 ? 255 : 0; }); break;                                 // only 0 and 255
+        case 5: fill([&](int) { return byte(rng) & 1 ? 255 : byte(rng); }); break;                         // 255 and interior
+        case 6: fill([&](int) { return byte(rng) & 1 ? 0 : byte(rng); }); break;                           // 0 and interior
+        case 7: { const int c = byte(rng); fill([&](int) { return std::clamp(c + byte(rng) % 9 - 4, 0, 255); }); break; } // narrow range
+        case 8: { const int a = byte(rng), b = byte(rng); fill([&](int i) { return a + (b - a) * i / 15; }); break; }    // gradient
+        default: fill([&](int) { return byte(rng); }); break;                                              // random
+    }
+}
+
+int main(int argc, char** argv) {
+    int n_blocks = 1 << 16;
+    uint32_t seed = 42;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--blocks") n_blocks = std::max(16, std::stoi(argv[++i]));
+        else if (arg == "--seed") seed = uint32_t(std::stoul(argv[++i]));
+    }
+#if !defined(__SSE2__)
+    std::cout << "note: built without SSE2, both paths are scalar" << std::endl;
+#endif
+
+    // one block column per layer, each block of a kind cycling through the edge cases and random content
+    const int n_kinds = 10, bh = 16, d = (n_blocks + bh - 1) / bh, w = 4, h = 4 * bh;
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> image(size_t(w) * h * d);
+    for (int b = 0; b < bh * d; ++b) {
+        uint8_t texels[16];
+        fill_block(b % n_kinds, rng, texels);
+        for (int y = 0; y < 4; ++y)
+            std::copy(texels + 4 * y, texels + 4 * y + 4, image.data() + (size_t(b) * 4 + y) * w);
+    }
+    std::cout << bh * d << " blocks, seed " << seed << std::endl;
+
+    BC4Stats simd_stats;
+    const std::vector<uint8_t> simd = bc4_encode(image.data(), w, h, d, simd_stats);
+
+    // scalar reference and the error of the decoded blocks
+    BC4Stats scalar_stats, decoded_stats;
+    std::vector<int> mismatches(n_kinds, 0);
+    for (int b = 0; b < bh * d; ++b) {
+        const uint8_t* src = image.data() + size_t(b) * 16;
+        uint8_t block[8], texels[16];
+        bc4_encode_block(src, w, block, scalar_stats);
+        if (!std::equal(block, block + 8, simd.data() + size_t(b) * 8))
+            ++mismatches[b % n_kinds];
+        bc4_decode_block(block, texels);
+        for (int i = 0; i < 16; ++i) {
+            const uint32_t error = uint32_t(std::abs(int(texels[i]) - int(src[i])));
+            decoded_stats.squared_error += error * error;
+            decoded_stats.max_error = std::max(decoded_stats.max_error, error);
+        }
+        decoded_stats.texels += 16;
+    }
+
+    const char* kind_names[n_kinds] = { "all 0", "all 255", "constant", "mixed 0/255/interior", "0 and 255", "255 and interior",
+        "0 and interior", "narrow range", "gradient", "random" };
+    for (int k = 0; k < n_kinds; ++k)
+        check(mismatches[k] == 0, std::string(kind_names[k]) + ": SSE2 and scalar blocks identical" + (mismatches[k] ? " (" + std::to_string(mismatches[k]) + " differ)" : ""));
+    check(simd_stats == scalar_stats, "SSE2 stats match the scalar stats (" + to_string(simd_stats) + ")");
+    check(scalar_stats == decoded_stats, "stats match the error of the decoded blocks (" + to_string(decoded_stats) + ")");
+
+    // lossless edge cases: constant blocks and blocks of only 0 and 255 (both endpoints exact in mode 1)
+    BC4Stats lossless;
+    for (int kind : { 0, 1, 2, 4 }) {
+        for (int k = 0; k < 64; ++k) {
+            uint8_t texels[16], block[8], decoded[16];
+            fill_block(kind, rng, texels);
+            bc4_encode_block(texels, 4, block, lossless);
+            bc4_decode_block(block, decoded);
+            if (!std::equal(texels, texels + 16, decoded))
+                lossless.max_error = std::max(lossless.max_error, 1u);
+        }
+    }
+    check(lossless.squared_error == 0 && lossless.max_error == 0, "constant and 0/255 blocks are lossless");
+
+    std::cout << (failures ? std::to_string(failures) + " check(s) FAILED" : "all checks ok") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <voldata.h>
+
+// --------------------------------------------------------------
+// synthetic inputs and image comparison shared by the benches and checks
+
+// sky: gradient plus small, bright sun
+inline std::vector<glm::vec3> synthetic_envmap(const glm::uvec2& size) {
+    std::vector<glm::vec3> data(size_t(size.x) * size.y);
+    for (uint32_t y = 0; y < size.y; ++y) {
+        for (uint32_t x = 0; x < size.x; ++x) {
+            const glm::vec2 uv = (glm::vec2(x, y) + .5f) / glm::vec2(size);
+            const float sun = glm::length(uv - glm::vec2(.3f, .8f)) < .01f ? 1000.f : 0.f;
+            data[size_t(y) * size.x + x] = glm::mix(glm::vec3(.3f, .25f, .2f), glm::vec3(.4f, .6f, 1.f), uv.y) + sun;
+        }
+    }
+    return data;
+}
+
+// n^3 sphere centered in the grid: scale * max(0, 1 - falloff * distance to the center) with distances relative to n
+inline voldata::Volume::GridPtr synthetic_sphere(int n, float falloff, float scale = 1.f) {
+    std::vector<float> values(size_t(n) * n * n);
+    for (int z = 0; z < n; ++z)
+        for (int y = 0; y < n; ++y)
+            for (int x = 0; x < n; ++x) {
+                const float r = glm::length((glm::vec3(x, y, z) + .5f) / float(n) - .5f);
+                values[(size_t(z) * n + y) * n + x] = std::max(0.f, 1.f - falloff * r) * scale;
+            }
+    return std::make_shared<voldata::DenseGrid>(n, n, n, values.data());
+}
+
+// relative RMS difference of the rgb channels to a reference image
+inline double relative_rmse(const std::vector<glm::vec4>& img, const std::vector<glm::vec4>& ref) {
+    double err = 0, norm = 0;
+    for (size_t i = 0; i < img.size(); ++i) {
+        const glm::vec3 d = glm::vec3(img[i]) - glm::vec3(ref[i]);
+        err += glm::dot(d, d);
+        norm += glm::dot(glm::vec3(ref[i]), glm::vec3(ref[i]));
+    }
+    return std::sqrt(err / std::max(norm, 1e-12));
+}
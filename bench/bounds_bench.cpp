@@ -0,0 +1,111 @@
+// render time with the volume AABB vs. the tight per-frame bounds of the occupied bricks as ray entry bounds
+// usage: bounds_bench [volume file or folder] [transfer function lut] [--cpu] [--spp N] [--res N]
+// (default: data/smoke.brick, OpenGL via EGL (headless), falls back to the CPU backend without EGL)
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include "renderer.h"
+#include "renderer_cpu.h"
+#include "glcontext.h"
+#include "volume_loader.h"
+#include "bench_util.h"
+
+using namespace cppgl;
+
+// mean luminance of an image
+static double mean_luminance(const std::vector<glm::vec4>& img) {
+    double sum = 0;
+    for (const auto& c : img) sum += glm::dot(glm::vec3(c), glm::vec3(0.2126f, 0.7152f, 0.0722f));
+    return sum / std::max(size_t(1), img.size());
+}
+
+static std::vector<glm::vec4> readback(Renderer& renderer) {
+    if (auto cpu = dynamic_cast<RendererCPU*>(&renderer))
+        return cpu->color;
+    const Texture2D& color = static_cast<RendererOpenGL&>(renderer).color;
+    std::vector<glm::vec4> img(size_t(color->w) * color->h);
+    color->bind(0);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &img[0].x);
+    color->unbind();
+    return img;
+}
+
+// render current frame, returns seconds
+static double render(Renderer& renderer) {
+    renderer.reset();
+    if (gl_context_current()) glFinish();
+    const auto start = std::chrono::steady_clock::now();
+    while (renderer.sample < renderer.sppx)
+        renderer.trace();
+    if (gl_context_current()) glFinish();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    std::string path = "data/smoke.brick", lut;
+    bool cpu = false;
+    int spp = 64, res = 512;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--cpu") cpu = true;
+        else if (arg == "--spp") spp = std::stoi(argv[++i]);
+        else if (arg == "--res") res = std::stoi(argv[++i]);
+        else if (std::filesystem::path(arg).extension() == ".txt") lut = arg;
+        else path = arg;
+    }
+
+    // setup renderer
+    std::shared_ptr<Renderer> renderer;
+    if (!cpu) {
+        try {
+            headless_init(res, res);
+            renderer = std::make_shared<RendererOpenGL>();
+        } catch (std::runtime_error& e) {
+            std::cerr << "no headless OpenGL context (" << e.what() << "), using CPU backend" << std::endl;
+        }
+    }
+    if (!renderer) {
+        renderer = std::make_shared<RendererCPU>();
+        renderer->resize(res, res);
+    }
+    renderer->init();
+    renderer->sppx = spp;
+    renderer->samples_per_dispatch = std::min(spp, 8);
+    current_camera()->pos = glm::vec3(1, 0, 1);
+    current_camera()->dir = glm::normalize(-current_camera()->pos);
+    if (gl_context_current()) gl_update_camera();
+
+    // load volume (folder: animation) and transfer function
+    renderer->volume = std::filesystem::is_directory(path) ? load_folder_parallel(path, FRAME_GRID_NAMES) : std::make_shared<voldata::Volume>(path);
+    renderer->scale_and_move_to_unit_cube();
+    renderer->commit();
+    if (!lut.empty()) {
+        renderer->transferfunc = std::make_shared<TransferFunction>(lut);
+        if (gl_context_current()) renderer->transferfunc->upload_gpu();
+    }
+    std::cout << (gl_context_current() ? "OpenGL" : "CPU") << " backend, " << res << "x" << res << ", " << spp << " spp, " << renderer->n_frames() << " frame(s)" << std::endl;
+
+    // render each frame with full and tight bounds
+    double total_full = 0, total_tight = 0, max_rmse = 0;
+    std::cout << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < renderer->n_frames(); ++i) {
+        renderer->set_frame(i);
+        renderer->tight_bounds = false;
+        const double t_full = render(*renderer);
+        const std::vector<glm::vec4> ref = readback(*renderer);
+        renderer->tight_bounds = true;
+        const double t_tight = render(*renderer);
+        const std::vector<glm::vec4> img = readback(*renderer);
+        total_full += t_full;
+        total_tight += t_tight;
+        max_rmse = std::max(max_rmse, relative_rmse(img, ref));
+        std::cout << "frame " << i << ": full " << t_full << "s, tight " << t_tight << "s (" << t_full / std::max(t_tight, 1e-9) << "x), " <<
+            "mean luminance " << mean_luminance(ref) << " / " << mean_luminance(img) << std::endl;
+    }
+    std::cout << "total: full " << total_full << "s, tight " << total_tight << "s (" << total_full / std::max(total_tight, 1e-9) << "x)" << std::endl;
+    std::cout << "max. relative rmse (tight vs. full): " << max_rmse << std::endl;
+    if (gl_context_current()) headless_shutdown();
+    return 0;
+}
@@ -0,0 +1,95 @@
+// microbenchmark for the batched brick grid lookups (single thread)
+// usage: brick_lookup_bench [volume file] [num lookups]
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <voldata.h>
+#include "brick_lookup.h"
+
+struct Positions {
+    std::vector<float> x, y, z;
+    std::vector<uint32_t> seeds;
+};
+
+static double lookups_per_sec(const std::function<void()>& run, size_t N) {
+    run(); // warmup
+    int reps = 0;
+    const auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        run();
+        ++reps;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < 0.5);
+    return reps * double(N) / elapsed;
+}
+
+int main(int argc, char** argv) {
+    const std::string path = argc > 1 ? argv[1] : "data/smoke.brick";
+    const size_t N = argc > 2 ? std::stoul(argv[2]) : 1 << 20;
+
+    // load grid
+    auto volume = std::make_shared<voldata::Volume>(path);
+    const auto grid = voldata::Volume::to_brick_grid(volume->current_grid());
+    const glm::vec3 extent = glm::vec3(grid->index_extent());
+    std::cout << "grid: " << path << " (" << extent.x << "x" << extent.y << "x" << extent.z << ")" << std::endl;
+
+    // random index-space positions
+    Positions pos;
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> dist(0.f, 1.f);
+    for (size_t i = 0; i < N; ++i) {
+        pos.x.push_back(dist(gen) * extent.x);
+        pos.y.push_back(dist(gen) * extent.y);
+        pos.z.push_back(dist(gen) * extent.z);
+        pos.seeds.push_back(gen());
+    }
+
+    BrickGridLookup lookup(std::make_shared<HostBrickGrid>(grid), 1.f);
+    const BrickGridLookup::ISA best = lookup.best_isa();
+    std::cout << "best isa: " << BrickGridLookup::isa_name(best) << std::endl;
+
+    // run all lookup kinds for given isa, returns results for validation
+    struct Kind {
+        std::string name;
+        std::function<void()> run;
+        size_t n_out;       // values written to out
+        bool uses_seeds;    // advances seeds
+    };
+    const size_t n_majorants = N * std::max(lookup.n_mip_levels(), 1);
+    std::vector<float> out(n_majorants);
+    std::vector<uint32_t> seeds(N);
+    const auto kinds = std::vector<Kind>{
+        { "nearest", [&]() { lookup.density(pos.x.data(), pos.y.data(), pos.z.data(), out.data(), N); }, N, false },
+        { "trilinear", [&]() { lookup.density_trilinear(pos.x.data(), pos.y.data(), pos.z.data(), out.data(), N); }, N, false },
+        { "stochastic", [&]() { seeds = pos.seeds; lookup.density_stochastic(pos.x.data(), pos.y.data(), pos.z.data(), seeds.data(), out.data(), N); }, N, true },
+        { "majorants", [&]() { lookup.majorants(pos.x.data(), pos.y.data(), pos.z.data(), out.data(), N); }, n_majorants, false },
+    };
+
+    // scalar reference results (only the values each kind writes, seeds only of the stochastic lookups)
+    std::vector<std::vector<float>> reference;
+    std::vector<std::vector<uint32_t>> reference_seeds;
+    lookup.isa = BrickGridLookup::SCALAR;
+    for (const auto& kind : kinds) {
+        kind.run();
+        reference.emplace_back(out.begin(), out.begin() + kind.n_out);
+        reference_seeds.push_back(kind.uses_seeds ? seeds : std::vector<uint32_t>());
+    }
+
+    bool ok = true;
+    std::cout << std::left << std::setw(12) << "isa" << std::setw(12) << "lookup" << std::setw(16) << "Mlookups/s" << "bit-exact" << std::endl;
+    for (int isa = BrickGridLookup::SCALAR; isa <= best; ++isa) {
+        lookup.isa = BrickGridLookup::ISA(isa);
+        for (size_t k = 0; k < kinds.size(); ++k) {
+            const double throughput = lookups_per_sec(kinds[k].run, N);
+            const bool exact = std::memcmp(out.data(), reference[k].data(), kinds[k].n_out * sizeof(float)) == 0 && (!kinds[k].uses_seeds || seeds == reference_seeds[k]);
+            ok = ok && exact;
+            std::cout << std::left << std::setw(12) << BrickGridLookup::isa_name(lookup.isa) << std::setw(12) << kinds[k].name
+                << std::setw(16) << std::fixed << std::setprecision(1) << throughput * 1e-6 << (exact ? "yes" : "NO") << std::endl;
+        }
+    }
+    return ok ? 0 : 1;
+}
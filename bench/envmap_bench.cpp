@@ -0,0 +1,127 @@
+// build time of the environment importance pyramid on the CPU, checked against the GPU reference (shader/env_setup.glsl)
+// usage: envmap_bench [hdr files] (default: synthetic 1k to 16k envmaps), GPU check requires EGL (headless)
+// for files, also reports Environment load times with a cold, disk (half-float) and memory envmap cache
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <unistd.h>
+#include <cppgl.h>
+#include "environment.h"
+#include "headless.h"
+#include "brick_cache.h"
+#include "bench_util.h"
+
+using namespace cppgl;
+
+// importance pyramid built by shader/env_setup.glsl and glGenerateMipmap, same sampling pattern as Environment::build_importance
+static std::vector<std::vector<float>> build_importance_gpu(const std::vector<glm::vec3>& envmap, const glm::uvec2& size, uint32_t dim, double& seconds) {
+    Texture2D tex = Texture2D("bench_envmap", size.x, size.y, GL_RGB32F, GL_RGB, GL_FLOAT, &envmap[0].x);
+    tex->bind(0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    tex->unbind();
+    Texture2D impmap = Texture2D("bench_importance", dim, dim, GL_R32F, GL_RED, GL_FLOAT);
+    static Shader setup_shader = Shader("env_setup", "shader/env_setup.glsl");
+    const glm::uvec2 n_samples = glm::max(glm::uvec2(4), (size + dim - 1u) / dim);
+    glFinish();
+    const auto start = std::chrono::steady_clock::now();
+    setup_shader->bind();
+    impmap->bind_image(0, GL_WRITE_ONLY, GL_R32F);
+    setup_shader->uniform("envmap", tex, 0);
+    setup_shader->uniform("output_size", glm::ivec2(dim));
+    setup_shader->uniform("output_size_samples", glm::ivec2(dim * n_samples));
+    setup_shader->uniform("num_samples", glm::ivec2(n_samples));
+    setup_shader->uniform("inv_samples", 1.f / (n_samples.x * n_samples.y));
+    setup_shader->dispatch_compute(dim, dim);
+    impmap->unbind_image(0);
+    setup_shader->unbind();
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    impmap->bind(0);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glFinish();
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::vector<std::vector<float>> pyramid;
+    for (uint32_t d = dim, mip = 0; d >= 1; d /= 2, ++mip) {
+        pyramid.emplace_back(size_t(d) * d);
+        glGetTexImage(GL_TEXTURE_2D, mip, GL_RED, GL_FLOAT, pyramid.back().data());
+    }
+    impmap->unbind();
+    return pyramid;
+}
+
+int main(int argc, char** argv) {
+    BrickCache::directory = (fs::temp_directory_path() / ("envmap_bench_" + std::to_string(getpid()))).string();
+    bool gpu = true;
+    try {
+        headless_init(64, 64);
+    } catch (std::runtime_error& e) {
+        std::cerr << "no OpenGL context, skipping GPU check: " << e.what() << std::endl;
+        gpu = false;
+    }
+
+    std::vector<std::string> inputs(argv + 1, argv + argc);
+    if (inputs.empty())
+        inputs = { "1k", "2k", "4k", "8k", "16k" };
+
+    int failed = 0;
+    for (const auto& input : inputs) {
+        glm::uvec2 size;
+        std::vector<glm::vec3> envmap;
+        if (input.back() == 'k' && input.size() <= 3) {
+            size = glm::uvec2(1024 * std::stoul(input), 512 * std::stoul(input));
+            envmap = synthetic_envmap(size);
+        } else
+            envmap = Environment::load_hdr(input, size);
+        const uint32_t dim = Environment::importance_dimension(size);
+
+        // CPU build (all cores)
+        auto start = std::chrono::steady_clock::now();
+        const auto pyramid = Environment::build_importance(envmap, size, dim);
+        const double cpu_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::setw(12) << input << " (" << size.x << "x" << size.y << "): " << dim << "^2 importance, " <<
+            pyramid.size() << " levels, cpu: " << std::fixed << std::setprecision(1) << cpu_seconds * 1000 << "ms";
+
+        // check against GPU
+        if (gpu) {
+            double gpu_seconds = 0;
+            const auto reference = build_importance_gpu(envmap, size, dim, gpu_seconds);
+            float max_error = 0.f;
+            const float avg = reference.back()[0];
+            for (size_t mip = 0; mip < pyramid.size(); ++mip)
+                for (size_t i = 0; i < pyramid[mip].size(); ++i)
+                    max_error = std::max(max_error, std::abs(pyramid[mip][i] - reference[mip][i]) / std::max(std::abs(reference[mip][i]), 1e-3f * avg));
+            const bool ok = max_error < 1e-2f;
+            failed += ok ? 0 : 1;
+            std::cout << ", gpu: " << gpu_seconds * 1000 << "ms, max. rel. error: " << std::scientific << std::setprecision(2) << max_error << (ok ? " OK" : " FAILED");
+        }
+        std::cout << std::endl;
+
+        // envmap cache (in a temporary directory)
+        if (input.back() != 'k' || input.size() > 3) {
+            const auto load_ms = [&]() {
+                const auto start = std::chrono::steady_clock::now();
+                Environment env(input);
+                if (gpu) glFinish();
+                return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            };
+            const double cold = load_ms();
+            EnvironmentCache::clear();
+            const double disk = load_ms();
+            const double memory = load_ms();
+            std::cout << std::setw(12) << "" << "  load: " << std::fixed << std::setprecision(1) << cold << "ms (cold), " <<
+                disk << "ms (disk cache), " << std::setprecision(3) << memory << "ms (memory cache)" << std::endl;
+            if (EnvironmentCache::misses != 1 || EnvironmentCache::disk_hits != 1 || EnvironmentCache::hits != 1) {
+                std::cout << std::setw(12) << "" << "  envmap cache FAILED" << std::endl;
+                ++failed;
+            }
+            EnvironmentCache::clear();
+            EnvironmentCache::misses = EnvironmentCache::disk_hits = EnvironmentCache::hits = 0;
+            fs::remove_all(BrickCache::directory);
+        }
+    }
+    headless_shutdown();
+    return failed;
+}
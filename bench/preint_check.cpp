@@ -0,0 +1,115 @@
+// accuracy of the pre-integrated transfer function (TransferFunction::compute_preintegrated()) along 1D rays:
+// emission-absorption with slabs as in direct_volume_rendering_preintegrated() and point samples as in direct_volume_rendering(),
+// both against a 1M step reference, for a lut with a thin opacity spike (as is and as uploaded, i.e. its density cdf with a sharp step),
+// exits with 1 if the slabs exceed the tolerance
+// usage: preint_check [--slabs N] [--tol error]
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "transferfunc.h"
+
+// lut with a smooth color ramp and an opacity spike one entry wide
+static std::vector<glm::vec4> spike_lut(int n = 64, int spike = 40) {
+    std::vector<glm::vec4> lut(n);
+    for (int i = 0; i < n; ++i)
+        lut[i] = glm::vec4(i / float(n - 1), .5f, 1.f - i / float(n - 1), i == spike ? 1.f : 0.f);
+    return lut;
+}
+
+// tf_lookup() with the window [0, 1]
+static glm::dvec4 tf_lookup(const std::vector<glm::vec4>& lut, double d) {
+    const double tc = std::clamp(d, 0.0, 1.0 - 1e-6) * lut.size();
+    const size_t idx = size_t(tc);
+    return glm::mix(glm::dvec4(lut[idx]), glm::dvec4(lut[std::min(idx + 1, lut.size() - 1)]), tc - idx);
+}
+
+// bilinear lookup of the table at window coordinates (front, back), as tf_preintegrated() inside the window
+static glm::dvec4 preint_lookup(const std::vector<glm::vec4>& table, uint32_t size, double front, double back) {
+    const double x = std::clamp(front, 0.0, 1.0) * (size - 1), y = std::clamp(back, 0.0, 1.0) * (size - 1);
+    const uint32_t x0 = std::min(uint32_t(x), size - 2), y0 = std::min(uint32_t(y), size - 2);
+    const double fx = x - x0, fy = y - y0;
+    const auto texel = [&](uint32_t i, uint32_t j) { return glm::dvec4(table[size_t(j) * size + i]); };
+    return glm::mix(glm::mix(texel(x0, y0), texel(x0 + 1, y0), fx), glm::mix(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), fx), fy);
+}
+
+// ray of unit length through a linear density ramp from d0 to d1, scaled by the majorant
+struct Ray {
+    double d0, d1, majorant;
+    double density(double s) const { return d0 + (d1 - d0) * s; }
+};
+
+// radiance and opacity of point sampled emission-absorption with n steps (midpoints)
+static glm::dvec4 point_samples(const std::vector<glm::vec4>& lut, const Ray& ray, int n) {
+    const double dt = 1.0 / n;
+    glm::dvec3 L(0);
+    double Tr = 1;
+    for (int i = 0; i < n; ++i) {
+        const glm::dvec4 rgba = tf_lookup(lut, ray.density((i + .5) * dt));
+        const double dtau = rgba.a * ray.majorant * dt;
+        L += glm::dvec3(rgba) * dtau * Tr;
+        Tr *= std::exp(-dtau);
+    }
+    return glm::dvec4(L, 1 - Tr);
+}
+
+// radiance and opacity of n pre-integrated slabs
+static glm::dvec4 slabs(const std::vector<glm::vec4>& table, uint32_t size, const Ray& ray, int n) {
+    const double dt = 1.0 / n;
+    glm::dvec3 L(0);
+    double Tr = 1;
+    for (int i = 0; i < n; ++i) {
+        const glm::dvec4 slab = preint_lookup(table, size, ray.density(i * dt), ray.density((i + 1) * dt));
+        const double alpha = 1 - std::exp(-slab.a * ray.majorant * dt);
+        L += Tr * alpha * (slab.a > 0 ? glm::dvec3(slab) / slab.a : glm::dvec3(0));
+        Tr *= 1 - alpha;
+    }
+    return glm::dvec4(L, 1 - Tr);
+}
+
+static double max_abs_diff(const glm::dvec4& a, const glm::dvec4& b) {
+    const glm::dvec4 d = glm::abs(a - b);
+    return std::max(std::max(d.x, d.y), std::max(d.z, d.w));
+}
+
+int main(int argc, char** argv) {
+    int n_slabs = 32;
+    double tolerance = 0.01;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--slabs") n_slabs = std::stoi(argv[++i]);
+        else if (arg == "--tol") tolerance = std::stod(argv[++i]);
+    }
+
+    std::vector<Ray> rays;
+    for (const double majorant : { 1.0, 10.0, 50.0 })
+        for (const auto& [d0, d1] : std::vector<std::pair<double, double>>{ { 0, 1 }, { 1, 0 }, { .3, .9 }, { .6, .65 }, { .62, .63 } })
+            rays.push_back(Ray{ d0, d1, majorant });
+
+    int failures = 0;
+    const std::vector<glm::vec4> spike = spike_lut();
+    for (const auto& [name, lut] : { std::make_pair("spike", spike), std::make_pair("spike cdf", TransferFunction::compute_lut_cdf(spike)) }) {
+        const uint32_t size = 256;
+        const std::vector<glm::vec4> table = TransferFunction::compute_preintegrated(lut, size);
+        std::vector<glm::dvec4> reference;
+        for (const auto& ray : rays)
+            reference.push_back(point_samples(lut, ray, 1 << 20));
+        // max. error over all rays and (rgb, alpha)
+        const auto max_error = [&](const auto& integrate) {
+            double error = 0;
+            for (size_t i = 0; i < rays.size(); ++i)
+                error = std::max(error, max_abs_diff(integrate(rays[i]), reference[i]));
+            return error;
+        };
+        const double slab_error = max_error([&](const Ray& ray) { return slabs(table, size, ray, n_slabs); });
+        std::cout << name << ":" << std::endl << std::fixed << std::setprecision(4) <<
+            std::setw(6) << n_slabs << " pre-integrated slabs: max. error " << slab_error << std::endl;
+        for (int n = 32; n <= 2048; n *= 2)
+            std::cout << std::setw(6) << n << " point samples:        max. error " << max_error([&](const Ray& ray) { return point_samples(lut, ray, n); }) << std::endl;
+        if (slab_error > tolerance) ++failures;
+    }
+    std::cout << (failures ? "FAILED" : "ok") << " (tol " << tolerance << ")" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+// end-to-end render regression check: renders canned scenes headless with fixed seed and camera (on Mesa llvmpipe by default),
+// compares them to the reference images in the repository and to a machine-local throughput baseline (optional),
+// exits with 1 on quality or throughput regressions or missing reference images
+// usage: render_regression [scenes] [--update] [--update-baseline] [--references dir] [--baseline dir] [--res N] [--spp N] [--rmse tol] [--slowdown tol] [--hardware]
+// (scenes: smoke, smoke_tf, emission, default: all; --update writes the current images as new references,
+// --update-baseline the current throughput as new local baseline)
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <cstdlib>
+#include <voldata.h>
+#include "renderer.h"
+#include "glcontext.h"
+#include "image_io.h"
+#include "report.h"
+#include "brick_cache.h"
+#include "volume_loader.h"
+#include "bench_util.h"
+
+namespace fs = std::filesystem;
+using namespace cppgl;
+
+// --------------------------------------------------------------
+// canned scenes
+
+struct Scene {
+    std::string name;
+    std::function<void(Renderer&)> setup;
+};
+
+// density sphere with a hot core (temperature grid as emission)
+static std::shared_ptr<voldata::Volume> synthetic_emissive(int n) {
+    auto volume = std::make_shared<voldata::Volume>(synthetic_sphere(n, 2.f));
+    volume->update_grid_frame(volume->grid_frame_counter, synthetic_sphere(n, 4.f, 1500.f), "temperature");
+    return volume;
+}
+
+static const std::vector<Scene> SCENES = {
+    { "smoke", [](Renderer& renderer) {
+        renderer.volume = std::make_shared<voldata::Volume>("data/smoke.brick");
+        renderer.environment = std::make_shared<Environment>("data/table_mountain_2_puresky_1k.hdr");
+    } },
+    { "smoke_tf", [](Renderer& renderer) {
+        renderer.volume = std::make_shared<voldata::Volume>("data/smoke.brick");
+        renderer.environment = std::make_shared<Environment>("data/table_mountain_2_puresky_1k.hdr");
+        renderer.transferfunc = std::make_shared<TransferFunction>("data/lut.txt");
+        renderer.transferfunc->upload_gpu();
+        renderer.show_environment = false;
+    } },
+    { "emission", [](Renderer& renderer) {
+        renderer.volume = synthetic_emissive(64);
+        renderer.environment = std::make_shared<Environment>(glm::vec3(.1f));
+        renderer.density_scale = 20.f;
+    } },
+};
+
+// --------------------------------------------------------------
+// helpers
+
+struct Result {
+    double samples_per_sec = 0;
+    double ms_per_trace = 0;
+};
+
+// value of "key": number in a flat JSON object
+static double json_number(const std::string& json, const std::string& key) {
+    const size_t pos = json.find("\"" + key + "\"");
+    if (pos == std::string::npos) return 0;
+    return std::strtod(json.c_str() + json.find(':', pos) + 1, nullptr);
+}
+
+static std::string read_file(const fs::path& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// render scene with fixed seed and camera, returns throughput
+static Result render(RendererOpenGL& renderer, const Scene& scene, int spp) {
+    renderer.volume.reset();
+    renderer.transferfunc.reset();
+    renderer.show_environment = true;
+    renderer.density_scale = 1.f;
+    scene.setup(renderer);
+    const float density_scale = renderer.density_scale;
+    renderer.scale_and_move_to_unit_cube();
+    renderer.density_scale *= density_scale;
+    renderer.commit();
+    renderer.seed = 42;
+    renderer.sppx = spp;
+    renderer.samples_per_dispatch = 1;
+    current_camera()->pos = glm::vec3(1, 0, 1);
+    current_camera()->dir = glm::normalize(-current_camera()->pos);
+    current_camera()->fov_degree = 70.f;
+    gl_update_camera();
+    // warmup (shader specialization, transfer function majorants, lazy uploads), then measure
+    renderer.reset();
+    renderer.trace();
+    renderer.reset();
+    glFinish();
+    double seconds = 0;
+    while (renderer.sample < renderer.sppx) {
+        const auto start = std::chrono::steady_clock::now();
+        renderer.trace();
+        glFinish();
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return Result{ renderer.pixel_samples / seconds, seconds * 1e3 / renderer.sample };
+}
+
+int main(int argc, char** argv) {
+    fs::path references = "bench/references", baseline = "bench/references/local";
+    int res = 256, spp = 16;
+    double rmse_tolerance = 0.01, slowdown_tolerance = 0.25;
+    bool update = false, update_baseline = false, hardware = false;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--update") update = true;
+        else if (arg == "--update-baseline") update_baseline = true;
+        else if (arg == "--references") references = argv[++i];
+        else if (arg == "--baseline") baseline = argv[++i];
+        else if (arg == "--res") res = std::stoi(argv[++i]);
+        else if (arg == "--spp") spp = std::stoi(argv[++i]);
+        else if (arg == "--rmse") rmse_tolerance = std::stod(argv[++i]);
+        else if (arg == "--slowdown") slowdown_tolerance = std::stod(argv[++i]);
+        else if (arg == "--hardware") hardware = true;
+        else names.push_back(arg);
+    }
+
+    // software rasterizer for results independent of the GPU and driver, no caches for hermetic runs
+    if (!hardware)
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+    BrickCache::enabled = false;
+    EnvironmentCache::persist = false;
+    headless_init(res, res);
+    std::cout << "GL renderer: " << glGetString(GL_RENDERER) << ", " << res << "x" << res << ", " << spp << " spp" << std::endl;
+    RendererOpenGL renderer;
+    renderer.init();
+    if (update)
+        fs::create_directories(references);
+    if (update_baseline)
+        fs::create_directories(baseline);
+
+    int failures = 0;
+    for (const Scene& scene : SCENES) {
+        if (!names.empty() && std::find(names.begin(), names.end(), scene.name) == names.end()) continue;
+        const Result result = render(renderer, scene, spp);
+        std::vector<glm::vec4> img(size_t(res) * res);
+        renderer.color->bind(0);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &img[0].x);
+        renderer.color->unbind();
+        const fs::path ref_image = references / (scene.name + ".exr"), ref_stats = baseline / (scene.name + ".json");
+        std::cout << std::left << std::setw(10) << scene.name << std::right << std::fixed << std::setprecision(2) <<
+            std::setw(10) << result.samples_per_sec / 1e6 << " M samples/s" << std::setw(10) << result.ms_per_trace << " ms/trace";
+        if (update || update_baseline) {
+            if (update)
+                image_store_exr(ref_image.string(), img.data(), res, res, false);
+            if (update_baseline) {
+                std::ofstream out(ref_stats);
+                out << std::setprecision(9) << "{ \"renderer\": " << json_string((const char*)glGetString(GL_RENDERER)) << ", \"res\": " << res << ", \"spp\": " << spp <<
+                    ", \"samples_per_sec\": " << result.samples_per_sec << ", \"ms_per_trace\": " << result.ms_per_trace << " }" << std::endl;
+            }
+            std::cout << (update ? "  reference updated" : "") << (update_baseline ? "  baseline updated" : "") << std::endl;
+            continue;
+        }
+        if (!fs::exists(ref_image)) {
+            std::cout << "  no reference image " << ref_image << "  FAILED" << std::endl;
+            ++failures;
+            continue;
+        }
+        // quality: relative rmse to reference image (same seed, so expected to match up to floating point differences)
+        uint32_t w, h;
+        const std::vector<glm::vec4> ref = image_load_exr(ref_image.string(), w, h);
+        const double rmse = w == uint32_t(res) && h == uint32_t(res) ? relative_rmse(img, ref) : INFINITY;
+        // throughput: samples per second relative to the local baseline, if any
+        const double ref_samples_per_sec = fs::exists(ref_stats) ? json_number(read_file(ref_stats), "samples_per_sec") : 0.0;
+        const double slowdown = ref_samples_per_sec > 0 ? 1.0 - result.samples_per_sec / ref_samples_per_sec : 0.0;
+        const bool ok = rmse <= rmse_tolerance && slowdown <= slowdown_tolerance;
+        std::cout << "  rmse " << std::setprecision(4) << rmse << " (tol " << rmse_tolerance << "), ";
+        if (ref_samples_per_sec > 0)
+            std::cout << std::setprecision(1) << 100 * slowdown << "% slower (tol " << 100 * slowdown_tolerance << "%)";
+        else
+            std::cout << "no local throughput baseline";
+        std::cout << (ok ? "  ok" : "  FAILED") << std::endl;
+        if (!ok) {
+            image_store_exr(scene.name + "_failed.exr", img.data(), res, res, false);
+            ++failures;
+        }
+    }
+    headless_shutdown();
+    std::cout << (failures ? std::to_string(failures) + " scene(s) FAILED" : "all scenes ok") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+// brick texture residency check: uploads synthetic frames headless (on Mesa llvmpipe by default) with a VRAM budget
+// smaller than two frames, steps through the frames and checks the hit, miss, eviction and upload counters
+// usage: residency_check [--frames N] [--size N] [--hardware]
+#include <cstdlib>
+#include <iostream>
+#include <voldata.h>
+#include "renderer.h"
+#include "glcontext.h"
+#include "bench_util.h"
+
+using namespace cppgl;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    std::cout << (ok ? "  ok      " : "  FAILED  ") << what << std::endl;
+    if (!ok) ++failures;
+}
+
+// density sphere with per-frame amplitude, so frames differ in content but not in texture size
+static BrickFrame synthetic_frame(int n, int frame) {
+    BrickFrame result;
+    result.density = std::make_shared<HostBrickGrid>(voldata::Volume::to_brick_grid(synthetic_sphere(n, 3.f, 1.f + frame)));
+    result.density->encode_atlas_bc4();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    int n_frames = 3, size = 64;
+    bool hardware = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--frames") n_frames = std::max(3, std::stoi(argv[++i]));
+        else if (arg == "--size") size = std::stoi(argv[++i]);
+        else if (arg == "--hardware") hardware = true;
+    }
+
+    if (!hardware)
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+    headless_init(64, 64);
+    std::cout << "GL renderer: " << glGetString(GL_RENDERER) << ", " << n_frames << " frames of " << size << "^3" << std::endl;
+    RendererOpenGL renderer;
+    renderer.init();
+
+    // count uploads of the actual texture creation
+    uint64_t uploads = 0;
+    BrickResidency residency([&](const HostBrickGrid& grid) { ++uploads; return renderer.brick_grid_to_textures(grid); });
+    std::vector<BrickFrame> frames;
+    for (int i = 0; i < n_frames; ++i)
+        frames.push_back(synthetic_frame(size, i));
+    size_t max_bytes = 0;
+    for (const auto& frame : frames)
+        max_bytes = std::max(max_bytes, frame.density->texture_bytes());
+    residency.budget_bytes = max_bytes * 3 / 2;
+    for (const auto& frame : frames)
+        residency.add(frame);
+    std::cout << "frame textures: " << max_bytes / 1e6 << " MB, budget: " << residency.budget_bytes / 1e6 << " MB" << std::endl;
+    check(residency.resident_frames == 1 && uploads == 1, "only the first frame is uploaded on add");
+
+    // every step to another frame evicts the previously resident one and uploads the new one
+    residency.reset_counters();
+    uploads = 0;
+    const int n_rounds = 2;
+    for (int round = 0; round < n_rounds; ++round) {
+        for (int i = 0; i < n_frames; ++i) {
+            BrickResidency::Frame& frame = residency.acquire(i);
+            if (!frame.resident || !frame.density.atlas || !glIsTexture(*frame.density.atlas) || !frame.density.indirection)
+                check(false, "frame " + std::to_string(i) + " resident after acquire");
+            if (residency.resident_bytes > residency.budget_bytes)
+                check(false, "budget exceeded after acquiring frame " + std::to_string(i));
+        }
+    }
+    const uint64_t steps = uint64_t(n_rounds) * n_frames;
+    check(residency.hits == 1, "hits: " + std::to_string(residency.hits) + " (expected 1, frame 0 was resident)");
+    check(residency.misses == steps - 1, "misses: " + std::to_string(residency.misses) + " (expected " + std::to_string(steps - 1) + ")");
+    check(residency.evictions == steps - 1, "evictions: " + std::to_string(residency.evictions) + " (expected " + std::to_string(steps - 1) + ")");
+    check(uploads == steps - 1, "uploads: " + std::to_string(uploads) + " (expected " + std::to_string(steps - 1) + ")");
+    check(residency.resident_frames == 1 && residency.resident_bytes <= residency.budget_bytes, "one frame resident within budget");
+
+    // repeated access to the resident frame hits, without uploads or evictions
+    residency.reset_counters();
+    uploads = 0;
+    for (int k = 0; k < 4; ++k)
+        residency.acquire(n_frames - 1);
+    check(residency.hits == 4 && residency.misses == 0 && residency.evictions == 0 && uploads == 0, "repeated access to the resident frame hits");
+
+    // textures of evicted frames are released
+    const BrickResidency::Frame& first = residency.acquire(0);
+    const GLuint atlas = *first.density.atlas;
+    residency.acquire(1);
+    check(!first.resident && !first.density.atlas && !first.density.indirection && !glIsTexture(atlas), "evicted frame textures are released");
+
+    check(glGetError() == GL_NO_ERROR, "no GL error");
+
+    headless_shutdown();
+    std::cout << (failures ? std::to_string(failures) + " check(s) FAILED" : "all checks ok") << std::endl;
+    return failures ? 1 : 0;
+}
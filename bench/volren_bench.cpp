@@ -0,0 +1,240 @@
+// wall time, throughput and peak memory of the CPU-side pipeline stages outside of tracing, reported as JSON
+// usage: volren_bench [volume files] [--size N] [--envmap-size N] [--threads N] [--json file]
+// (default: synthetic dense and sparse 256^3 grids plus data/smoke.brick, synthetic 2048x1024 envmap plus the shipped envmap)
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <functional>
+#include <unistd.h>
+#include <voldata.h>
+#include "renderer_cpu.h"
+#include "environment.h"
+#include "transferfunc.h"
+#include "image_io.h"
+#include "telemetry.h"
+#include "report.h"
+#include "bench_util.h"
+
+namespace fs = std::filesystem;
+using namespace cppgl;
+
+// --------------------------------------------------------------
+// helpers
+
+struct StageResult {
+    std::string stage, input;
+    double seconds = 0;         // per iteration
+    uint32_t iterations = 0;
+    double items = 0;           // per iteration (voxels, texels, lut entries or pixels)
+    std::string item_name;
+    double bytes = 0;           // per iteration
+    size_t peak_rss = 0;        // during the stage, in bytes
+};
+
+static std::vector<StageResult> results;
+
+// /proc/self/status entry in bytes
+static size_t proc_status_bytes(const std::string& key) {
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, key.size() + 1, key + ":") == 0)
+            return std::stoull(line.substr(key.size() + 1)) * 1024;
+    }
+    return 0;
+}
+
+// reset the peak RSS (VmHWM) to the current RSS, if supported by the kernel
+static void reset_peak_rss() {
+    std::ofstream out("/proc/self/clear_refs");
+    out << "5";
+}
+
+// run stage repeatedly for at least min_seconds (at least once), record the time per iteration
+static void measure(const std::string& stage, const std::string& input, const std::string& item_name, double items, double bytes,
+        const std::function<void()>& run, double min_seconds = 0.5) {
+    reset_peak_rss();
+    uint32_t reps = 0;
+    double elapsed = 0;
+    const auto start = std::chrono::steady_clock::now();
+    do {
+        run();
+        ++reps;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < min_seconds);
+    StageResult r{ stage, input, elapsed / reps, reps, items, item_name, bytes, proc_status_bytes("VmHWM") };
+    std::cerr << std::left << std::setw(24) << stage << std::setw(24) << input << std::right << std::fixed << std::setprecision(3) <<
+        std::setw(10) << r.seconds * 1e3 << " ms" << std::setw(12) << r.items / r.seconds / 1e6 << " M" << item_name << "/s" <<
+        std::setw(10) << r.bytes / r.seconds / (1 << 20) << " MB/s" << std::setw(10) << r.peak_rss / (1 << 20) << " MB peak" << std::endl;
+    results.push_back(r);
+}
+
+static void write_json(std::ostream& out, int size, uint32_t n_threads) {
+    out << std::setprecision(9) << "{" << std::endl;
+    out << "  \"machine\": " << Telemetry::machine_json() << "," << std::endl;
+    out << "  \"settings\": { \"size\": " << size << ", \"threads\": " << n_threads << " }," << std::endl;
+    out << "  \"stages\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const StageResult& r = results[i];
+        out << "    { \"stage\": " << json_string(r.stage) << ", \"input\": " << json_string(r.input) <<
+            ", \"seconds\": " << r.seconds << ", \"iterations\": " << r.iterations <<
+            ", \"" << r.item_name << "\": " << r.items << ", \"" << r.item_name << "_per_sec\": " << r.items / r.seconds <<
+            ", \"bytes\": " << r.bytes << ", \"bytes_per_sec\": " << r.bytes / r.seconds <<
+            ", \"peak_rss_bytes\": " << r.peak_rss << " }" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "  ]" << std::endl << "}" << std::endl;
+}
+
+// --------------------------------------------------------------
+// synthetic inputs
+
+// dense: smooth, non-zero everywhere
+static voldata::Volume::GridPtr synthetic_dense(int n) {
+    std::vector<float> values(size_t(n) * n * n);
+    for (int z = 0; z < n; ++z)
+        for (int y = 0; y < n; ++y)
+            for (int x = 0; x < n; ++x) {
+                const glm::vec3 p = glm::vec3(x, y, z) * (12.f / n);
+                values[(size_t(z) * n + y) * n + x] = 1.1f + std::sin(p.x) * std::cos(p.y) * std::sin(p.z + p.x);
+            }
+    return std::make_shared<voldata::DenseGrid>(n, n, n, values.data());
+}
+
+// sparse: a few spherical blobs, empty elsewhere (~5% occupancy)
+static voldata::Volume::GridPtr synthetic_sparse(int n) {
+    std::vector<float> values(size_t(n) * n * n, 0.f);
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<float> dist(0.f, 1.f);
+    for (int i = 0; i < 16; ++i) {
+        const glm::vec3 center = glm::vec3(dist(gen), dist(gen), dist(gen)) * float(n);
+        const float radius = n * 0.09f;
+        const glm::ivec3 lo = glm::max(glm::ivec3(center - radius), glm::ivec3(0));
+        const glm::ivec3 hi = glm::min(glm::ivec3(center + radius), glm::ivec3(n - 1));
+        for (int z = lo.z; z <= hi.z; ++z)
+            for (int y = lo.y; y <= hi.y; ++y)
+                for (int x = lo.x; x <= hi.x; ++x) {
+                    const float d = glm::length(glm::vec3(x, y, z) + .5f - center) / radius;
+                    float& v = values[(size_t(z) * n + y) * n + x];
+                    v = std::max(v, 1.f - d);
+                }
+    }
+    return std::make_shared<voldata::DenseGrid>(n, n, n, values.data());
+}
+
+// --------------------------------------------------------------
+// stages
+
+static void bench_grid(const std::string& input, const voldata::Volume::GridPtr& grid) {
+    const glm::uvec3 extent = grid->index_extent();
+    const double voxels = double(extent.x) * extent.y * extent.z;
+    // conversion to brick grid (input: dense float voxels)
+    std::shared_ptr<voldata::BrickGrid> bricks;
+    measure("to_brick_grid", input, "voxels", voxels, voxels * sizeof(float), [&]() { bricks = voldata::Volume::to_brick_grid(grid); }, 0);
+    const double brick_bytes = HostBrickGrid(bricks).size_bytes();
+    measure("host_brick_grid", input, "voxels", voxels, brick_bytes, [&]() { HostBrickGrid host(bricks); });
+    // BC4 encoding of the atlas (input: 8 bit atlas texels)
+    const BrickGridView view = HostBrickGrid(bricks).view;
+    const double atlas_texels = double(view.atlas_stride[0]) * view.atlas_stride[1] * view.atlas_stride[2];
+    measure("bc4_encode", input, "texels", atlas_texels, atlas_texels, [&]() {
+        BC4Stats stats;
+        bc4_encode(view.atlas, view.atlas_stride[0], view.atlas_stride[1], view.atlas_stride[2], stats);
+    });
+    // unit cube transform
+    RendererCPU renderer;
+    renderer.volume = std::make_shared<voldata::Volume>(grid);
+    const glm::mat4 transform = renderer.volume->transform;
+    measure("scale_and_move_to_unit_cube", input, "frames", renderer.volume->n_grid_frames(), 0, [&]() {
+        renderer.volume->transform = transform;
+        renderer.density_scale = 1.f;
+        renderer.scale_and_move_to_unit_cube();
+    });
+}
+
+static void bench_envmap(const std::string& input, const std::vector<glm::vec3>& envmap, const glm::uvec2& size, uint32_t n_threads) {
+    const uint32_t dim = Environment::importance_dimension(size);
+    const double texels = double(size.x) * size.y;
+    measure("build_importance", input, "texels", texels, texels * sizeof(glm::vec3), [&]() { Environment::build_importance(envmap, size, dim, n_threads); });
+}
+
+int main(int argc, char** argv) {
+    int size = 256, envmap_size = 1024;
+    uint32_t n_threads = 0;
+    std::string json_file;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--size") size = std::stoi(argv[++i]);
+        else if (arg == "--envmap-size") envmap_size = std::stoi(argv[++i]);
+        else if (arg == "--threads") n_threads = std::stoul(argv[++i]);
+        else if (arg == "--json") json_file = argv[++i];
+        else files.push_back(arg);
+    }
+    if (files.empty() && fs::exists("data/smoke.brick"))
+        files.push_back("data/smoke.brick");
+
+    // volume grids: synthetic and loaded from file
+    bench_grid("dense_" + std::to_string(size), synthetic_dense(size));
+    bench_grid("sparse_" + std::to_string(size), synthetic_sparse(size));
+    for (const auto& path : files) {
+        std::shared_ptr<voldata::Volume> volume;
+        measure("load_grid", fs::path(path).filename().string(), "bytes", fs::file_size(path), fs::file_size(path),
+                [&]() { volume = std::make_shared<voldata::Volume>(path); });
+        const glm::uvec3 extent = volume->current_grid()->index_extent();
+        results.back().item_name = "voxels";
+        results.back().items = double(extent.x) * extent.y * extent.z;
+        bench_grid(fs::path(path).filename().string(), volume->current_grid());
+    }
+
+    // importance map: synthetic and shipped envmap
+    const glm::uvec2 synthetic_size = glm::uvec2(2 * envmap_size, envmap_size);
+    bench_envmap("synthetic_" + std::to_string(synthetic_size.x) + "x" + std::to_string(synthetic_size.y), synthetic_envmap(synthetic_size), synthetic_size, n_threads);
+    const std::string envmap_path = "data/table_mountain_2_puresky_1k.hdr";
+    if (fs::exists(envmap_path)) {
+        glm::uvec2 hdr_size;
+        std::vector<glm::vec3> envmap;
+        const double file_bytes = fs::file_size(envmap_path);
+        measure("load_hdr", fs::path(envmap_path).filename().string(), "bytes", file_bytes, file_bytes, [&]() { envmap = Environment::load_hdr(envmap_path, hdr_size); });
+        bench_envmap(fs::path(envmap_path).filename().string(), envmap, hdr_size, n_threads);
+    }
+
+    // transfer function density CDF
+    for (const size_t n : { 256, 4096 }) {
+        std::vector<glm::vec4> lut(n);
+        for (size_t i = 0; i < n; ++i)
+            lut[i] = glm::vec4(glm::vec3(float(i) / n), 0.5f + 0.5f * std::sin(i * 0.1f));
+        measure("compute_lut_cdf", "lut_" + std::to_string(n), "entries", n, n * sizeof(glm::vec4), [&]() { TransferFunction::compute_lut_cdf(lut); });
+    }
+
+    // tonemapping and PNG writing of a 1024^2 image
+    {
+        const uint32_t w = 1024, h = 1024;
+        std::vector<glm::vec4> color(size_t(w) * h);
+        for (uint32_t y = 0; y < h; ++y)
+            for (uint32_t x = 0; x < w; ++x)
+                color[size_t(y) * w + x] = glm::vec4(float(x) / w, float(y) / h, 0.5f + 0.5f * std::sin(x * 0.05f), 1.f);
+        const fs::path filename = fs::temp_directory_path() / ("volren_bench_" + std::to_string(getpid()) + ".png");
+        std::vector<uint8_t> pixels(color.size() * 4);
+        measure("write_png", std::to_string(w) + "x" + std::to_string(h), "pixels", double(w) * h, double(w) * h * sizeof(glm::vec4), [&]() {
+            tonemap_ldr(color.data(), color.size(), pixels.data(), true, 5.f, 2.2f);
+            image_store_ldr(filename, pixels.data(), w, h, 4);
+        });
+        fs::remove(filename);
+    }
+
+    // report
+    if (json_file.empty())
+        write_json(std::cout, size, n_threads);
+    else {
+        std::ofstream out(json_file);
+        if (!out) throw std::runtime_error("volren_bench: unable to write " + json_file);
+        write_json(out, size, n_threads);
+        std::cerr << json_file << " written." << std::endl;
+    }
+    return 0;
+}
@@ -18,12 +18,15 @@ if __name__ == "__main__":
     VOLPATH = os.path.join(ROOT_DIR, './data')
     ENVPATH = os.path.join(ROOT_DIR, './data')
     ENABLE_RANDOM_TRANSFERFUNC = False
+    ENVMAP_CACHE_GB = 4 # loaded envmaps are kept in GPU memory up to this size
+    BATCH_SIZE = 8 # images rendered per render_batch() call (their volumes are kept in memory)
 
     # init renderer
     renderer = volpy.Renderer()
     renderer.init()
     renderer.draw()
     random.seed(SEED)
+    volpy.EnvironmentCache.max_bytes = ENVMAP_CACHE_GB << 30
 
     # collect envmap and volume files recursively
     def glob_directory(root, ext='.hdr'):
@@ -79,46 +82,39 @@ if __name__ == "__main__":
         params['cam_fov'] = 25 + (random.random() * 70)
         return params
 
-    for i, params in enumerate([randomize_parameters() for i in range(N_IMAGES)]):
-        print(f'rendering {i+1}/{N_IMAGES}..')
-        # load volume
-        renderer.volume = volpy.Volume(params['vol_path'])
-        renderer.commit()
-        renderer.albedo = params['vol_albedo']
-        renderer.phase = params['vol_phase']
-        renderer.density_scale = params['vol_density_scale']
-        # load envmap
-        renderer.environment = volpy.Environment(params['env_path'])
-        renderer.environment.strength = params['env_strength']
-        renderer.show_environment = params['env_show']
-        # randomze transferfunc?
+    def make_jobs(params):
+        # noisy input and converged target of the same scene
+        volume = volpy.Volume(params['vol_path'])
+        environment = volpy.Environment(params['env_path'])
+        # randomize transferfunc?
+        transferfunc = None
         if (ENABLE_RANDOM_TRANSFERFUNC):
-            renderer.transferfunc = volpy.TransferFunction()
-            renderer.transferfunc.randomize(params['lut_n_bins'])
-            renderer.transferfunc.window_left = params['lut_window_left']
-            renderer.transferfunc.window_width = params['lut_window_width']
-        else:
-            renderer.transferfunc = None
+            transferfunc = volpy.TransferFunction()
+            transferfunc.randomize(params['lut_n_bins'])
+            transferfunc.window_left = params['lut_window_left']
+            transferfunc.window_width = params['lut_window_width']
         # setup camera
-        bb_min, bb_max = renderer.volume.AABB("density")
+        bb_min, bb_max = volume.AABB("density")
         center = bb_min + (bb_max - bb_min) * 0.5
         radius = (bb_max - center).length()
-        renderer.cam_pos = center + params['cam_pos_sample'] * radius
-        renderer.cam_dir = (center + params['cam_dir_sample'] * radius * 0.1 - renderer.cam_pos).normalize()
-        renderer.cam_fov = params['cam_fov']
-        # render noisy
-        renderer.seed = params['seed_input']
-        renderer.bounces = params['max_bounces']
-        renderer.render(params['samples'])
-        data_input = np.flip(np.array(renderer.fbo_data()), axis=0)
-        dataset_input[i] = np.transpose(data_input.astype(np.float16), [2, 1, 0])
-        renderer.draw()
-        # render converged reference
-        renderer.seed = params['seed_target']
-        renderer.bounces = params['max_bounces']
-        renderer.render(N_SAMPLES_TARGET)
-        data_target = np.flip(np.array(renderer.fbo_data()), axis=0)
-        dataset_target[i] = np.transpose(data_target.astype(np.float16), [2, 1, 0])
+        cam_pos = center + params['cam_pos_sample'] * radius
+        cam_dir = (center + params['cam_dir_sample'] * radius * 0.1 - cam_pos).normalize()
+        job = {
+            'volume': volume, 'albedo': params['vol_albedo'], 'phase': params['vol_phase'], 'density_scale': params['vol_density_scale'],
+            'environment': environment, 'env_strength': params['env_strength'], 'show_environment': params['env_show'],
+            'transferfunc': transferfunc, 'cam_pos': cam_pos, 'cam_dir': cam_dir, 'cam_fov': params['cam_fov'], 'bounces': params['max_bounces'],
+        }
+        return [dict(job, seed=params['seed_input'], spp=params['samples']), dict(job, seed=params['seed_target'], spp=N_SAMPLES_TARGET)]
+
+    all_params = [randomize_parameters() for i in range(N_IMAGES)]
+    for i in range(0, N_IMAGES, BATCH_SIZE):
+        n = min(BATCH_SIZE, N_IMAGES - i)
+        print(f'rendering {i+1}-{i+n}/{N_IMAGES}..')
+        jobs = [job for params in all_params[i:i+n] for job in make_jobs(params)]
+        # fp16, channel planes and rows top-down, as stored in the datasets
+        images = renderer.render_batch(jobs, half=True, planar=True)
+        dataset_input[i:i+n] = images[0::2]
+        dataset_target[i:i+n] = images[1::2]
         renderer.draw()
 
     renderer.shutdown()
@@ -0,0 +1,38 @@
+#version 450 core
+
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout (binding = 0, rgba32f) uniform readonly image2D stats;
+
+// active tiles, the first 3 entries are the indirect dispatch arguments
+layout (std430, binding = 1) buffer TileBuffer {
+    uint tile_dispatch[3];
+    uint n_tiles_x;
+    uint active_tiles[];
+};
+
+uniform ivec2 resolution;
+uniform float threshold;
+
+shared uint tile_error;
+
+// ---------------------------------------------------
+// per tile convergence check: collect tiles whose max. relative error exceeds the threshold
+
+void main() {
+    if (gl_LocalInvocationIndex == 0) tile_error = 0;
+    barrier();
+
+    const ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (all(lessThan(pixel, resolution))) {
+        // relative standard error of the mean pixel luminance
+        const vec4 s = imageLoad(stats, pixel);
+        const float variance = s.z > 1.f ? s.y / (s.z - 1.f) : 1e30f;
+        const float error = sqrt(max(variance, 0.f) / max(s.z, 1.f)) / max(s.x, 1e-3f);
+        atomicMax(tile_error, floatBitsToUint(min(error, 1e30f))); // positive floats order like their bit pattern
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0 && uintBitsToFloat(tile_error) > threshold)
+        active_tiles[atomicAdd(tile_dispatch[0], 1)] = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
@@ -15,8 +15,8 @@ float sum(const vec3 x) { return x.x + x.y + x.z; }
 float mean(const vec3 x) { return sum(x) / 3.f; }
 
 float sanitize(const float x) { return isnan(x) || isinf(x) ? 0.f : x; }
-vec3 sanitize(const vec3 x) { return mix(x, vec3(0), isnan(x) || isinf(x)); }
-vec4 sanitize(const vec4 x) { return mix(x, vec4(0), isnan(x) || isinf(x)); }
+vec3 sanitize(const vec3 x) { return mix(x, vec3(0), bvec3(ivec3(isnan(x)) | ivec3(isinf(x)))); } // no || on bvecs in GLSL
+vec4 sanitize(const vec4 x) { return mix(x, vec4(0), bvec4(ivec4(isnan(x)) | ivec4(isinf(x)))); }
 
 float luma(const vec3 col) { return dot(col, vec3(0.212671f, 0.715160f, 0.072169f)); }
 
@@ -34,6 +34,50 @@ vec3 align(const vec3 N, const vec3 v) {
 
 float power_heuristic(const float a, const float b) { return sqr(a) / (sqr(a) + sqr(b)); }
 
+// --------------------------------------------------------------
+// hot-path counters (instrumented build with USE_COUNTERS only, see TraceCounters in renderer.h)
+
+#define COUNTER_DDA_STEPS 0         // DDA steps of free-flight sampling
+#define COUNTER_NULL_COLLISIONS 1
+#define COUNTER_REAL_COLLISIONS 2
+#define COUNTER_DENSITY_LOOKUPS 3   // (filtered) density lookups
+#define COUNTER_SHADOW_STEPS 4      // steps of NEE shadow rays
+#define COUNTER_RR_TERMINATIONS 5   // paths terminated by russian roulette
+#define COUNTER_BOUNCES 6           // histogram of path depths, last bin: >= N_BOUNCE_BINS - 1
+#define N_BOUNCE_BINS 32
+#define N_COUNTERS (COUNTER_BOUNCES + N_BOUNCE_BINS)
+
+#ifdef USE_COUNTERS
+layout (std430, binding = 3) buffer CounterBuffer {
+    uint trace_counters[2 * N_COUNTERS]; // 64 bit counters (low, high)
+};
+
+shared uint group_counters[N_COUNTERS]; // counted per work group first
+
+#define COUNT(i) atomicAdd(group_counters[i], 1u)
+#define WORK_GROUP_SIZE (gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z)
+
+// must be called by all invocations of the work group
+void counters_begin() {
+    for (uint i = gl_LocalInvocationIndex; i < N_COUNTERS; i += WORK_GROUP_SIZE)
+        group_counters[i] = 0u;
+    barrier();
+}
+
+// must be called by all invocations of the work group
+void counters_end() {
+    barrier();
+    for (uint i = gl_LocalInvocationIndex; i < N_COUNTERS; i += WORK_GROUP_SIZE) {
+        const uint count = group_counters[i];
+        if (count == 0u) continue;
+        const uint low = atomicAdd(trace_counters[2 * i], count);
+        if (low + count < low) atomicAdd(trace_counters[2 * i + 1], 1u); // carry
+    }
+}
+#else
+#define COUNT(i)
+#endif
+
 // --------------------------------------------------------------
 // random number generation helpers
 
@@ -142,13 +186,17 @@ vec4 sample_environment(const vec2 rng, out vec3 w_i) {
     const vec3 Le = env_strength * texture(env_envmap, uv).rgb;
     const float avg_w = texelFetch(env_impmap, ivec2(0, 0), env_imp_base_mip).r;
     const float pdf = texelFetch(env_impmap, pos, 0).r / avg_w;
-    return vec4(Le, pdf * inv_4PI);
+    return vec4(Le, pdf * inv_4PI / (.5f * M_PI * max(sin_t, 1e-4f))); // uv to solid angle (importance includes sin(theta) * PI/2)
 }
 
 float pdf_environment(const vec3 dir) {
+    const vec3 idir = env_inv_transform * dir;
+    const vec2 uv = vec2(atan(idir.z, idir.x) / (2 * M_PI) + 0.5f, 1.f - acos(idir.y) / M_PI);
+    const ivec2 pos = clamp(ivec2(uv / env_imp_inv_dim), ivec2(0), ivec2(1.f / env_imp_inv_dim) - 1);
     const float avg_w = texelFetch(env_impmap, ivec2(0, 0), env_imp_base_mip).r;
-    const float pdf = luma(lookup_environment(dir)) / avg_w;
-    return pdf * inv_4PI;
+    const float pdf = texelFetch(env_impmap, pos, 0).r / avg_w;
+    const float sin_t = sqrt(max(0.f, 1.f - sqr(idir.y)));
+    return pdf * inv_4PI / (.5f * M_PI * max(sin_t, 1e-4f));
 }
 
 // --------------------------------------------------------------
@@ -211,6 +259,15 @@ vec4 tf_lookup(float d) {
     return mix(tf_lut[idx], tf_lut[min(idx + 1, tf_size - 1)], f);
 }
 
+// max. opacity of tf_lookup() over densities in [d_min, d_max] (piecewise linear between lut entries)
+float tf_max_opacity(float d_min, float d_max) {
+    float a = max(tf_lookup(d_min).a, tf_lookup(d_max).a);
+    const int last = min(int(floor(tf_window(d_max) * tf_size)), int(tf_size) - 1);
+    for (int i = int(ceil(tf_window(d_min) * tf_size)); i <= last; ++i)
+        a = max(a, tf_lut[i].a);
+    return a;
+}
+
 // --------------------------------------------------------------
 // stochastic filter helpers
 
@@ -262,31 +319,51 @@ uniform mat4 vol_density_transform;
 uniform mat4 vol_density_inv_transform;
 uniform usampler3D vol_density_indirection;
 uniform sampler3D vol_density_range;
-uniform sampler3D vol_density_atlas;
+uniform sampler2DArray vol_density_atlas;   // BC4 compressed, one layer per atlas slice
+uniform sampler3D vol_density_atlas_lod;    // coarser atlas levels 1.. as mip levels 0..
 
-// brick grid voxel density lookup (nearest neighbor)
-float lookup_density_brick(const vec3 ipos) {
+// brick grid voxel density lookup on given atlas level (nearest neighbor)
+float lookup_density_brick_level(const vec3 ipos, const int level) {
     const ivec3 iipos = ivec3(floor(ipos));
     const ivec3 brick = iipos >> 3;
     const uvec3 ptr = texelFetch(vol_density_indirection, brick, 0).xyz;
     const vec2 range = texelFetch(vol_density_range, brick, 0).xy;
-    const float value_unorm = texelFetch(vol_density_atlas, ivec3(ptr << 3) + (iipos & 7), 0).x;
+    const ivec3 texel = ivec3(ptr << 3) + (iipos & 7);
+    const float value_unorm = level == 0 ? texelFetch(vol_density_atlas, texel, 0).x : texelFetch(vol_density_atlas_lod, texel >> level, level - 1).x;
     return range.x + value_unorm * (range.y - range.x);
 }
 
+// brick grid voxel density lookup (nearest neighbor)
+float lookup_density_brick(const vec3 ipos) {
+    return lookup_density_brick_level(ipos, 0);
+}
+
 // brick majorant lookup (nearest neighbor)
 float lookup_majorant(const vec3 ipos, int mip) {
     const ivec3 brick = ivec3(floor(ipos)) >> (3 + mip);
     return vol_density_scale * texelFetch(vol_density_range, brick, mip).y;
 }
 
+#ifdef USE_TRANSFERFUNC
+// max. transfer function opacity per brick and mip level (see shader/tf_majorant.glsl)
+uniform sampler3D vol_density_tf_majorant;
+
+// brick majorant lookup with transfer function (nearest neighbor)
+float lookup_majorant_tf(const vec3 ipos, int mip) {
+    const ivec3 brick = ivec3(floor(ipos)) >> (3 + mip);
+    return vol_majorant * texelFetch(vol_density_tf_majorant, brick, mip).x;
+}
+#endif
+
 // density lookup (nearest neighbor)
 float lookup_density(const vec3 ipos) {
+    COUNT(COUNTER_DENSITY_LOOKUPS);
     return vol_density_scale * lookup_density_brick(ipos);
 }
 
 // density lookup (trilinear filter)
 float lookup_density_trilinear(const vec3 ipos) {
+    COUNT(COUNTER_DENSITY_LOOKUPS);
     const vec3 f = fract(ipos - 0.5);
     const ivec3 iipos = ivec3(floor(ipos - 0.5));
     const float lx0 = mix(lookup_density_brick(iipos + ivec3(0, 0, 0)), lookup_density_brick(iipos + ivec3(1, 0, 0)), f.x);
@@ -308,29 +385,92 @@ uniform mat4 vol_emission_transform;
 uniform mat4 vol_emission_inv_transform;
 uniform usampler3D vol_emission_indirection;
 uniform sampler3D vol_emission_range;
-uniform sampler3D vol_emission_atlas;
+uniform sampler2DArray vol_emission_atlas;
+uniform sampler3D vol_emission_atlas_lod;
 
-// brick grid voxel temperature lookup (nearest neighbor)
-float lookup_temperature_brick(const vec3 ipos) {
+// brick grid voxel temperature lookup on given atlas level (nearest neighbor)
+float lookup_temperature_brick_level(const vec3 ipos, const int level) {
     const ivec3 iipos = ivec3(floor(ipos));
     const ivec3 brick = iipos >> 3;
     const uvec3 ptr = texelFetch(vol_emission_indirection, brick, 0).xyz;
     const vec2 range = texelFetch(vol_emission_range, brick, 0).xy;
-    const float value_unorm = texelFetch(vol_emission_atlas, ivec3(ptr << 3) + (iipos & 7), 0).x;
+    const ivec3 texel = ivec3(ptr << 3) + (iipos & 7);
+    const float value_unorm = level == 0 ? texelFetch(vol_emission_atlas, texel, 0).x : texelFetch(vol_emission_atlas_lod, texel >> level, level - 1).x;
     return range.x + value_unorm * (range.y - range.x);
 }
 
-// emission lookup (stochastic tricubic filter)
-vec3 lookup_emission(const vec3 ipos, inout uint seed) {
+// brick grid voxel temperature lookup (nearest neighbor)
+float lookup_temperature_brick(const vec3 ipos) {
+    return lookup_temperature_brick_level(ipos, 0);
+}
+
+// emission lookup on given atlas level (stochastic tricubic filter at the resolution of the level)
+vec3 lookup_emission_level(const vec3 ipos, const int level, inout uint seed) {
     const vec3 ipos_emission = vec3(vol_emission_inv_transform * vol_density_transform * vec4(ipos, 1));
-    const float t = lookup_temperature_brick(stochastic_tricubic_filter(ipos_emission, seed)) * vol_emission_norm;
+    const float t = lookup_temperature_brick_level(stochastic_tricubic_filter(ipos_emission / float(1 << level), seed) << level, level) * vol_emission_norm;
     return vol_emission_scale * sqr(vec3(t, sqr(t), sqr(sqr(t))));
 }
 
+// emission lookup (stochastic tricubic filter)
+vec3 lookup_emission(const vec3 ipos, inout uint seed) {
+    return lookup_emission_level(ipos, 0, seed);
+}
+
+// --------------------------------------------------------------
+// level of detail: lookups use coarser atlas levels (box filtered, see brick_atlas_levels()) depending on the footprint
+// of a ray cone traced along the path and the path depth. in unbiased mode, coarse lookups are corrected by the residual
+// to level 0, fetched with probability LOD_RESIDUAL_PROB, which is unbiased (but not bounded), so it is only used where
+// the estimators are linear in the looked up value: emission and ratio tracking of shadow rays (not for free-flight sampling)
+
+#define LOD_BOUNCE_LEVELS 0.5f      // levels added per scattering event
+#define LOD_SCATTER_SPREAD 0.5f     // cone spread angle after scattering (isotropic phase function)
+#define LOD_RESIDUAL_PROB 0.25f
+
+uniform int lod_mode;               // 0: off, 1: all lookups on the selected level, 2: unbiased
+uniform int lod_levels;             // coarser atlas levels available
+uniform float lod_quality;          // footprint scale, larger values select finer levels
+uniform float lod_pixel_spread;     // spread angle of camera rays
+
+// ray cone of the current path segment (world-space width at its origin and spread angle) and path depth, see trace_path()
+float lod_cone_width = 0.f;
+float lod_cone_spread = 0.f;
+float lod_depth = 0.f;
+
+// atlas level for a lookup at distance t along the current segment (ilen: index-space voxels per unit distance), stochastically rounded
+int lod_level(const float t, const float ilen, inout uint seed) {
+    if (lod_mode == 0) return 0;
+    const float footprint = (lod_cone_width + lod_cone_spread * t) * ilen / lod_quality;
+    const float level = min(log2(max(footprint, 1e-6f)) + lod_depth * LOD_BOUNCE_LEVELS / lod_quality, float(lod_levels));
+    if (level <= 0.f) return 0;
+    return int(level) + (rng(seed) < fract(level) ? 1 : 0);
+}
+
+// density lookup on given atlas level (stochastic tricubic filter at the resolution of the level)
+float lookup_density_level(const vec3 ipos, const int level, inout uint seed) {
+    COUNT(COUNTER_DENSITY_LOOKUPS);
+    return vol_density_scale * lookup_density_brick_level(stochastic_tricubic_filter(ipos / float(1 << level), seed) << level, level);
+}
+
+// density lookup with level of detail: on the selected level, or residual corrected in unbiased mode
+float lookup_density_lod(const vec3 ipos, const int level, inout uint seed) {
+    if (level == 0) return lookup_density_stochastic(ipos, seed);
+    const float d = lookup_density_level(ipos, level, seed);
+    if (lod_mode == 1 || rng(seed) >= LOD_RESIDUAL_PROB) return d;
+    return d + (lookup_density_stochastic(ipos, seed) - d) / LOD_RESIDUAL_PROB;
+}
+
+// emission lookup with level of detail: on the selected level, or residual corrected in unbiased mode
+vec3 lookup_emission_lod(const vec3 ipos, const int level, inout uint seed) {
+    if (level == 0) return lookup_emission(ipos, seed);
+    const vec3 Le = lookup_emission_level(ipos, level, seed);
+    if (lod_mode == 1 || rng(seed) >= LOD_RESIDUAL_PROB) return Le;
+    return Le + (lookup_emission(ipos, seed) - Le) / LOD_RESIDUAL_PROB;
+}
+
 // --------------------------------------------------------------
 // null-collision methods
 
-float transmittance(const vec3 wpos, const vec3 wdir, inout uint seed, float t_max = FLT_MAX) {
+float transmittance(const vec3 wpos, const vec3 wdir, inout uint seed, const float t_max) {
     // clip volume
     vec2 near_far;
     if (!intersect_box(wpos, wdir, vol_bb_min, vol_bb_max, near_far)) return 1.f;
@@ -341,6 +481,7 @@ float transmittance(const vec3 wpos, const vec3 wdir, inout uint seed, float t_m
     // ratio tracking
     float t = near_far.x - log(1 - rng(seed)) * vol_inv_majorant, Tr = 1.f;
     while (t < near_far.y) {
+        COUNT(COUNTER_SHADOW_STEPS);
 #ifdef USE_TRANSFERFUNC
         const vec4 rgba = tf_lookup(lookup_density_trilinear(ipos + t * idir) * vol_inv_majorant);
         const float d = vol_majorant * rgba.a;
@@ -371,6 +512,7 @@ bool sample_volume(const vec3 wpos, const vec3 wdir, out float t, inout vec3 thr
     // delta tracking
     t = near_far.x - log(1 - rng(seed)) * vol_inv_majorant;
     while (t < near_far.y) {
+        COUNT(COUNTER_DDA_STEPS);
 #ifdef USE_TRANSFERFUNC
         const vec4 rgba = tf_lookup(lookup_density_trilinear(ipos + t * idir) * vol_inv_majorant);
         const float d = vol_majorant * rgba.a;
@@ -381,6 +523,7 @@ bool sample_volume(const vec3 wpos, const vec3 wdir, out float t, inout vec3 thr
         Le += throughput * (1 - vol_albedo) * lookup_emission(ipos + t * idir, seed) * P_real;
         // classify as real or null collison
         if (rng(seed) < P_real) {
+            COUNT(COUNTER_REAL_COLLISIONS);
 #ifdef USE_TRANSFERFUNC
             throughput *= rgba.rgb * vol_albedo;
 #else
@@ -388,6 +531,7 @@ bool sample_volume(const vec3 wpos, const vec3 wdir, out float t, inout vec3 thr
 #endif
             return true;
         }
+        COUNT(COUNTER_NULL_COLLISIONS);
         // advance
         t -= log(1 - rng(seed)) * vol_inv_majorant;
     }
@@ -418,12 +562,14 @@ float transmittanceDDA(const vec3 wpos, const vec3 wdir, inout uint seed) {
     const vec3 ipos = vec3(vol_density_inv_transform * vec4(wpos, 1));
     const vec3 idir = vec3(vol_density_inv_transform * vec4(wdir, 0)); // non-normalized!
     const vec3 ri = 1.f / idir;
+    const float ilen = length(idir);
     // march brick grid
     float t = near_far.x + 1e-6f, Tr = 1.f, tau = -log(1.f - rng(seed)), mip = MIP_START;
     while (t < near_far.y) {
+        COUNT(COUNTER_SHADOW_STEPS);
         const vec3 curr = ipos + t * idir;
 #ifdef USE_TRANSFERFUNC
-        const float majorant = vol_majorant * tf_lookup(lookup_majorant(curr, int(round(mip))) * vol_inv_majorant).a;
+        const float majorant = lookup_majorant_tf(curr, int(round(mip)));
 #else
         const float majorant = lookup_majorant(curr, int(round(mip)));
 #endif
@@ -437,10 +583,22 @@ float transmittanceDDA(const vec3 wpos, const vec3 wdir, inout uint seed) {
 #ifdef USE_TRANSFERFUNC
         const vec4 rgba = tf_lookup(lookup_density_trilinear(ipos + t * idir) * vol_inv_majorant);
         const float d = vol_majorant * rgba.a;
+        const int level = 0;
 #else
-        const float d = lookup_density_stochastic(ipos + t * idir, seed);
+        const int level = lod_level(t, ilen, seed);
+        const float d = lookup_density_lod(ipos + t * idir, level, seed);
 #endif
-        if (rng(seed) * majorant < d) { // check if real or null collision
+        if (lod_mode == 2 && level > 0) {
+            // unbiased level of detail: ratio tracking, as the residual corrected density may exceed the majorant
+            Tr *= 1.f - d / majorant;
+            // russian roulette
+            if (abs(Tr) < .1f) {
+                const float prob = 1 - abs(Tr);
+                if (rng(seed) < prob) return 0.f;
+                Tr /= 1 - prob;
+            }
+        } else if (rng(seed) * majorant < d) { // check if real or null collision
+            COUNT(COUNTER_REAL_COLLISIONS);
             Tr *= max(0.f, 1.f - vol_majorant / majorant); // adjust by ratio of global to local majorant
             // russian roulette
             if (Tr < .1f) {
@@ -448,7 +606,8 @@ float transmittanceDDA(const vec3 wpos, const vec3 wdir, inout uint seed) {
                 if (rng(seed) < prob) return 0.f;
                 Tr /= 1 - prob;
             }
-        }
+        } else
+            COUNT(COUNTER_NULL_COLLISIONS);
         tau = -log(1.f - rng(seed));
         mip = max(0.f, mip - MIP_SPEED_DOWN);
     }
@@ -464,13 +623,15 @@ bool sample_volumeDDA(const vec3 wpos, const vec3 wdir, out float t, inout vec3
     const vec3 ipos = vec3(vol_density_inv_transform * vec4(wpos, 1));
     const vec3 idir = vec3(vol_density_inv_transform * vec4(wdir, 0)); // non-normalized!
     const vec3 ri = 1.f / idir;
+    const float ilen = length(idir);
     // march brick grid
     t = near_far.x + 1e-6f;
     float tau = -log(1.f - rng(seed)), mip = MIP_START;
     while (t < near_far.y) {
+        COUNT(COUNTER_DDA_STEPS);
         const vec3 curr = ipos + t * idir;
 #ifdef USE_TRANSFERFUNC
-        const float majorant = vol_majorant * tf_lookup(lookup_majorant(curr, int(round(mip))) * vol_inv_majorant).a;
+        const float majorant = lookup_majorant_tf(curr, int(round(mip)));
 #else
         const float majorant = lookup_majorant(curr, int(round(mip)));
 #endif
@@ -481,20 +642,23 @@ bool sample_volumeDDA(const vec3 wpos, const vec3 wdir, out float t, inout vec3
         if (tau > 0) continue; // no collision, step ahead
         t += tau / majorant; // step back to point of collision
         if (t >= near_far.y) break;
+        const int level = lod_level(t, ilen, seed);
 #ifdef USE_TRANSFERFUNC
         const vec4 rgba = tf_lookup(lookup_density_trilinear(ipos + t * idir) * vol_inv_majorant);
         const float d = vol_majorant * rgba.a;
 #else
-        const float d = lookup_density_stochastic(ipos + t * idir, seed);
+        const float d = lookup_density_lod(ipos + t * idir, lod_mode == 1 ? level : 0, seed); // real/null decision is not linear in d
 #endif
-        Le += throughput * (1.f - vol_albedo) * lookup_emission(ipos + t * idir, seed) * d * vol_inv_majorant;
+        Le += throughput * (1.f - vol_albedo) * lookup_emission_lod(ipos + t * idir, level, seed) * d * vol_inv_majorant;
         if (rng(seed) * majorant < d) { // check if real or null collision
+            COUNT(COUNTER_REAL_COLLISIONS);
             throughput *= vol_albedo;
 #ifdef USE_TRANSFERFUNC
             throughput *= rgba.rgb;
 #endif
             return true;
         }
+        COUNT(COUNTER_NULL_COLLISIONS);
         tau = -log(1.f - rng(seed));
         mip = max(0.f, mip - MIP_SPEED_DOWN);
     }
@@ -567,28 +731,77 @@ bool sample_volume_raymarch(const vec3 wpos, const vec3 wdir, out float t, inout
 }
 
 // --------------------------------------------------------------
-// simple direct volume rendering
-
-vec3 direct_volume_rendering(vec3 pos, vec3 dir, inout uint seed) {
+// simple direct volume rendering (emission-absorption, returns radiance and opacity)
+
+uniform int dvr_steps;
+uniform sampler2D tf_preint; // pre-integrated transfer function, see TransferFunction::compute_preintegrated()
+
+// mean (rgb * a, a) of tf_lookup() over a slab with density linear from d_front to d_back
+vec4 tf_preintegrated(float d_front, float d_back) {
+    const float u_front = (d_front - tf_window_left) / tf_window_width, u_back = (d_back - tf_window_left) / tf_window_width;
+    const float c_front = clamp(u_front, 0.f, 1.f), c_back = clamp(u_back, 0.f, 1.f);
+    const float size = textureSize(tf_preint, 0).x;
+    const vec4 inside = texture(tf_preint, (vec2(c_front, c_back) * (size - 1) + .5f) / size);
+    const float du = abs(u_back - u_front);
+    if (du < 1e-6f) return inside;
+    // parts of the slab outside the window take the lut values at its ends
+    const float u_min = min(u_front, u_back), u_max = max(u_front, u_back);
+    const float w_low = (max(0.f, -u_min) - max(0.f, -u_max)) / du;
+    const float w_high = (max(0.f, u_max - 1.f) - max(0.f, u_min - 1.f)) / du;
+    const vec4 low = texture(tf_preint, vec2(.5f / size));
+    const vec4 high = texture(tf_preint, vec2(1.f - .5f / size));
+    return (1.f - w_low - w_high) * inside + w_low * low + w_high * high;
+}
+
+// point samples
+vec4 direct_volume_rendering(vec3 pos, vec3 dir, inout uint seed) {
     vec3 L = vec3(0);
     // clip volume
     vec2 near_far;
-    if (!intersect_box(pos, dir, vol_bb_min, vol_bb_max, near_far)) return lookup_environment(dir);
+    if (!intersect_box(pos, dir, vol_bb_min, vol_bb_max, near_far)) return vec4(lookup_environment(dir), 0);
     // to index-space
     const vec3 ipos = vec3(vol_density_inv_transform * vec4(pos, 1));
     const vec3 idir = vec3(vol_density_inv_transform * vec4(dir, 0)); // non-normalized!
     // ray marching
-    const float dt = (near_far.y - near_far.x) / float(RAYMARCH_STEPS);
+    const float dt = (near_far.y - near_far.x) / float(dvr_steps);
     near_far.x += rng(seed) * dt; // jitter starting position
     float Tr = 1.f;
-    for (int i = 0; i < RAYMARCH_STEPS; ++i) {
+    for (int i = 0; i < dvr_steps; ++i) {
         const vec4 rgba = tf_lookup(lookup_density_trilinear(ipos + min(near_far.x + i * dt, near_far.y) * idir) * vol_inv_majorant);
         const float dtau = rgba.a * vol_majorant * dt;
         L += rgba.rgb * dtau * Tr;
         Tr *= exp(-dtau);
-        if (Tr <= 1e-6) return L;
+        if (Tr <= 1e-6) return vec4(L, 1);
+    }
+    return vec4(L + lookup_environment(dir) * Tr, 1 - Tr);
+}
+
+// slabs between samples, integrated using the pre-integrated transfer function
+vec4 direct_volume_rendering_preintegrated(vec3 pos, vec3 dir, inout uint seed) {
+    vec3 L = vec3(0);
+    // clip volume
+    vec2 near_far;
+    if (!intersect_box(pos, dir, vol_bb_min, vol_bb_max, near_far)) return vec4(lookup_environment(dir), 0);
+    // to index-space
+    const vec3 ipos = vec3(vol_density_inv_transform * vec4(pos, 1));
+    const vec3 idir = vec3(vol_density_inv_transform * vec4(dir, 0)); // non-normalized!
+    // ray marching, first slab shortened to jitter the slab boundaries
+    const float dt = (near_far.y - near_far.x) / float(dvr_steps);
+    float t = near_far.x, t_back = near_far.x + rng(seed) * dt, Tr = 1.f;
+    float d_front = lookup_density_trilinear(ipos + t * idir) * vol_inv_majorant;
+    for (int i = 0; i <= dvr_steps && t < near_far.y; ++i) {
+        t_back = min(t_back, near_far.y);
+        const float d_back = lookup_density_trilinear(ipos + t_back * idir) * vol_inv_majorant;
+        const vec4 slab = tf_preintegrated(d_front, d_back);
+        const float alpha = 1.f - exp(-slab.a * vol_majorant * (t_back - t));
+        L += Tr * alpha * (slab.a > 0.f ? slab.rgb / slab.a : vec3(0));
+        Tr *= 1.f - alpha;
+        if (Tr <= 1e-6) return vec4(L, 1);
+        t = t_back;
+        t_back += dt;
+        d_front = d_back;
     }
-    return L + lookup_environment(dir) * Tr;
+    return vec4(L + lookup_environment(dir) * Tr, 1 - Tr);
 }
 
 // --------------------------------------------------------------
@@ -604,6 +817,10 @@ vec4 trace_path(vec3 pos, vec3 dir, inout uint seed) {
     bool free_path = true;
     uint n_paths = 0;
     float t, f_p; // t: end of ray segment (i.e. sampled position or out of volume), f_p: last phase function sample for MIS
+    // ray cone of the camera ray for level of detail
+    lod_cone_width = 0.f;
+    lod_cone_spread = lod_pixel_spread;
+    lod_depth = 0.f;
 #ifdef USE_DDA
     while (sample_volumeDDA(pos, dir, t, throughput, L, seed)) {
 #else
@@ -611,6 +828,10 @@ vec4 trace_path(vec3 pos, vec3 dir, inout uint seed) {
 #endif
         // advance ray
         pos = pos + t * dir;
+        // widen ray cone for the shadow ray and the scattered ray
+        lod_cone_width += lod_cone_spread * t;
+        lod_cone_spread = max(lod_cone_spread, LOD_SCATTER_SPREAD * (1.f - abs(vol_phase_g)));
+        lod_depth += 1.f;
 
         // sample light source (environment)
         vec3 w_i;
@@ -621,7 +842,7 @@ vec4 trace_path(vec3 pos, vec3 dir, inout uint seed) {
 #ifdef USE_DDA
             const float Tr = transmittanceDDA(pos, w_i, seed);
 #else
-            const float Tr = transmittance(pos, w_i, seed);
+            const float Tr = transmittance(pos, w_i, seed, FLT_MAX);
 #endif
             L += throughput * mis_weight * f_p * Tr * Le_pdf.rgb / Le_pdf.w;
         }
@@ -632,7 +853,7 @@ vec4 trace_path(vec3 pos, vec3 dir, inout uint seed) {
         const float rr_val = luma(throughput);
         if (rr_val < .1f) {
             const float prob = 1 - rr_val;
-            if (rng(seed) < prob) { free_path = false; break; }
+            if (rng(seed) < prob) { free_path = false; COUNT(COUNTER_RR_TERMINATIONS); break; }
             throughput /= 1 - prob;
         }
 
@@ -649,5 +870,6 @@ vec4 trace_path(vec3 pos, vec3 dir, inout uint seed) {
         L += throughput * mis_weight * Le;
     }
 
+    COUNT(COUNTER_BOUNCES + min(n_paths, uint(N_BOUNCE_BINS - 1)));
     return vec4(L, clamp(n_paths, 0.f, 1.f));
 }
\ No newline at end of file
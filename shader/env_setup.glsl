@@ -11,7 +11,9 @@ uniform ivec2 num_samples;
 uniform float inv_samples;
 
 // ---------------------------------------------------
-// main
+// main (GPU reference of Environment::build_importance, see bench/envmap_bench.cpp)
+
+#define M_PI float(3.14159265358979323846)
 
 float luma(const vec3 col) { return dot(col, vec3(0.212671f, 0.715160f, 0.072169f)); }
 
@@ -25,7 +27,7 @@ void main() {
     for (int y = 0; y < num_samples.y; ++y) {
         for (int x = 0; x < num_samples.x; ++x) {
             const vec2 uv = (pixel * num_samples + vec2(x + .5f, y + .5f)) / output_size_samples;
-            importance += luma(texture(envmap, uv).rgb);
+            importance += luma(texture(envmap, uv).rgb) * sin((1.f - uv.y) * M_PI) * M_PI / 2; // solid angle weight
         }
     }
 
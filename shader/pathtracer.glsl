@@ -0,0 +1,79 @@
+// ---------------------------------------------------
+// path tracer kernel, included by the pathtracer_brick*.glsl variants after their settings and common.glsl
+
+layout (binding = 0, rgba32f) uniform image2D color;
+layout (binding = 1, rgba32f) uniform image2D stats; // running luminance mean, M2 and sample count per pixel
+
+// active tiles for adaptive sampling (also indirect dispatch arguments)
+layout (std430, binding = 1) readonly buffer TileBuffer {
+    uint tile_dispatch[3];
+    uint n_tiles_x;
+    uint active_tiles[];
+};
+
+// ---------------------------------------------------
+// uniforms
+
+uniform int current_sample; // index of the first sample of this dispatch
+uniform int samples;        // samples per pixel in this dispatch
+uniform int seed;
+uniform ivec2 resolution;
+uniform ivec2 image_offset; // position of the render target in the full image (tiled rendering)
+uniform ivec2 image_size;   // resolution of the full image
+uniform int adaptive_dispatch; // 1: one work group per active tile
+#ifdef USE_TRANSFERFUNC
+uniform int dvr;               // 0: path tracing, 1: direct volume rendering (point samples), 2: direct volume rendering (pre-integrated slabs)
+#endif
+
+// ---------------------------------------------------
+// main
+
+void trace_pixel(const ivec2 pixel) {
+    vec4 s = current_sample == 1 ? vec4(0) : imageLoad(stats, pixel);
+    vec4 result = imageLoad(color, pixel);
+    for (int i = 0; i < samples; ++i) {
+        // setup random seed and camera ray (from the pixel position in the full image)
+        const ivec2 xy = image_offset + pixel;
+        uint seed = tea(seed * (xy.y * image_size.x + xy.x), current_sample + i, 32);
+        const vec3 pos = cam_pos;
+        const vec3 dir = view_dir(xy, image_size, rng2(seed));
+
+        // trace ray
+#ifdef USE_TRANSFERFUNC
+        const vec4 L = sanitize(dvr == 2 ? direct_volume_rendering_preintegrated(pos, dir, seed) :
+                dvr == 1 ? direct_volume_rendering(pos, dir, seed) : trace_path(pos, dir, seed));
+#else
+        const vec4 L = sanitize(trace_path(pos, dir, seed));
+#endif
+
+        // update running luminance statistics (Welford), pixels of converged tiles receive fewer samples
+        const float n = s.z + 1.f;
+        const float delta = luma(L.rgb) - s.x;
+        s.x += delta / n;
+        s.y += delta * (luma(L.rgb) - s.x);
+        s.z = n;
+
+        // accumulate
+        result = mix(result, L, 1.f / n);
+    }
+
+    // write result
+    imageStore(stats, pixel, s);
+    imageStore(color, pixel, result);
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (adaptive_dispatch > 0) {
+        const uint tile = active_tiles[gl_WorkGroupID.x];
+        pixel = ivec2(tile % n_tiles_x, tile / n_tiles_x) * ivec2(gl_WorkGroupSize.xy) + ivec2(gl_LocalInvocationID.xy);
+    }
+#ifdef USE_COUNTERS
+    counters_begin();
+#endif
+    if (all(lessThan(pixel, resolution)))
+        trace_pixel(pixel);
+#ifdef USE_COUNTERS
+    counters_end();
+#endif
+}
@@ -0,0 +1,11 @@
+#version 450 core
+
+layout (local_size_x = 16, local_size_y = 16) in;
+
+// ---------------------------------------------------
+// settings
+
+#define USE_DDA
+#define USE_COUNTERS
+#include "common.glsl"
+#include "pathtracer.glsl"
@@ -0,0 +1,38 @@
+#version 450 core
+
+layout (local_size_x = 256) in;
+
+layout (binding = 0, rgba32f) uniform readonly image2D color;
+
+// converted image: fp32, or fp16 with two elements per word
+layout (std430, binding = 0) writeonly buffer ReadbackBuffer {
+    uint words[];
+};
+
+uniform ivec2 resolution;
+uniform int channels;       // 3 (rgb) or 4 (rgba)
+uniform int half_float;     // 1: fp16, 0: fp32
+uniform int planar;         // 1: channel planes (chw), 0: interleaved (hwc)
+uniform int flip;           // 1: rows top-down
+
+// ---------------------------------------------------
+// format conversion for readback, one invocation per output word (elements of a word may belong to different pixels)
+
+float element(const uint e) {
+    const uint n_pixels = uint(resolution.x * resolution.y);
+    const uint p = planar != 0 ? e % n_pixels : e / uint(channels);
+    const uint c = planar != 0 ? e / n_pixels : e % uint(channels);
+    const ivec2 pixel = ivec2(p % uint(resolution.x), p / uint(resolution.x));
+    return imageLoad(color, ivec2(pixel.x, flip != 0 ? resolution.y - 1 - pixel.y : pixel.y))[c];
+}
+
+void main() {
+    // 2D dispatch for large images, rows of gl_NumWorkGroups.x groups
+    const uint word = gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x;
+    const uint n = uint(resolution.x * resolution.y * channels);
+    if (half_float != 0) {
+        if (2 * word >= n) return;
+        words[word] = packHalf2x16(vec2(element(2 * word), 2 * word + 1 < n ? element(2 * word + 1) : 0.f));
+    } else if (word < n)
+        words[word] = floatBitsToUint(element(word));
+}
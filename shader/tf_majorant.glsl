@@ -0,0 +1,72 @@
+#version 450 core
+
+layout (local_size_x = 8, local_size_y = 8, local_size_z = 4) in;
+
+layout (binding = 0, r32f) uniform writeonly image3D tf_majorant;
+layout (binding = 1, r32f) uniform readonly image3D tf_majorant_fine; // next finer level (mip > 0), level 0 (mip < 0)
+
+layout (std430, binding = 2) buffer TFOccupiedBuffer {
+    int tf_occupied[6];                 // min. and max. brick with non-zero opacity (mip < 0)
+};
+
+// ---------------------------------------------------
+// settings
+
+#define USE_TRANSFERFUNC
+#include "common.glsl"
+
+// ---------------------------------------------------
+// uniforms
+
+uniform sampler3D tf_majorant_range;    // brick min/max (level 0)
+uniform int tf_majorant_mip;          // < 0: reduce bounds of the occupied bricks on level 0
+uniform ivec3 tf_majorant_size;         // size of the level to write
+uniform float tf_majorant_inv_scale;    // 1 / global majorant (without density scale), as in the tracer
+uniform vec2 tf_majorant_update;        // level 0: only bricks overlapping this window coordinate interval are updated
+
+shared int group_occupied[6];
+
+// ---------------------------------------------------
+// bounds of the bricks with non-zero opacity, reduced per work group first
+
+void reduce_occupied(const ivec3 brick) {
+    if (gl_LocalInvocationIndex == 0)
+        group_occupied = int[6](0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF, -1, -1, -1);
+    barrier();
+    if (all(lessThan(brick, tf_majorant_size)) && imageLoad(tf_majorant_fine, brick).x > 0.f) {
+        for (int i = 0; i < 3; ++i) {
+            atomicMin(group_occupied[i], brick[i]);
+            atomicMax(group_occupied[i + 3], brick[i]);
+        }
+    }
+    barrier();
+    if (gl_LocalInvocationIndex == 0 && group_occupied[3] >= 0) {
+        for (int i = 0; i < 3; ++i) {
+            atomicMin(tf_occupied[i], group_occupied[i]);
+            atomicMax(tf_occupied[i + 3], group_occupied[i + 3]);
+        }
+    }
+}
+
+// ---------------------------------------------------
+// max. transfer function opacity per brick: over its value range on level 0, max. of the 2x2x2 finer bricks above
+
+void main() {
+    const ivec3 brick = ivec3(gl_GlobalInvocationID);
+    if (tf_majorant_mip < 0) {
+        reduce_occupied(brick);
+        return;
+    }
+    if (any(greaterThanEqual(brick, tf_majorant_size))) return;
+
+    float a = 0.f;
+    if (tf_majorant_mip == 0) {
+        const vec2 range = texelFetch(tf_majorant_range, brick, 0).xy * tf_majorant_inv_scale;
+        if (tf_window(range.y) < tf_majorant_update.x || tf_window(range.x) > tf_majorant_update.y) return; // unchanged
+        a = tf_max_opacity(range.x, range.y);
+    } else {
+        for (int i = 0; i < 8; ++i)
+            a = max(a, imageLoad(tf_majorant_fine, 2 * brick + ivec3(i & 1, (i >> 1) & 1, i >> 2)).x);
+    }
+    imageStore(tf_majorant, brick, vec4(a));
+}
@@ -24,7 +24,7 @@ vec3 hable_tonemap(in vec3 rgb, in float exposure) {
     return hable(exposure * rgb) / hable(vec3(W));
 }
 
-vec4 sanitize(const vec4 x) { return mix(x, vec4(0), isnan(x) || isinf(x)); }
+vec4 sanitize(const vec4 x) { return mix(x, vec4(0), bvec4(ivec4(isnan(x)) | ivec4(isinf(x)))); }
 
 void main() {
 	const ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
@@ -0,0 +1,209 @@
+#include "bc4.h"
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// -----------------------------------------------------------
+// BC4Stats
+
+void BC4Stats::add(const BC4Stats& other) {
+    texels += other.texels;
+    squared_error += other.squared_error;
+    max_error = std::max(max_error, other.max_error);
+}
+
+double BC4Stats::rmse() const {
+    return texels ? std::sqrt(double(squared_error) / texels) : 0.0;
+}
+
+double BC4Stats::psnr() const {
+    if (squared_error == 0) return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 * texels / double(squared_error));
+}
+
+// -----------------------------------------------------------
+// block encoding
+
+namespace {
+
+// palette of a block: r0 > r1 interpolates 8 values, otherwise 6 values plus 0 and 255
+void bc4_palette(uint8_t r0, uint8_t r1, uint8_t* palette) {
+    palette[0] = r0;
+    palette[1] = r1;
+    if (r0 > r1) {
+        for (int k = 2; k < 8; ++k)
+            palette[k] = uint8_t(((8 - k) * r0 + (k - 1) * r1 + 3) / 7);
+    } else {
+        for (int k = 2; k < 6; ++k)
+            palette[k] = uint8_t(((6 - k) * r0 + (k - 1) * r1 + 2) / 5);
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// endpoints of both modes: min/max of the block, and min/max of the values other than 0 and 255
+void bc4_endpoints(const uint8_t* texels, uint8_t endpoints[2][2]) {
+    uint8_t lo = 255, hi = 0, lo_inner = 255, hi_inner = 0;
+    for (int i = 0; i < 16; ++i) {
+        const uint8_t v = texels[i];
+        lo = std::min(lo, v);
+        hi = std::max(hi, v);
+        if (v != 0 && v != 255) {
+            lo_inner = std::min(lo_inner, v);
+            hi_inner = std::max(hi_inner, v);
+        }
+    }
+    if (lo_inner > hi_inner) lo_inner = hi_inner = 0;
+    endpoints[0][0] = hi; endpoints[0][1] = lo;
+    endpoints[1][0] = lo_inner; endpoints[1][1] = hi_inner;
+}
+
+void bc4_pack(uint8_t r0, uint8_t r1, const uint8_t* indices, uint8_t* block) {
+    block[0] = r0;
+    block[1] = r1;
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i)
+        bits |= uint64_t(indices[i]) << (3 * i);
+    for (int i = 0; i < 6; ++i)
+        block[2 + i] = uint8_t(bits >> (8 * i));
+}
+
+// nearest palette entry per texel (the first one on ties), returns the squared error
+uint32_t bc4_indices(const uint8_t* texels, const uint8_t* palette, uint8_t* indices, uint32_t& max_error) {
+    uint32_t squared_error = 0;
+    max_error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = std::abs(int(texels[i]) - palette[0]);
+        indices[i] = 0;
+        for (int k = 1; k < 8; ++k) {
+            const int err = std::abs(int(texels[i]) - palette[k]);
+            if (err < best) {
+                best = err;
+                indices[i] = uint8_t(k);
+            }
+        }
+        squared_error += best * best;
+        max_error = std::max(max_error, uint32_t(best));
+    }
+    return squared_error;
+}
+
+#if defined(__SSE2__)
+// same as bc4_indices() for all 16 texels at once
+uint32_t bc4_indices_sse2(const __m128i texels, const uint8_t* palette, uint8_t* indices, uint32_t& max_error) {
+    const auto absdiff = [](__m128i a, __m128i b) { return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a)); };
+    __m128i best = absdiff(texels, _mm_set1_epi8(char(palette[0])));
+    __m128i index = _mm_setzero_si128();
+    for (int k = 1; k < 8; ++k) {
+        const __m128i err = absdiff(texels, _mm_set1_epi8(char(palette[k])));
+        // err < best (unsigned): max(err, best) != err
+        const __m128i less = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_max_epu8(err, best), err), _mm_set1_epi8(-1));
+        index = _mm_or_si128(_mm_andnot_si128(less, index), _mm_and_si128(less, _mm_set1_epi8(char(k))));
+        best = _mm_min_epu8(best, err);
+    }
+    _mm_storeu_si128((__m128i*)indices, index);
+    // squared error: widen to 16 bit, multiply-add pairs to 32 bit
+    const __m128i lo = _mm_unpacklo_epi8(best, _mm_setzero_si128()), hi = _mm_unpackhi_epi8(best, _mm_setzero_si128());
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    // max. error: horizontal max
+    __m128i m = _mm_max_epu8(best, _mm_srli_si128(best, 8));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 4));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 2));
+    m = _mm_max_epu8(m, _mm_srli_si128(m, 1));
+    max_error = uint32_t(_mm_cvtsi128_si32(m) & 0xFF);
+    return uint32_t(_mm_cvtsi128_si32(sum));
+}
+#endif
+
+// encode block with gathered texels, both modes are tried and the one with the lower error is kept (the first on ties)
+template <bool SIMD> void bc4_encode_texels(const uint8_t* texels, uint8_t* block, BC4Stats& stats) {
+    uint8_t endpoints[2][2], palette[8], indices[16], best_indices[16];
+    bc4_endpoints(texels, endpoints);
+    uint32_t best_error = std::numeric_limits<uint32_t>::max(), best_max = 0;
+    int best_mode = 0;
+    for (int mode = 0; mode < 2; ++mode) {
+        const uint8_t r0 = endpoints[mode][0], r1 = endpoints[mode][1];
+        if (mode == 0 && r0 == r1) continue; // constant block, exact in mode 1
+        bc4_palette(r0, r1, palette);
+        uint32_t max_error, error;
+#if defined(__SSE2__)
+        if (SIMD)
+            error = bc4_indices_sse2(_mm_loadu_si128((const __m128i*)texels), palette, indices, max_error);
+        else
+#endif
+            error = bc4_indices(texels, palette, indices, max_error);
+        if (error < best_error) {
+            best_error = error;
+            best_max = max_error;
+            best_mode = mode;
+            std::copy(indices, indices + 16, best_indices);
+        }
+    }
+    bc4_pack(endpoints[best_mode][0], endpoints[best_mode][1], best_indices, block);
+    stats.texels += 16;
+    stats.squared_error += best_error;
+    stats.max_error = std::max(stats.max_error, best_max);
+}
+
+void gather_block(const uint8_t* src, size_t row_stride, uint8_t* texels) {
+    for (int y = 0; y < 4; ++y)
+        std::copy(src + y * row_stride, src + y * row_stride + 4, texels + 4 * y);
+}
+
+} // namespace
+
+void bc4_encode_block(const uint8_t* src, size_t row_stride, uint8_t* block, BC4Stats& stats) {
+    uint8_t texels[16];
+    gather_block(src, row_stride, texels);
+    bc4_encode_texels<false>(texels, block, stats);
+}
+
+void bc4_decode_block(const uint8_t* block, uint8_t* texels) {
+    uint8_t palette[8];
+    bc4_palette(block[0], block[1], palette);
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i)
+        bits |= uint64_t(block[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i)
+        texels[i] = palette[(bits >> (3 * i)) & 7];
+}
+
+// -----------------------------------------------------------
+// image encoding
+
+std::vector<uint8_t> bc4_encode(const uint8_t* data, int w, int h, int d, BC4Stats& stats, uint32_t n_threads) {
+    const int bw = w / 4, bh = h / 4;
+    std::vector<uint8_t> blocks(size_t(bw) * bh * d * 8);
+    if (n_threads == 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::max(1u, std::min(n_threads, uint32_t(d)));
+    // contiguous layer ranges per thread, stats are summed in order
+    std::vector<BC4Stats> thread_stats(n_threads);
+    const auto encode = [&](uint32_t t) {
+        const int z_begin = int(int64_t(d) * t / n_threads), z_end = int(int64_t(d) * (t + 1) / n_threads);
+        uint8_t texels[16];
+        for (int z = z_begin; z < z_end; ++z) {
+            for (int by = 0; by < bh; ++by) {
+                const uint8_t* row = data + (size_t(z) * h + 4 * by) * w;
+                uint8_t* out = blocks.data() + ((size_t(z) * bh + by) * bw) * 8;
+                for (int bx = 0; bx < bw; ++bx) {
+                    gather_block(row + 4 * bx, w, texels);
+                    bc4_encode_texels<true>(texels, out + 8 * bx, thread_stats[t]);
+                }
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < n_threads; ++t)
+        threads.emplace_back(encode, t);
+    for (auto& thread : threads)
+        thread.join();
+    for (const auto& s : thread_stats)
+        stats.add(s);
+    return blocks;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// --------------------------------------------------------------
+// BC4 (RGTC1, unsigned) encoding of 8 bit single channel images on the CPU,
+// deterministic (independent of instruction set and thread count), 8 bytes per 4x4 block
+
+// encoding error in 8 bit units
+struct BC4Stats {
+    uint64_t texels = 0;
+    uint64_t squared_error = 0;
+    uint32_t max_error = 0;
+    uint32_t pad = 0;
+
+    void add(const BC4Stats& other);
+    double rmse() const;
+    double psnr() const;    // in dB, infinite if lossless
+};
+
+// encode a 4x4 block (rows of row_stride bytes) into 8 bytes, scalar reference
+void bc4_encode_block(const uint8_t* src, size_t row_stride, uint8_t* block, BC4Stats& stats);
+// decode a 4x4 block into 16 texels (rows of 4, endpoint interpolation rounded to 8 bit)
+void bc4_decode_block(const uint8_t* block, uint8_t* texels);
+
+// encode the layers of a w x h x d image (w and h multiples of 4) in the layout of a 2D array texture
+// (per layer, rows of blocks), layers are encoded in parallel (n_threads = 0: all cores)
+std::vector<uint8_t> bc4_encode(const uint8_t* data, int w, int h, int d, BC4Stats& stats, uint32_t n_threads = 0);
@@ -12,8 +12,13 @@
 #include <pybind11/operators.h>
 
 #include "renderer.h"
+#include "renderer_cpu.h"
+#include "glcontext.h"
+#include "brick_cache.h"
+#include "image_io.h"
 #include "environment.h"
 #include "transferfunc.h"
+#include "render_batch.h"
 
 using namespace cppgl;
 
@@ -61,6 +66,81 @@ pybind11::class_<MatT> register_matrix_operators(pybind11::class_<MatT>& pyclass
         .def(-pybind11::self);
 }
 
+static glm::ivec2 render_resolution(const std::shared_ptr<Renderer>& renderer) {
+    if (auto cpu = std::dynamic_pointer_cast<RendererCPU>(renderer))
+        return glm::ivec2(cpu->resolution);
+    return gl_resolution();
+}
+
+// 8 bit pixels of the displayed image (rows bottom-up): the default framebuffer after draw() with a window,
+// without one (headless) the color texture tonemapped on the CPU the same way draw() would
+static std::vector<uint8_t> displayed_pixels(const std::shared_ptr<RendererOpenGL>& renderer, int channels) {
+    const glm::ivec2 size = gl_resolution();
+    std::vector<uint8_t> pixels(size_t(size.x) * size.y * channels);
+    if (gl_window_current()) {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, size.x, size.y, channels == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        return pixels;
+    }
+    const Texture2D& color = renderer->color;
+    if (!color || color->w != size.x || color->h != size.y)
+        throw std::runtime_error("save: color buffer does not match the render resolution");
+    std::vector<glm::vec4> rgba(size_t(color->w) * color->h);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, color->id);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &rgba[0].x);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    std::vector<uint8_t> rgba8(rgba.size() * 4);
+    tonemap_ldr(rgba.data(), rgba.size(), rgba8.data(), renderer->tonemapping, renderer->tonemap_exposure, renderer->tonemap_gamma);
+    for (size_t i = 0; i < pixels.size() / channels; ++i)
+        for (int c = 0; c < channels; ++c)
+            pixels[channels * i + c] = rgba8[4 * i + c];
+    return pixels;
+}
+
+// readback format matching a numpy array of shape (h, w, 3 or 4), or (3 or 4, h, w) when planar, with dtype float32 or float16
+static ImageReadback::Format readback_format(const pybind11::array& out, const glm::ivec2& res, bool planar, bool flip) {
+    ImageReadback::Format format;
+    format.planar = planar;
+    format.flip = flip;
+    if (out.dtype().kind() != 'f' || (out.itemsize() != 4 && out.itemsize() != 2))
+        throw std::runtime_error("readback: dtype must be float32 or float16");
+    format.half = out.itemsize() == 2;
+    const ssize_t c = out.ndim() == 3 ? out.shape(planar ? 0 : 2) : 0;
+    if (out.ndim() != 3 || (c != 3 && c != 4) || out.shape(planar ? 1 : 0) != res.y || out.shape(planar ? 2 : 1) != res.x)
+        throw std::runtime_error("readback: expected shape " + std::string(planar ? "(3 or 4, " : "(") + std::to_string(res.y) + ", " + std::to_string(res.x) + (planar ? ")" : ", 3 or 4)"));
+    if (!(out.flags() & pybind11::array::c_style) || !out.writeable())
+        throw std::runtime_error("readback: array must be writeable and C-contiguous");
+    format.alpha = c == 4;
+    return format;
+}
+
+// job from dict with (a subset of) the keys below
+static RenderJob render_job(const pybind11::dict& params) {
+    RenderJob job;
+    for (const auto& [key, value] : params) {
+        const std::string name = pybind11::str(key);
+        if (name == "cam_pos") job.cam_pos = value.cast<glm::vec3>();
+        else if (name == "cam_dir") job.cam_dir = value.cast<glm::vec3>();
+        else if (name == "cam_fov") job.cam_fov = value.cast<float>();
+        else if (name == "volume") job.volume = value.cast<std::shared_ptr<voldata::Volume>>();
+        else if (name == "frame") job.frame = value.cast<size_t>();
+        else if (name == "albedo") job.albedo = value.cast<glm::vec3>();
+        else if (name == "phase") job.phase = value.cast<float>();
+        else if (name == "density_scale") job.density_scale = value.cast<float>();
+        else if (name == "emission_scale") job.emission_scale = value.cast<float>();
+        else if (name == "transferfunc") job.transferfunc = value.is_none() ? nullptr : value.cast<std::shared_ptr<TransferFunction>>();
+        else if (name == "environment") job.environment = value.cast<std::shared_ptr<Environment>>();
+        else if (name == "env_strength") job.env_strength = value.cast<float>();
+        else if (name == "show_environment") job.show_environment = value.cast<bool>();
+        else if (name == "seed") job.seed = value.cast<int>();
+        else if (name == "spp") job.spp = value.cast<int>();
+        else if (name == "bounces") job.bounces = value.cast<int>();
+        else throw std::runtime_error("render_batch: unknown job parameter: " + name);
+    }
+    return job;
+}
+
 PYBIND11_EMBEDDED_MODULE(volpy, m) {
 
     // ------------------------------------------------------------
@@ -81,10 +161,18 @@ PYBIND11_EMBEDDED_MODULE(volpy, m) {
 
     pybind11::class_<voldata::Volume, std::shared_ptr<voldata::Volume>>(m, "Volume")
         .def(pybind11::init<>())
-        .def(pybind11::init<std::string>())
+        .def(pybind11::init([](const std::string& path) {
+            auto volume = std::make_shared<voldata::Volume>(path);
+            BrickCache::register_source(volume->current_grid(), path, "density");
+            return volume;
+        }))
         .def(pybind11::init<size_t, size_t, size_t, const uint8_t*>())
         .def(pybind11::init<size_t, size_t, size_t, const float*>())
-        .def("load_grid", &voldata::Volume::load_grid)
+        .def("load_grid", [](const std::string& path, const std::string& gridname) {
+            auto grid = voldata::Volume::load_grid(path, gridname);
+            BrickCache::register_source(grid, path, gridname);
+            return grid;
+        })
         .def("clear", &voldata::Volume::clear)
         .def("add_grid_frame", &voldata::Volume::add_grid_frame)
         .def("update_grid_frame", &voldata::Volume::update_grid_frame)
@@ -93,6 +181,15 @@ PYBIND11_EMBEDDED_MODULE(volpy, m) {
         .def("minorant_majorant", &voldata::Volume::minorant_majorant)
         .def("__repr__", &voldata::Volume::to_string, pybind11::arg("indent") = "");
 
+    // ------------------------------------------------------------
+    // brick cache bindings
+
+    pybind11::class_<BrickCache>(m, "BrickCache")
+        .def_readwrite_static("enabled", &BrickCache::enabled)
+        .def_readwrite_static("directory", &BrickCache::directory)
+        .def_readwrite_static("max_bytes", &BrickCache::max_bytes)
+        .def_static("evict", &BrickCache::evict, pybind11::arg("reserve_bytes") = 0);
+
     // ------------------------------------------------------------
     // environment bindings
 
@@ -100,6 +197,18 @@ PYBIND11_EMBEDDED_MODULE(volpy, m) {
         .def(pybind11::init<std::string>())
         .def_readwrite("strength", &Environment::strength);
 
+    pybind11::class_<EnvironmentCache>(m, "EnvironmentCache")
+        .def_readwrite_static("enabled", &EnvironmentCache::enabled)
+        .def_readwrite_static("persist", &EnvironmentCache::persist)
+        .def_readwrite_static("max_bytes", &EnvironmentCache::max_bytes)
+        .def_readonly_static("entries", &EnvironmentCache::entries)
+        .def_readonly_static("bytes", &EnvironmentCache::bytes)
+        .def_readonly_static("hits", &EnvironmentCache::hits)
+        .def_readonly_static("disk_hits", &EnvironmentCache::disk_hits)
+        .def_readonly_static("misses", &EnvironmentCache::misses)
+        .def_static("clear", &EnvironmentCache::clear)
+        .def_static("evict", &EnvironmentCache::evict, pybind11::arg("reserve_bytes") = 0);
+
     // ------------------------------------------------------------
     // transferfunc bindings
 
@@ -114,74 +223,259 @@ PYBIND11_EMBEDDED_MODULE(volpy, m) {
     // ------------------------------------------------------------
     // renderer bindings
 
-    pybind11::class_<RendererOpenGL, std::shared_ptr<RendererOpenGL>>(m, "Renderer")
-        .def(pybind11::init<>())
-        .def("init", &RendererOpenGL::init)
-        .def("commit", &RendererOpenGL::commit)
-        .def("trace", &RendererOpenGL::trace)
-        .def("reset", &RendererOpenGL::reset)
-        .def("scale_and_move_to_unit_cube", &RendererOpenGL::scale_and_move_to_unit_cube)
-        .def("render", [](const std::shared_ptr<RendererOpenGL>& renderer, int spp) {
-            current_camera()->update();
-            renderer->sample = 0;
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    pybind11::class_<Renderer, std::shared_ptr<Renderer>>(m, "Renderer")
+        .def(pybind11::init([](const std::string& backend) -> std::shared_ptr<Renderer> {
+            if (backend == "gl") return std::make_shared<RendererOpenGL>();
+            if (backend == "cpu") return std::make_shared<RendererCPU>();
+            throw std::runtime_error("Unknown backend: " + backend);
+        }), pybind11::arg("backend") = "gl")
+        .def("init", &Renderer::init)
+        .def("commit", &Renderer::commit)
+        .def("trace", &Renderer::trace)
+        .def("reset", &Renderer::reset)
+        .def("scale_and_move_to_unit_cube", &Renderer::scale_and_move_to_unit_cube)
+        .def_property("vram_budget", [](const std::shared_ptr<Renderer>& renderer) {
+            auto gl = std::dynamic_pointer_cast<RendererOpenGL>(renderer);
+            return gl ? gl->residency.budget_bytes : 0;
+        }, [](const std::shared_ptr<Renderer>& renderer, size_t bytes) {
+            if (auto gl = std::dynamic_pointer_cast<RendererOpenGL>(renderer)) {
+                gl->residency.budget_bytes = bytes;
+                gl->residency.enforce_budget();
+            }
+        })
+        .def("residency_stats", [](const std::shared_ptr<Renderer>& renderer) {
+            std::map<std::string, size_t> stats;
+            if (auto gl = std::dynamic_pointer_cast<RendererOpenGL>(renderer)) {
+                stats["frames"] = gl->residency.size();
+                stats["resident_frames"] = gl->residency.resident_frames;
+                stats["resident_bytes"] = gl->residency.resident_bytes;
+                stats["hits"] = gl->residency.hits;
+                stats["misses"] = gl->residency.misses;
+                stats["evictions"] = gl->residency.evictions;
+            }
+            return stats;
+        })
+        .def("atlas_error", [](const std::shared_ptr<Renderer>& renderer) {
+            // BC4 encoding error of the density and emission atlases of the committed frames (OpenGL only), in 8 bit units
+            pybind11::dict error;
+            if (auto gl = std::dynamic_pointer_cast<RendererOpenGL>(renderer)) {
+                const char* names[2] = { "density", "emission" };
+                for (int i = 0; i < 2; ++i) {
+                    const BC4Stats& stats = gl->atlas_error[i];
+                    if (stats.texels == 0) continue;
+                    pybind11::dict grid;
+                    grid["texels"] = stats.texels;
+                    grid["rmse"] = stats.rmse();
+                    grid["max_error"] = stats.max_error;
+                    grid["psnr"] = stats.psnr();
+                    error[names[i]] = grid;
+                }
+            }
+            return error;
+        })
+        .def("counters", [](const std::shared_ptr<Renderer>& renderer) {
+            // hot-path counters since reset (with instrumented, OpenGL only)
+            renderer->read_counters();
+            pybind11::dict counters;
+            counters["paths"] = renderer->pixel_samples;
+            for (int i = 0; i < TraceCounters::BOUNCES; ++i)
+                counters[TraceCounters::name(i)] = renderer->counters[i];
+            std::vector<uint64_t> bounces(TraceCounters::N_BOUNCE_BINS);
+            for (int i = 0; i < TraceCounters::N_BOUNCE_BINS; ++i)
+                bounces[i] = renderer->counters.bounces(i);
+            counters["bounces"] = bounces;
+            return counters;
+        })
+        .def("counters_json", [](const std::shared_ptr<Renderer>& renderer) {
+            renderer->read_counters();
+            return renderer->counters.json(renderer->pixel_samples);
+        })
+        .def("n_frames", &Renderer::n_frames)
+        .def_property("frame", &Renderer::current_frame, &Renderer::set_frame)
+        .def("stream", [](const std::shared_ptr<Renderer>& renderer, const std::string& folder, size_t window, size_t max_bytes) {
+            renderer->stream = std::make_shared<FrameStream>(folder, FRAME_GRID_NAMES, window, max_bytes);
+            renderer->stream_frame = 0;
+            renderer->volume = std::make_shared<voldata::Volume>();
+            renderer->volume->add_grid_frame(renderer->stream->acquire(0)->grids);
+        }, pybind11::arg("folder"), pybind11::arg("window") = 8, pybind11::arg("max_bytes") = 0)
+        .def("render", [](const std::shared_ptr<Renderer>& renderer, int spp) {
+            if (gl_context_current()) {
+                gl_update_camera();
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
+            renderer->reset();
+            const int sppx = renderer->sppx;
+            renderer->sppx = spp; // limits batch size and adaptive early stop
             while (renderer->sample < spp) {
                 renderer->trace();
-                Context::swap_buffers(); // keep interactivity
+                if (gl_context_current())
+                    gl_swap_buffers(); // keep interactivity
             }
+            renderer->sppx = sppx;
         })
-        .def("draw", [](const std::shared_ptr<RendererOpenGL>& renderer) {
+        .def("draw", [](const std::shared_ptr<Renderer>& renderer) {
+            if (!gl_window_current()) return; // nothing to draw to when headless
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             renderer->draw();
             Context::swap_buffers();
         })
-        .def_static("resolution", []() {
-            return Context::resolution();
+        .def("resolution", &render_resolution)
+        .def("readback", [](const std::shared_ptr<Renderer>& renderer, pybind11::array out, bool planar, bool flip) {
+            // accumulation buffer into given array (fp32 or fp16, rgb or rgba as given by its dtype and shape), converted on the GPU
+            const glm::ivec2 res = render_resolution(renderer);
+            const ImageReadback::Format format = readback_format(out, res, planar, flip);
+            void* dst = out.mutable_data();
+            {
+                pybind11::gil_scoped_release release;
+                if (auto cpu = std::dynamic_pointer_cast<RendererCPU>(renderer))
+                    ImageReadback::convert(cpu->color.data(), res.x, res.y, format, dst);
+                else {
+                    auto gl = std::static_pointer_cast<RendererOpenGL>(renderer);
+                    gl->readback.read(gl->color, format, dst, format.bytes(res.x, res.y));
+                }
+            }
+            return out;
+        }, pybind11::arg("out"), pybind11::arg("planar") = false, pybind11::arg("flip") = true)
+        .def("render_batch", [](const std::shared_ptr<Renderer>& renderer, const std::vector<pybind11::dict>& params, bool half, bool alpha, bool planar, bool flip) {
+            // render jobs back-to-back with pipelined readback, returns array of shape (n, h, w, c), or (n, c, h, w) with planar
+            std::vector<RenderJob> jobs;
+            for (const auto& p : params)
+                jobs.push_back(render_job(p));
+            ImageReadback::Format format;
+            format.half = half;
+            format.alpha = alpha;
+            format.planar = planar;
+            format.flip = flip;
+            const glm::ivec2 res = render_resolution(renderer);
+            const ssize_t n = ssize_t(jobs.size()), c = format.channels();
+            pybind11::array out(pybind11::dtype(half ? "float16" : "float32"), planar ? std::vector<ssize_t>{ n, c, res.y, res.x } : std::vector<ssize_t>{ n, res.y, res.x, c });
+            void* dst = out.mutable_data();
+            {
+                pybind11::gil_scoped_release release;
+                render_batch(*renderer, jobs, format, dst);
+            }
+            return out;
+        }, pybind11::arg("jobs"), pybind11::arg("half") = false, pybind11::arg("alpha") = false, pybind11::arg("planar") = false, pybind11::arg("flip") = true)
+        .def("readback_async", [](const std::shared_ptr<Renderer>& renderer, bool half, bool alpha, bool planar, bool flip) {
+            // queue readback, the next render can start before it finished, returns id for readback_wait
+            auto gl = std::dynamic_pointer_cast<RendererOpenGL>(renderer);
+            if (!gl) throw std::runtime_error("readback_async: requires the OpenGL backend");
+            ImageReadback::Format format;
+            format.half = half;
+            format.alpha = alpha;
+            format.planar = planar;
+            format.flip = flip;
+            return gl->readback.request(gl->color, format);
+        }, pybind11::arg("half") = false, pybind11::arg("alpha") = false, pybind11::arg("planar") = false, pybind11::arg("flip") = true)
+        .def("readback_wait", [](const std::shared_ptr<Renderer>& renderer, uint64_t id, pybind11::array out) {
+            auto gl = std::dynamic_pointer_cast<RendererOpenGL>(renderer);
+            if (!gl) throw std::runtime_error("readback_wait: requires the OpenGL backend");
+            // array must match the request in dtype, channels and layout, not just in byte size
+            ImageReadback::Format format;
+            glm::uvec2 size;
+            if (!gl->readback.pending(id, format, size))
+                throw std::runtime_error("readback_wait: no pending request with id " + std::to_string(id));
+            const ImageReadback::Format given = readback_format(out, glm::ivec2(size), format.planar, format.flip);
+            if (given.half != format.half || given.alpha != format.alpha)
+                throw std::runtime_error(std::string("readback_wait: expected dtype ") + (format.half ? "float16" : "float32") + " with " + std::to_string(format.channels()) + " channels");
+            void* dst = out.mutable_data();
+            const size_t bytes = out.nbytes();
+            {
+                pybind11::gil_scoped_release release;
+                gl->readback.wait(id, dst, bytes);
+            }
+            return out;
         })
-        .def("fbo_data", [](const std::shared_ptr<RendererOpenGL>& renderer) {
-            auto tex = renderer->color;
+        .def("fbo_data", [](const std::shared_ptr<Renderer>& renderer) {
+            if (auto cpu = std::dynamic_pointer_cast<RendererCPU>(renderer)) {
+                auto buf = std::make_shared<voldata::Buf3D<float>>(glm::uvec3(cpu->resolution.x, cpu->resolution.y, 3));
+                for (size_t i = 0; i < cpu->color.size(); ++i)
+                    for (int c = 0; c < 3; ++c)
+                        buf->data[3 * i + c] = cpu->color[i][c];
+                return buf;
+            }
+            auto tex = std::static_pointer_cast<RendererOpenGL>(renderer)->color;
             auto buf = std::make_shared<voldata::Buf3D<float>>(glm::uvec3(tex->w, tex->h, 3));
             glBindTexture(GL_TEXTURE_2D, tex->id);
             glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &buf->data[0]);
             glBindTexture(GL_TEXTURE_2D, 0);
             return buf;
         })
-        .def("save", [](const std::shared_ptr<RendererOpenGL>& renderer, const std::string& filename = "out.png") {
-            const glm::ivec2 size = Context::resolution();
-            std::vector<uint8_t> pixels(size.x * size.y * 3);
-            glPixelStorei(GL_PACK_ALIGNMENT, 1);
-            glReadPixels(0, 0, size.x, size.y, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        .def("save", [](const std::shared_ptr<Renderer>& renderer, const std::string& filename = "out.png") {
+            if (std::dynamic_pointer_cast<RendererCPU>(renderer))
+                return renderer->save(filename, renderer->tonemapping);
+            const glm::ivec2 size = gl_resolution();
+            const std::vector<uint8_t> pixels = displayed_pixels(std::static_pointer_cast<RendererOpenGL>(renderer), 3);
             const fs::path outfile = fs::path(filename);
             image_store_ldr(outfile, pixels.data(), size.x, size.y, 3);
             std::cout << outfile << " written." << std::endl;
         })
-        .def("save_with_alpha", [](const std::shared_ptr<RendererOpenGL>& renderer, const std::string& filename = "out.png") {
-            const glm::ivec2 size = Context::resolution();
-            std::vector<uint8_t> pixels(size.x * size.y * 4);
-            glPixelStorei(GL_PACK_ALIGNMENT, 1);
-            glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        .def("save_with_alpha", [](const std::shared_ptr<Renderer>& renderer, const std::string& filename = "out.png") {
+            if (std::dynamic_pointer_cast<RendererCPU>(renderer))
+                return renderer->save(fs::path(filename).replace_extension(".png").string(), renderer->tonemapping);
+            const glm::ivec2 size = gl_resolution();
+            const std::vector<uint8_t> pixels = displayed_pixels(std::static_pointer_cast<RendererOpenGL>(renderer), 4);
             const fs::path outfile = fs::path(filename).replace_extension(".png");
             image_store_ldr(outfile, pixels.data(), size.x, size.y, 4);
             std::cout << outfile << " written." << std::endl;
         })
+        .def("save_exr", [](const std::shared_ptr<Renderer>& renderer, const std::string& filename, bool half) {
+            // raw accumulation buffer (without tonemapping)
+            if (auto cpu = std::dynamic_pointer_cast<RendererCPU>(renderer))
+                return image_store_exr(filename, cpu->color.data(), cpu->resolution.x, cpu->resolution.y, half);
+            auto tex = std::static_pointer_cast<RendererOpenGL>(renderer)->color;
+            std::vector<glm::vec4> data(size_t(tex->w) * tex->h);
+            glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+            glBindTexture(GL_TEXTURE_2D, tex->id);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &data[0].x);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            image_store_exr(filename, data.data(), tex->w, tex->h, half);
+        }, pybind11::arg("filename") = "out.exr", pybind11::arg("half") = true)
+        .def("save_heatmap", &Renderer::save_heatmap, pybind11::arg("filename") = "heatmap.png")
+        .def("scene_hash", &Renderer::scene_hash, pybind11::arg("sources") = "")
+        .def("save_checkpoint", &Renderer::save_checkpoint, pybind11::arg("filename"), pybind11::arg("scene_hash"))
+        .def("load_checkpoint", &Renderer::load_checkpoint, pybind11::arg("filename"), pybind11::arg("scene_hash"))
         // members
-        .def_readwrite("volume", &RendererOpenGL::volume)
-        .def_readwrite("environment", &RendererOpenGL::environment)
-        .def_readwrite("transferfunc", &RendererOpenGL::transferfunc)
-        .def_readwrite("sample", &RendererOpenGL::sample)
-        .def_readwrite("sppx", &RendererOpenGL::sppx)
-        .def_readwrite("bounces", &RendererOpenGL::bounces)
-        .def_readwrite("seed", &RendererOpenGL::seed)
-        .def_readwrite("tonemap_exposure", &RendererOpenGL::tonemap_exposure)
-        .def_readwrite("tonemap_gamma", &RendererOpenGL::tonemap_gamma)
-        .def_readwrite("tonemapping", &RendererOpenGL::tonemapping)
-        .def_readwrite("show_environment", &RendererOpenGL::show_environment)
-        .def_readwrite("albedo", &RendererOpenGL::albedo)
-        .def_readwrite("phase", &RendererOpenGL::phase)
-        .def_readwrite("density_scale", &RendererOpenGL::density_scale)
-        .def_readwrite("emission_scale", &RendererOpenGL::emission_scale)
-        .def_readwrite("vol_clip_min", &RendererOpenGL::vol_clip_min)
-        .def_readwrite("vol_clip_max", &RendererOpenGL::vol_clip_max)
+        .def_readwrite("volume", &Renderer::volume)
+        .def_readwrite("environment", &Renderer::environment)
+        .def_readwrite("transferfunc", &Renderer::transferfunc)
+        .def_readwrite("sample", &Renderer::sample)
+        .def_readwrite("sppx", &Renderer::sppx)
+        .def_readwrite("samples_per_dispatch", &Renderer::samples_per_dispatch)
+        .def_readonly("pixel_samples", &Renderer::pixel_samples)
+        .def_readwrite("bounces", &Renderer::bounces)
+        .def_readwrite("seed", &Renderer::seed)
+        .def_readwrite("tonemap_exposure", &Renderer::tonemap_exposure)
+        .def_readwrite("tonemap_gamma", &Renderer::tonemap_gamma)
+        .def_readwrite("tonemapping", &Renderer::tonemapping)
+        .def_readwrite("show_environment", &Renderer::show_environment)
+        .def_readwrite("adaptive", &Renderer::adaptive)
+        .def_readwrite("adaptive_threshold", &Renderer::adaptive_threshold)
+        .def_readwrite("adaptive_min_samples", &Renderer::adaptive_min_samples)
+        .def_readwrite("adaptive_interval", &Renderer::adaptive_interval)
+        .def_readonly("tiles_active", &Renderer::tiles_active)
+        .def_readonly("tiles_total", &Renderer::tiles_total)
+        .def_readwrite("dvr", &Renderer::dvr)
+        .def_readwrite("dvr_preintegrated", &Renderer::dvr_preintegrated)
+        .def_readwrite("dvr_steps", &Renderer::dvr_steps)
+        .def_readwrite("lod_mode", &Renderer::lod_mode)
+        .def_readwrite("lod_levels", &Renderer::lod_levels)
+        .def_readwrite("lod_quality", &Renderer::lod_quality)
+        .def_readwrite("albedo", &Renderer::albedo)
+        .def_readwrite("phase", &Renderer::phase)
+        .def_readwrite("density_scale", &Renderer::density_scale)
+        .def_readwrite("emission_scale", &Renderer::emission_scale)
+        .def_readwrite("vol_clip_min", &Renderer::vol_clip_min)
+        .def_readwrite("vol_clip_max", &Renderer::vol_clip_max)
+        .def_readwrite("tight_bounds", &Renderer::tight_bounds)
+        .def_readwrite("instrumented", &Renderer::instrumented)
+        .def_property("n_threads", [](const std::shared_ptr<Renderer>& renderer) {
+            auto cpu = std::dynamic_pointer_cast<RendererCPU>(renderer);
+            return cpu ? cpu->n_threads : 0u;
+        }, [](const std::shared_ptr<Renderer>& renderer, uint32_t n_threads) {
+            if (auto cpu = std::dynamic_pointer_cast<RendererCPU>(renderer))
+                cpu->n_threads = n_threads;
+        })
         // camera
         .def_readwrite_static("cam_pos", &current_camera()->pos)
         .def_readwrite_static("cam_dir", &current_camera()->dir)
@@ -202,7 +496,7 @@ PYBIND11_EMBEDDED_MODULE(volpy, m) {
             return glm::normalize(glm::toQuat(GL_TO_COLMAP * current_camera()->view));
         })
         .def_static("colmap_focal_length", []() {
-            return Context::resolution().y / (2 * tan(0.5 * glm::radians(current_camera()->fov_degree)));
+            return gl_resolution().y / (2 * tan(0.5 * glm::radians(current_camera()->fov_degree)));
         })
         .def_static("shutdown", []() {
             exit(0);
@@ -0,0 +1,310 @@
+#include "brick_cache.h"
+
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+// -----------------------------------------------------------
+// file layout
+
+namespace {
+
+const char CACHE_MAGIC[8] = "VRBRICK";
+const uint32_t CACHE_VERSION = 2;
+const uint64_t CACHE_ALIGNMENT = 4096;  // sections start on page boundaries
+const size_t CACHE_MAX_KEY = 2048;
+const char* CACHE_EXTENSION = ".vrb";
+const char* ENVMAP_EXTENSION = ".vre";    // see EnvironmentCache
+const auto STALE_TMP_AGE = std::chrono::hours(1); // temporary files of stores that never finished (e.g. crashed)
+
+// layout of the brick grid data, must match brick_grid_to_textures() and shader/common.glsl
+const char* BRICK_PARAMS = "brick=8;indirection=rgb10a2ui;range=rg16f;atlas=r8;atlas_bc4=2d_array";
+
+struct Section {
+    uint64_t offset, bytes;
+    int32_t stride[3], pad;
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    int32_t n_range_levels;
+    uint64_t file_size;
+    char key[CACHE_MAX_KEY];
+    float transform[16];
+    Section indirection;
+    Section range[BrickGridView::MAX_LEVELS];
+    Section atlas;
+    Section atlas_bc4;          // BC4 encoded atlas (stride of the atlas), see HostBrickGrid::encode_atlas_bc4()
+    uint64_t bc4_texels, bc4_squared_error;     // BC4Stats of atlas_bc4
+    uint32_t bc4_max_error, pad;
+};
+static_assert(sizeof(Header) <= CACHE_ALIGNMENT, "brick cache header must fit into the first page");
+
+inline uint64_t align_up(uint64_t x) { return (x + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT; }
+
+inline uint64_t fnv1a(const std::string& s) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const char c : s) {
+        h ^= uint8_t(c);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+std::string default_directory() {
+    if (const char* dir = std::getenv("VOLREN_CACHE_DIR")) return dir;
+    if (const char* dir = std::getenv("XDG_CACHE_HOME")) return std::string(dir) + "/volren";
+    if (const char* dir = std::getenv("HOME")) return std::string(dir) + "/.cache/volren";
+    return (fs::temp_directory_path() / "volren").string();
+}
+
+fs::path cache_file(const std::string& key, const std::string& extension = CACHE_EXTENSION) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)fnv1a(key));
+    return fs::path(BrickCache::directory) / (std::string(name) + extension);
+}
+
+// grid sources, see BrickCache::register_source()
+std::mutex sources_mutex;
+std::map<const voldata::Grid*, std::pair<std::weak_ptr<voldata::Grid>, std::string>> sources;
+
+// serializes directory modifications (store and evict)
+std::mutex directory_mutex;
+
+} // namespace
+
+// -----------------------------------------------------------
+// BrickCache
+
+bool BrickCache::enabled = true;
+std::string BrickCache::directory = default_directory();
+size_t BrickCache::max_bytes = size_t(8) << 30;
+
+void BrickCache::register_source(const voldata::Volume::GridPtr& grid, const std::string& path, const std::string& gridname) {
+    if (!grid) return;
+    const std::string file = file_key(path);
+    if (file.empty()) return;
+    const std::string source = file + "|" + gridname;
+    std::lock_guard<std::mutex> lock(sources_mutex);
+    for (auto it = sources.begin(); it != sources.end();)
+        it = it->second.first.expired() ? sources.erase(it) : std::next(it);
+    sources[grid.get()] = { grid, source };
+}
+
+std::string BrickCache::key(const voldata::Volume::GridPtr& grid) {
+    std::lock_guard<std::mutex> lock(sources_mutex);
+    const auto it = sources.find(grid.get());
+    if (it == sources.end() || it->second.first.lock() != grid) return "";
+    return it->second.second + "|" + BRICK_PARAMS;
+}
+
+std::shared_ptr<HostBrickGrid> BrickCache::load(const std::string& key) {
+    if (key.empty() || key.size() >= CACHE_MAX_KEY) return nullptr;
+    const fs::path path = cache_file(key);
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return nullptr;
+    }
+    const size_t size = st.st_size;
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return nullptr;
+    std::shared_ptr<const void> storage(addr, [size](const void* p) { munmap(const_cast<void*>(p), size); });
+
+    // validate header
+    const uint8_t* base = (const uint8_t*)addr;
+    const Header& header = *(const Header*)addr;
+    const auto valid_section = [&](const Section& s, size_t elem_size) {
+        return s.offset % CACHE_ALIGNMENT == 0 && s.offset + s.bytes <= size &&
+            s.bytes == size_t(s.stride[0]) * s.stride[1] * s.stride[2] * elem_size;
+    };
+    bool valid = std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 && header.version == CACHE_VERSION &&
+        header.file_size == size && std::strncmp(header.key, key.c_str(), CACHE_MAX_KEY) == 0 &&
+        header.n_range_levels > 0 && header.n_range_levels <= BrickGridView::MAX_LEVELS &&
+        valid_section(header.indirection, sizeof(uint32_t)) && valid_section(header.atlas, sizeof(uint8_t)) &&
+        header.atlas_bc4.offset % CACHE_ALIGNMENT == 0 && header.atlas_bc4.offset + header.atlas_bc4.bytes <= size &&
+        header.atlas_bc4.bytes == header.atlas.bytes / 2 && std::memcmp(header.atlas_bc4.stride, header.atlas.stride, sizeof(header.atlas.stride)) == 0;
+    for (int i = 0; valid && i < header.n_range_levels; ++i)
+        valid = valid_section(header.range[i], sizeof(uint32_t));
+    if (!valid) {
+        std::cerr << "Discarding stale brick cache entry " << path << std::endl;
+        std::lock_guard<std::mutex> lock(directory_mutex);
+        std::error_code ec;
+        fs::remove(path, ec);
+        return nullptr;
+    }
+
+    // point view into mapped file
+    BrickGridView view;
+    std::memset(&view, 0, sizeof(view));
+    view.indirection = (const uint32_t*)(base + header.indirection.offset);
+    std::memcpy(view.indirection_stride, header.indirection.stride, sizeof(view.indirection_stride));
+    view.n_range_levels = header.n_range_levels;
+    for (int i = 0; i < header.n_range_levels; ++i) {
+        view.range[i] = (const uint32_t*)(base + header.range[i].offset);
+        std::memcpy(view.range_stride[i], header.range[i].stride, sizeof(view.range_stride[i]));
+    }
+    view.atlas = base + header.atlas.offset;
+    std::memcpy(view.atlas_stride, header.atlas.stride, sizeof(view.atlas_stride));
+    view.scale = 1.f;
+    glm::mat4 transform;
+    std::memcpy(&transform[0][0], header.transform, sizeof(header.transform));
+
+    auto grid = std::make_shared<HostBrickGrid>(view, transform, storage);
+    grid->atlas_bc4 = base + header.atlas_bc4.offset;
+    grid->atlas_bc4_stats.texels = header.bc4_texels;
+    grid->atlas_bc4_stats.squared_error = header.bc4_squared_error;
+    grid->atlas_bc4_stats.max_error = header.bc4_max_error;
+
+    // mark as recently used
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return grid;
+}
+
+void BrickCache::store(const std::string& key, const HostBrickGrid& bricks) {
+    if (key.empty() || key.size() >= CACHE_MAX_KEY)
+        throw std::runtime_error("BrickCache: invalid key!");
+    if (!bricks.atlas_bc4)
+        throw std::runtime_error("BrickCache: atlas not BC4 encoded!");
+    const BrickGridView& view = bricks.view;
+
+    // build header and section layout
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.n_range_levels = view.n_range_levels;
+    std::strncpy(header.key, key.c_str(), CACHE_MAX_KEY - 1);
+    std::memcpy(header.transform, &bricks.transform[0][0], sizeof(header.transform));
+    uint64_t offset = CACHE_ALIGNMENT;
+    std::vector<std::pair<const Section*, const void*>> sections;
+    const auto add_section = [&](Section& s, const int32_t* stride, size_t bytes, const void* data) {
+        s.offset = offset;
+        s.bytes = bytes;
+        std::memcpy(s.stride, stride, sizeof(s.stride));
+        offset = align_up(offset + bytes);
+        sections.push_back({ &s, data });
+    };
+    add_section(header.indirection, view.indirection_stride, bricks.indirection_size() * sizeof(uint32_t), view.indirection);
+    for (int i = 0; i < header.n_range_levels; ++i)
+        add_section(header.range[i], view.range_stride[i], bricks.range_size(i) * sizeof(uint32_t), view.range[i]);
+    add_section(header.atlas, view.atlas_stride, bricks.atlas_size(), view.atlas);
+    add_section(header.atlas_bc4, view.atlas_stride, bricks.atlas_size() / 2, bricks.atlas_bc4);
+    header.bc4_texels = bricks.atlas_bc4_stats.texels;
+    header.bc4_squared_error = bricks.atlas_bc4_stats.squared_error;
+    header.bc4_max_error = bricks.atlas_bc4_stats.max_error;
+    header.file_size = offset;
+    if (header.file_size > max_bytes) return; // would be evicted right away
+
+    std::lock_guard<std::mutex> lock(directory_mutex);
+    fs::create_directories(directory);
+    evict_locked(header.file_size);
+
+    // write to temporary file and rename, so readers never see partial entries
+    const fs::path path = cache_file(key);
+    fs::path tmp = path;
+    tmp += ".tmp" + std::to_string(getpid()) + "_" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    try {
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out) throw std::runtime_error("BrickCache: unable to write " + tmp.string());
+        out.write((const char*)&header, sizeof(header));
+        for (const auto& [section, data] : sections) {
+            out.seekp(section->offset);
+            out.write((const char*)data, section->bytes);
+        }
+        // pad to full size
+        out.seekp(header.file_size - 1);
+        out.put(0);
+        if (!out) throw std::runtime_error("BrickCache: unable to write " + tmp.string());
+        out.close();
+        fs::rename(tmp, path);
+    } catch (...) {
+        std::error_code ec;
+        fs::remove(tmp, ec);
+        throw;
+    }
+}
+
+std::shared_ptr<HostBrickGrid> BrickCache::get_or_convert(const voldata::Volume::GridPtr& grid) {
+    const std::string k = enabled ? key(grid) : "";
+    if (!k.empty()) {
+        if (auto cached = load(k)) return cached;
+    }
+    auto bricks = std::make_shared<HostBrickGrid>(voldata::Volume::to_brick_grid(grid));
+    if (!k.empty()) {
+        try {
+            bricks->encode_atlas_bc4(); // cache entries include the encoded atlas
+            store(k, *bricks);
+        } catch (std::exception& e) {
+            std::cerr << "Unable to store brick grid in cache: " << e.what() << std::endl;
+        }
+    }
+    return bricks;
+}
+
+std::string BrickCache::file_key(const std::string& path) {
+    std::error_code ec;
+    const fs::path canonical = fs::canonical(path, ec);
+    if (ec) return "";
+    const auto mtime = fs::last_write_time(canonical, ec);
+    if (ec) return "";
+    return canonical.string() + "|" + std::to_string(mtime.time_since_epoch().count());
+}
+
+std::string BrickCache::file_path(const std::string& key, const std::string& extension) {
+    return cache_file(key, extension).string();
+}
+
+void BrickCache::evict(size_t reserve_bytes) {
+    std::lock_guard<std::mutex> lock(directory_mutex);
+    evict_locked(reserve_bytes);
+}
+
+void BrickCache::evict_locked(size_t reserve_bytes) {
+    std::error_code ec;
+    if (!fs::is_directory(directory, ec)) return;
+    std::vector<std::tuple<fs::file_time_type, size_t, fs::path>> entries;
+    size_t total = 0;
+    const auto now = fs::file_time_type::clock::now();
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        if (!entry.is_regular_file(ec)) continue;
+        const size_t size = entry.file_size(ec);
+        const fs::file_time_type time = entry.last_write_time(ec);
+        // temporary files (<entry>.tmp<pid>...): remove stale ones, count those still being written
+        const fs::path stem_ext = entry.path().stem().extension();
+        if (entry.path().extension().string().rfind(".tmp", 0) == 0 && (stem_ext == CACHE_EXTENSION || stem_ext == ENVMAP_EXTENSION)) {
+            if (now - time > STALE_TMP_AGE && fs::remove(entry.path(), ec)) continue;
+            total += size;
+            continue;
+        }
+        if (entry.path().extension() != CACHE_EXTENSION && entry.path().extension() != ENVMAP_EXTENSION) continue;
+        entries.emplace_back(time, size, entry.path());
+        total += size;
+    }
+    // oldest first
+    std::sort(entries.begin(), entries.end());
+    for (const auto& [time, size, path] : entries) {
+        if (total + reserve_bytes <= max_bytes) break;
+        if (fs::remove(path, ec)) total -= size;
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <voldata.h>
+
+#include "brick_lookup.h"
+
+// --------------------------------------------------------------
+// on-disk cache of converted brick grids
+// one versioned file per grid with page aligned sections (indirection, range, range mipmaps, atlas, BC4 encoded atlas),
+// keyed by source path, modification time, grid name and brick parameters.
+// cache hits are memory mapped, so the data can be uploaded or used without an intermediate copy.
+// the directory and size limit are shared with the envmap cache (see EnvironmentCache).
+
+struct BrickCache {
+    // settings
+    static bool enabled;
+    static std::string directory;       // default: $VOLREN_CACHE_DIR, $XDG_CACHE_HOME/volren or ~/.cache/volren
+    static size_t max_bytes;            // size limit, least recently used entries are evicted
+
+    // remember where a grid was loaded from, so converted brick grids can be cached
+    static void register_source(const voldata::Volume::GridPtr& grid, const std::string& path, const std::string& gridname);
+
+    // cache key for a grid, empty if its source is unknown
+    static std::string key(const voldata::Volume::GridPtr& grid);
+
+    // memory map cached brick grid, nullptr on cache miss
+    static std::shared_ptr<HostBrickGrid> load(const std::string& key);
+
+    // write brick grid with BC4 encoded atlas to cache (evicts old entries if necessary)
+    static void store(const std::string& key, const HostBrickGrid& bricks);
+
+    // brick grid from cache, or convert and store
+    static std::shared_ptr<HostBrickGrid> get_or_convert(const voldata::Volume::GridPtr& grid);
+
+    // key of a source file (canonical path and modification time), empty if it does not exist
+    static std::string file_key(const std::string& path);
+
+    // cache file for a key
+    static std::string file_path(const std::string& key, const std::string& extension);
+
+    // remove least recently used entries until the cache holds at most max_bytes - reserve_bytes,
+    // unfinished temporary files count towards the limit and are removed once stale
+    static void evict(size_t reserve_bytes = 0);
+
+private:
+    static void evict_locked(size_t reserve_bytes);
+};
@@ -0,0 +1,216 @@
+#include "brick_lookup.h"
+#include <limits>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+// -----------------------------------------------------------
+// occupied bounds
+
+template <typename F> static std::pair<glm::vec3, glm::vec3> occupied_bounds(const int32_t* stride, const F& occupied) {
+    glm::ivec3 lo = glm::ivec3(std::numeric_limits<int32_t>::max()), hi = glm::ivec3(-1);
+    for (int z = 0; z < stride[2]; ++z) {
+        for (int y = 0; y < stride[1]; ++y) {
+            const size_t row = (size_t(z) * stride[1] + y) * stride[0];
+            int first = -1, last = -1;
+            for (int x = 0; x < stride[0]; ++x) {
+                if (!occupied(row + x)) continue;
+                if (first < 0) first = x;
+                last = x;
+            }
+            if (first < 0) continue;
+            lo = glm::min(lo, glm::ivec3(first, y, z));
+            hi = glm::max(hi, glm::ivec3(last, y, z));
+        }
+    }
+    if (hi.x < 0) return { glm::vec3(1), glm::vec3(0) };
+    return { glm::vec3(lo * 8), glm::vec3((hi + 1) * 8) };
+}
+
+std::pair<glm::vec3, glm::vec3> brick_occupied_bounds(const BrickGridView& grid) {
+    // max. is the upper half of the packed RG16F range, test for positive non-zero halfs
+    const uint32_t* range = grid.range[0];
+    return occupied_bounds(grid.range_stride[0], [&](size_t i) { const uint32_t h = range[i] >> 16; return h != 0 && h < 0x8000; });
+}
+
+std::pair<glm::vec3, glm::vec3> brick_occupied_bounds(const float* values, const int32_t* stride) {
+    return occupied_bounds(stride, [&](size_t i) { return values[i] > 0.f; });
+}
+
+// -----------------------------------------------------------
+// HostBrickGrid
+
+HostBrickGrid::HostBrickGrid(const std::shared_ptr<voldata::BrickGrid>& grid) : transform(grid->transform), storage(grid) {
+    if (grid->range_mipmaps.size() + 1 > size_t(BrickGridView::MAX_LEVELS))
+        throw std::runtime_error("HostBrickGrid: too many range mip levels!");
+    const auto stride = [](int32_t* dst, const glm::uvec3& src) { dst[0] = src.x; dst[1] = src.y; dst[2] = src.z; };
+    view.indirection = grid->indirection.data.data();
+    stride(view.indirection_stride, grid->indirection.stride);
+    view.n_range_levels = int32_t(grid->range_mipmaps.size() + 1);
+    for (int i = 0; i < view.n_range_levels; ++i) {
+        const voldata::Buf3D<uint32_t>& buf = i == 0 ? grid->range : grid->range_mipmaps[i - 1];
+        view.range[i] = buf.data.data();
+        stride(view.range_stride[i], buf.stride);
+    }
+    view.atlas = grid->atlas.data.data();
+    stride(view.atlas_stride, grid->atlas.stride);
+    view.scale = 1.f;
+    occupied = brick_occupied_bounds(view);
+}
+
+HostBrickGrid::HostBrickGrid(const BrickGridView& view, const glm::mat4& transform, const std::shared_ptr<const void>& storage) : view(view), transform(transform), storage(storage) {
+    occupied = brick_occupied_bounds(view);
+}
+
+static size_t texels(const int32_t* stride) { return size_t(stride[0]) * stride[1] * stride[2]; }
+
+size_t HostBrickGrid::indirection_size() const { return texels(view.indirection_stride); }
+
+size_t HostBrickGrid::range_size(int mip) const { return texels(view.range_stride[mip]); }
+
+size_t HostBrickGrid::atlas_size(int level) const {
+    return size_t(view.atlas_stride[0] >> level) * (view.atlas_stride[1] >> level) * (view.atlas_stride[2] >> level);
+}
+
+size_t HostBrickGrid::size_bytes() const {
+    size_t bytes = indirection_size() * sizeof(uint32_t) + atlas_size();
+    for (size_t i = 0; i < atlas_levels.size(); ++i)
+        bytes += atlas_size(int(i + 1));
+    if (atlas_bc4)
+        bytes += atlas_size() / 2;
+    for (int i = 0; i < view.n_range_levels; ++i)
+        bytes += range_size(i) * sizeof(uint32_t);
+    return bytes;
+}
+
+size_t HostBrickGrid::texture_bytes() const {
+    return size_bytes() - (atlas_bc4 ? atlas_size() : 0); // uncompressed atlas stays on the host
+}
+
+void HostBrickGrid::encode_atlas_bc4() {
+    if (atlas_bc4) return;
+    // atlas width and height are multiples of the brick size, so each 4x4 block lies within a brick
+    BC4Stats stats;
+    auto blocks = std::make_shared<std::vector<uint8_t>>(bc4_encode(view.atlas, view.atlas_stride[0], view.atlas_stride[1], view.atlas_stride[2], stats));
+    atlas_bc4 = blocks->data();
+    atlas_bc4_storage = blocks;
+    atlas_bc4_stats = stats;
+}
+
+void HostBrickGrid::build_atlas_levels(int n_levels) {
+    if (int(atlas_levels.size()) < n_levels)
+        atlas_levels = brick_atlas_levels(view, n_levels);
+}
+
+// -----------------------------------------------------------
+// atlas levels
+
+std::vector<std::vector<uint8_t>> brick_atlas_levels(const BrickGridView& grid, int n_levels) {
+    n_levels = std::clamp(n_levels, 0, 3);
+    std::vector<std::vector<uint8_t>> levels(n_levels);
+    const uint8_t* src = grid.atlas;
+    glm::ivec3 src_size = glm::ivec3(grid.atlas_stride[0], grid.atlas_stride[1], grid.atlas_stride[2]);
+    for (int l = 0; l < n_levels; ++l) {
+        const glm::ivec3 size = src_size / 2;
+        std::vector<uint8_t>& dst = levels[l];
+        dst.resize(size_t(size.x) * size.y * size.z);
+        // slices in parallel, rounded mean of 2x2x2 texels (deterministic, independent of the thread count)
+        const auto downsample = [&](int z_begin, int z_end) {
+            for (int z = z_begin; z < z_end; ++z) {
+                for (int y = 0; y < size.y; ++y) {
+                    const uint8_t* r[4];
+                    for (int i = 0; i < 4; ++i)
+                        r[i] = src + (size_t(2 * z + (i >> 1)) * src_size.y + 2 * y + (i & 1)) * src_size.x;
+                    uint8_t* out = dst.data() + (size_t(z) * size.y + y) * size.x;
+                    for (int x = 0; x < size.x; ++x) {
+                        uint32_t sum = 4;
+                        for (int i = 0; i < 4; ++i)
+                            sum += r[i][2 * x] + r[i][2 * x + 1];
+                        out[x] = uint8_t(sum >> 3);
+                    }
+                }
+            }
+        };
+        const int n_threads = std::max(1, std::min(int(std::thread::hardware_concurrency()), size.z));
+        std::vector<std::thread> threads;
+        for (int i = 0; i < n_threads; ++i)
+            threads.emplace_back(downsample, size.z * i / n_threads, size.z * (i + 1) / n_threads);
+        for (auto& thread : threads)
+            thread.join();
+        src = dst.data();
+        src_size = size;
+    }
+    return levels;
+}
+
+// -----------------------------------------------------------
+// BrickGridLookup
+
+BrickGridLookup::BrickGridLookup(const std::shared_ptr<HostBrickGrid>& grid, float density_scale) : density_scale(density_scale), grid(grid) {
+    if (!grid) throw std::runtime_error("BrickGridLookup: grid must not be null!");
+    isa = best_isa();
+}
+
+BrickGridLookup::ISA BrickGridLookup::best_isa() const {
+    // kernels use 32 bit gather offsets
+    if (grid->atlas_size() > size_t(std::numeric_limits<int32_t>::max())) return SCALAR;
+#if (defined(__x86_64__) || defined(_M_X64)) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) return AVX2;
+#endif
+    return SCALAR;
+}
+
+const char* BrickGridLookup::isa_name(ISA isa) {
+    switch (isa) {
+        case AVX512: return "avx512";
+        case AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+int BrickGridLookup::n_mip_levels() const {
+    return grid->view.n_range_levels;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define BRICK_DISPATCH(name, ...)                                         \
+    BrickGridView v = grid->view;                                         \
+    v.scale = density_scale;                                              \
+    if (isa == AVX512) return brick_##name##_avx512(v, __VA_ARGS__);      \
+    if (isa == AVX2) return brick_##name##_avx2(v, __VA_ARGS__);
+#else
+#define BRICK_DISPATCH(name, ...)
+#endif
+
+void BrickGridLookup::density(const float* x, const float* y, const float* z, float* out, size_t N) const {
+    BRICK_DISPATCH(density, x, y, z, out, N);
+    for (size_t i = 0; i < N; ++i)
+        out[i] = density_scale * brick_lookup(grid->view, glm::vec3(x[i], y[i], z[i]));
+}
+
+void BrickGridLookup::density_trilinear(const float* x, const float* y, const float* z, float* out, size_t N) const {
+    BRICK_DISPATCH(density_trilinear, x, y, z, out, N);
+    for (size_t i = 0; i < N; ++i)
+        out[i] = density_scale * brick_lookup_trilinear(grid->view, glm::vec3(x[i], y[i], z[i]));
+}
+
+void BrickGridLookup::density_stochastic(const float* x, const float* y, const float* z, uint32_t* seeds, float* out, size_t N) const {
+    BRICK_DISPATCH(density_stochastic, x, y, z, seeds, out, N);
+    for (size_t i = 0; i < N; ++i)
+        out[i] = density_scale * brick_lookup(grid->view, glm::vec3(stochastic_tricubic_filter(glm::vec3(x[i], y[i], z[i]), seeds[i])));
+}
+
+void BrickGridLookup::majorant(const float* x, const float* y, const float* z, int mip, float* out, size_t N) const {
+    BRICK_DISPATCH(majorant, x, y, z, mip, out, N);
+    for (size_t i = 0; i < N; ++i)
+        out[i] = density_scale * brick_majorant(grid->view, glm::vec3(x[i], y[i], z[i]), mip);
+}
+
+void BrickGridLookup::majorants(const float* x, const float* y, const float* z, float* out, size_t N) const {
+    for (int mip = 0; mip < n_mip_levels(); ++mip)
+        majorant(x, y, z, mip, out + mip * N, N);
+}
+
+#undef BRICK_DISPATCH
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <voldata.h>
+
+#include "brick_lookup_kernels.h"
+#include "bc4.h"
+
+// --------------------------------------------------------------
+// scalar reference of the brick grid lookups in shader/common.glsl
+// (input positions in index space, out of bounds fetches return zero, as robust texelFetch)
+
+inline float mix_ref(float x, float y, float a) { return x * (1.f - a) + y * a; } // GLSL mix()
+
+// random number generation helpers
+
+inline uint32_t tea(uint32_t val0, uint32_t val1, uint32_t N) { // tiny encryption algorithm (TEA) to calculate a seed per launch index and iteration
+    uint32_t v0 = val0, v1 = val1, s0 = 0;
+    for (uint32_t n = 0; n < N; ++n) {
+        s0 += 0x9e3779b9;
+        v0 += ((v1 << 4) + 0xA341316C) ^ (v1 + s0) ^ ((v1 >> 5) + 0xC8013EA4);
+        v1 += ((v0 << 4) + 0xAD90777D) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7E95761E);
+    }
+    return v0;
+}
+
+inline float rng(uint32_t& previous) { // return a random sample in the range [0, 1) with a simple linear congruential generator
+    previous = previous * 1664525u + 1013904223u;
+    return float(previous & 0x00FFFFFFu) / float(0x01000000u);
+}
+
+// evaluation order of function arguments is unspecified in C++, so draw samples one by one
+inline glm::vec2 rng2(uint32_t& previous) { const float x = rng(previous); return glm::vec2(x, rng(previous)); }
+inline glm::vec3 rng3(uint32_t& previous) { const glm::vec2 xy = rng2(previous); return glm::vec3(xy, rng(previous)); }
+
+// stochastic filter
+
+inline glm::ivec3 stochastic_tricubic_filter(const glm::vec3& ipos, uint32_t& seed) {
+    // from "Stochastic Texture Filtering": https://arxiv.org/pdf/2305.05810.pdf
+    const glm::ivec3 iipos = glm::ivec3(glm::floor(ipos - 0.5f));
+    const glm::vec3 t = (ipos - 0.5f) - glm::vec3(iipos);
+    const glm::vec3 t2 = t * t;
+    // weighted reservoir sampling, first tap always accepted
+    glm::vec3 w = (1.f / 6.f) * (-t * t2 + 3.f * t2 - 3.f * t + 1.f);
+    glm::vec3 sumWt = w;
+    glm::ivec3 idx = glm::ivec3(0);
+    const auto select = [&](int tap) {
+        sumWt = w + sumWt;
+        const glm::vec3 p = w / glm::max(glm::vec3(1e-3f), sumWt);
+        for (int i = 0; i < 3; ++i)
+            if (rng(seed) < p[i]) idx[i] = tap;
+    };
+    // sample second tap
+    w = (1.f / 6.f) * (3.f * t * t2 - 6.f * t2 + 4.f);
+    select(1);
+    // sample third tap
+    w = (1.f / 6.f) * (-3.f * t * t2 + 3.f * t2 + 3.f * t + 1.f);
+    select(2);
+    // sample fourth tap
+    w = (1.f / 6.f) * t * t2;
+    select(3);
+    // return tap location
+    return iipos + idx - 1;
+}
+
+// brick grid texel fetches
+
+inline bool brick_fetch_index(const glm::ivec3& p, const int32_t* stride, size_t& index) {
+    if (p.x < 0 || p.y < 0 || p.z < 0 || p.x >= stride[0] || p.y >= stride[1] || p.z >= stride[2]) return false;
+    index = (size_t(p.z) * stride[1] + p.y) * stride[0] + p.x;
+    return true;
+}
+
+// indirection: GL_RGB10_A2UI with GL_UNSIGNED_INT_10_10_10_2 layout
+inline glm::ivec3 brick_fetch_indirection(const BrickGridView& grid, const glm::ivec3& brick) {
+    size_t i;
+    if (!brick_fetch_index(brick, grid.indirection_stride, i)) return glm::ivec3(0);
+    const uint32_t v = grid.indirection[i];
+    return glm::ivec3((v >> 22) & 0x3FF, (v >> 12) & 0x3FF, (v >> 2) & 0x3FF);
+}
+
+// range: GL_RG16F with min/max mipmaps
+inline glm::vec2 brick_fetch_range(const BrickGridView& grid, const glm::ivec3& brick, int mip) {
+    if (mip >= grid.n_range_levels) return glm::vec2(0);
+    size_t i;
+    if (!brick_fetch_index(brick, grid.range_stride[mip], i)) return glm::vec2(0);
+    return glm::unpackHalf2x16(grid.range[mip][i]);
+}
+
+// atlas: normalized 8 bit
+inline float brick_fetch_atlas(const BrickGridView& grid, const glm::ivec3& p) {
+    size_t i;
+    if (!brick_fetch_index(p, grid.atlas_stride, i)) return 0.f;
+    return grid.atlas[i] / 255.f;
+}
+
+// brick grid voxel lookup (nearest neighbor), lookup_density_brick()
+inline float brick_lookup(const BrickGridView& grid, const glm::vec3& ipos) {
+    const glm::ivec3 iipos = glm::ivec3(glm::floor(ipos));
+    const glm::ivec3 brick = iipos >> 3;
+    const glm::ivec3 ptr = brick_fetch_indirection(grid, brick);
+    const glm::vec2 range = brick_fetch_range(grid, brick, 0);
+    const float value_unorm = brick_fetch_atlas(grid, (ptr << 3) + (iipos & 7));
+    return range.x + value_unorm * (range.y - range.x);
+}
+
+// brick grid voxel lookup (trilinear filter), without density scale
+inline float brick_lookup_trilinear(const BrickGridView& grid, const glm::vec3& ipos) {
+    const glm::vec3 f = glm::fract(ipos - 0.5f);
+    const glm::vec3 iipos = glm::floor(ipos - 0.5f);
+    const auto l = [&](float x, float y, float z) { return brick_lookup(grid, iipos + glm::vec3(x, y, z)); };
+    const float lx0 = mix_ref(l(0, 0, 0), l(1, 0, 0), f.x);
+    const float lx1 = mix_ref(l(0, 1, 0), l(1, 1, 0), f.x);
+    const float hx0 = mix_ref(l(0, 0, 1), l(1, 0, 1), f.x);
+    const float hx1 = mix_ref(l(0, 1, 1), l(1, 1, 1), f.x);
+    return mix_ref(mix_ref(lx0, lx1, f.y), mix_ref(hx0, hx1, f.y), f.z);
+}
+
+// brick majorant lookup (nearest neighbor), without density scale
+inline float brick_majorant(const BrickGridView& grid, const glm::vec3& ipos, int mip) {
+    const glm::ivec3 brick = glm::ivec3(glm::floor(ipos)) >> (3 + mip);
+    return brick_fetch_range(grid, brick, mip).y;
+}
+
+// index-space bounds of all bricks with a max. value above zero on range level 0, empty (min > max) if there are none
+std::pair<glm::vec3, glm::vec3> brick_occupied_bounds(const BrickGridView& grid);
+// same for per-brick values in the layout of range level 0 (e.g. transfer function majorants)
+std::pair<glm::vec3, glm::vec3> brick_occupied_bounds(const float* values, const int32_t* stride);
+
+// --------------------------------------------------------------
+// host brick grid data, either owned by a converted voldata::BrickGrid or memory mapped from the brick cache
+
+struct HostBrickGrid {
+    HostBrickGrid(const std::shared_ptr<voldata::BrickGrid>& grid);
+    HostBrickGrid(const BrickGridView& view, const glm::mat4& transform, const std::shared_ptr<const void>& storage);
+
+    size_t indirection_size() const;    // in texels
+    size_t range_size(int mip) const;   // in texels
+    size_t atlas_size(int level = 0) const;     // in bytes
+    size_t size_bytes() const;          // total size of all host data
+    size_t texture_bytes() const;       // total size of all textures (with the BC4 atlas, if encoded)
+
+    // build n coarser atlas levels for level of detail (no-op if already built), see brick_atlas_levels()
+    void build_atlas_levels(int n_levels);
+    // BC4 encode the atlas (no-op if already encoded, e.g. loaded from the brick cache)
+    void encode_atlas_bc4();
+
+    // data
+    BrickGridView view;
+    glm::mat4 transform;
+    std::shared_ptr<const void> storage;    // keeps the data referenced by view alive
+    std::pair<glm::vec3, glm::vec3> occupied;   // brick_occupied_bounds() of the grid
+    std::vector<std::vector<uint8_t>> atlas_levels; // coarser atlas levels 1.. (empty: none built)
+    const uint8_t* atlas_bc4 = nullptr; // BC4 encoded atlas in 2D array texture layout (one layer per slice), nullptr: not encoded
+    std::shared_ptr<const void> atlas_bc4_storage;  // keeps atlas_bc4 alive, unless it points into storage
+    BC4Stats atlas_bc4_stats;           // encoding error of atlas_bc4
+};
+
+// coarser levels 1..n of a brick atlas, each the 2x2x2 box filtered previous level: bricks are 8-aligned in the atlas,
+// so the levels stay within bricks and share the value range of level 0 (level 3 holds the mean of each brick)
+std::vector<std::vector<uint8_t>> brick_atlas_levels(const BrickGridView& grid, int n_levels);
+
+// --------------------------------------------------------------
+// batched brick grid lookups for N index-space positions (SoA layout),
+// dispatched at runtime to AVX-512, AVX2 or the scalar reference
+
+class BrickGridLookup {
+public:
+    enum ISA { SCALAR, AVX2, AVX512 };
+
+    BrickGridLookup(const std::shared_ptr<HostBrickGrid>& grid, float density_scale = 1.f);
+
+    // best instruction set supported by this machine (and grid)
+    ISA best_isa() const;
+    static const char* isa_name(ISA isa);
+
+    // density (nearest neighbor), lookup_density()
+    void density(const float* x, const float* y, const float* z, float* out, size_t N) const;
+    // density (trilinear filter), lookup_density_trilinear()
+    void density_trilinear(const float* x, const float* y, const float* z, float* out, size_t N) const;
+    // density (stochastic tricubic filter), lookup_density_stochastic(), advances the per-position seeds
+    void density_stochastic(const float* x, const float* y, const float* z, uint32_t* seeds, float* out, size_t N) const;
+    // majorant on given mip level, lookup_majorant()
+    void majorant(const float* x, const float* y, const float* z, int mip, float* out, size_t N) const;
+    // majorants on all mip levels, out[mip * N + i]
+    void majorants(const float* x, const float* y, const float* z, float* out, size_t N) const;
+    // number of range mip levels (including level 0)
+    int n_mip_levels() const;
+
+    // data
+    ISA isa;
+    float density_scale;
+    std::shared_ptr<HostBrickGrid> grid;
+};
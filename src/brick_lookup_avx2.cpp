@@ -0,0 +1,83 @@
+// AVX2 + F16C brick grid lookup kernels (compiled with -mavx2 -mf16c -ffp-contract=off, see CMakeLists.txt)
+#include "brick_lookup_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+
+namespace {
+
+struct AVX2 {
+    static const int W = 8;
+    using F = __m256;
+    using I = __m256i;
+    using M = __m256i;
+
+    static inline F loadf(const float* p) { return _mm256_loadu_ps(p); }
+    static inline void storef(float* p, F v) { _mm256_storeu_ps(p, v); }
+    static inline I loadi(const uint32_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+    static inline void storei(uint32_t* p, I v) { _mm256_storeu_si256((__m256i*)p, v); }
+
+    static inline F set1f(float v) { return _mm256_set1_ps(v); }
+    static inline F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static inline F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static inline F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static inline F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static inline F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static inline F neg(F a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.f)); }
+    static inline F floor(F a) { return _mm256_floor_ps(a); }
+    static inline I cvti(F a) { return _mm256_cvttps_epi32(a); }
+    static inline F cvtf(I a) { return _mm256_cvtepi32_ps(a); }
+
+    static inline I set1i(int32_t v) { return _mm256_set1_epi32(v); }
+    static inline I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+    static inline I subi(I a, I b) { return _mm256_sub_epi32(a, b); }
+    static inline I mullo(I a, I b) { return _mm256_mullo_epi32(a, b); }
+    static inline I andi(I a, I b) { return _mm256_and_si256(a, b); }
+    static inline I srai(I a, int n) { return _mm256_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+    static inline I srli(I a, int n) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+    static inline I slli(I a, int n) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+    static inline I srlv(I a, I n) { return _mm256_srlv_epi32(a, n); }
+
+    static inline M cmplt(F a, F b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+    static inline M inside(I v, int32_t n) { // 0 <= v < n
+        return _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), v), _mm256_cmpgt_epi32(_mm256_set1_epi32(n), v));
+    }
+    static inline M mand(M a, M b) { return _mm256_and_si256(a, b); }
+    static inline I select(M m, I a, I b) { return _mm256_blendv_epi8(a, b, m); }
+
+    // masked gathers, inactive lanes are zero
+    static inline I gather(const uint32_t* base, I idx, M m) {
+        return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)base, idx, m, 4);
+    }
+    static inline I gather_bytes(const uint8_t* base, I idx, M m) {
+        return _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)base, idx, m, 1);
+    }
+
+    // convert halfs stored in the lower 16 bits of each lane
+    static inline F half_to_float(I h) {
+        const I packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(h, _mm256_setzero_si256()), 0x08);
+        return _mm256_cvtph_ps(_mm256_castsi256_si128(packed));
+    }
+};
+
+#include "brick_lookup_simd.inl"
+
+} // namespace
+
+void brick_density_avx2(const BrickGridView& view, const float* x, const float* y, const float* z, float* out, size_t N) {
+    BrickKernels<AVX2>::density(view, x, y, z, out, N);
+}
+
+void brick_density_trilinear_avx2(const BrickGridView& view, const float* x, const float* y, const float* z, float* out, size_t N) {
+    BrickKernels<AVX2>::density_trilinear(view, x, y, z, out, N);
+}
+
+void brick_density_stochastic_avx2(const BrickGridView& view, const float* x, const float* y, const float* z, uint32_t* seeds, float* out, size_t N) {
+    BrickKernels<AVX2>::density_stochastic(view, x, y, z, seeds, out, N);
+}
+
+void brick_majorant_avx2(const BrickGridView& view, const float* x, const float* y, const float* z, int mip, float* out, size_t N) {
+    BrickKernels<AVX2>::majorant(view, x, y, z, mip, out, N);
+}
+
+#endif
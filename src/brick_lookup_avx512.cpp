@@ -0,0 +1,78 @@
+// AVX-512F brick grid lookup kernels (compiled with -mavx512f -ffp-contract=off, see CMakeLists.txt)
+#include "brick_lookup_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+
+namespace {
+
+struct AVX512 {
+    static const int W = 16;
+    using F = __m512;
+    using I = __m512i;
+    using M = __mmask16;
+
+    static inline F loadf(const float* p) { return _mm512_loadu_ps(p); }
+    static inline void storef(float* p, F v) { _mm512_storeu_ps(p, v); }
+    static inline I loadi(const uint32_t* p) { return _mm512_loadu_si512(p); }
+    static inline void storei(uint32_t* p, I v) { _mm512_storeu_si512(p, v); }
+
+    static inline F set1f(float v) { return _mm512_set1_ps(v); }
+    static inline F add(F a, F b) { return _mm512_add_ps(a, b); }
+    static inline F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+    static inline F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+    static inline F div(F a, F b) { return _mm512_div_ps(a, b); }
+    static inline F max(F a, F b) { return _mm512_max_ps(a, b); }
+    static inline F neg(F a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x80000000))); }
+    static inline F floor(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    static inline I cvti(F a) { return _mm512_cvttps_epi32(a); }
+    static inline F cvtf(I a) { return _mm512_cvtepi32_ps(a); }
+
+    static inline I set1i(int32_t v) { return _mm512_set1_epi32(v); }
+    static inline I addi(I a, I b) { return _mm512_add_epi32(a, b); }
+    static inline I subi(I a, I b) { return _mm512_sub_epi32(a, b); }
+    static inline I mullo(I a, I b) { return _mm512_mullo_epi32(a, b); }
+    static inline I andi(I a, I b) { return _mm512_and_si512(a, b); }
+    static inline I srai(I a, int n) { return _mm512_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+    static inline I srli(I a, int n) { return _mm512_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+    static inline I slli(I a, int n) { return _mm512_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+    static inline I srlv(I a, I n) { return _mm512_srlv_epi32(a, n); }
+
+    static inline M cmplt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static inline M inside(I v, int32_t n) { return _mm512_cmplt_epu32_mask(v, _mm512_set1_epi32(n)); } // 0 <= v < n
+    static inline M mand(M a, M b) { return a & b; }
+    static inline I select(M m, I a, I b) { return _mm512_mask_blend_epi32(m, a, b); }
+
+    // masked gathers, inactive lanes are zero
+    static inline I gather(const uint32_t* base, I idx, M m) {
+        return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, base, 4);
+    }
+    static inline I gather_bytes(const uint8_t* base, I idx, M m) {
+        return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, base, 1);
+    }
+
+    // convert halfs stored in the lower 16 bits of each lane
+    static inline F half_to_float(I h) { return _mm512_cvtph_ps(_mm512_cvtepi32_epi16(h)); }
+};
+
+#include "brick_lookup_simd.inl"
+
+} // namespace
+
+void brick_density_avx512(const BrickGridView& view, const float* x, const float* y, const float* z, float* out, size_t N) {
+    BrickKernels<AVX512>::density(view, x, y, z, out, N);
+}
+
+void brick_density_trilinear_avx512(const BrickGridView& view, const float* x, const float* y, const float* z, float* out, size_t N) {
+    BrickKernels<AVX512>::density_trilinear(view, x, y, z, out, N);
+}
+
+void brick_density_stochastic_avx512(const BrickGridView& view, const float* x, const float* y, const float* z, uint32_t* seeds, float* out, size_t N) {
+    BrickKernels<AVX512>::density_stochastic(view, x, y, z, seeds, out, N);
+}
+
+void brick_majorant_avx512(const BrickGridView& view, const float* x, const float* y, const float* z, int mip, float* out, size_t N) {
+    BrickKernels<AVX512>::majorant(view, x, y, z, mip, out, N);
+}
+
+#endif
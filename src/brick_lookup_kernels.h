@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// raw view of a voldata::BrickGrid for the SIMD kernels
+// (kernel translation units are compiled with ISA specific flags and must not instantiate shared inline code, so no glm/voldata here)
+struct BrickGridView {
+    static const int MAX_LEVELS = 16;
+    const uint32_t* indirection;
+    int32_t indirection_stride[3];
+    const uint32_t* range[MAX_LEVELS];          // level 0: range, level i > 0: range_mipmaps[i-1]
+    int32_t range_stride[MAX_LEVELS][3];
+    int32_t n_range_levels;
+    const uint8_t* atlas;
+    int32_t atlas_stride[3];
+    float scale;                                // density scale
+};
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+// AVX2 + F16C kernels (8 lanes), see brick_lookup_avx2.cpp
+void brick_density_avx2(const BrickGridView& view, const float* x, const float* y, const float* z, float* out, size_t N);
+void brick_density_trilinear_avx2(const BrickGridView& view, const float* x, const float* y, const float* z, float* out, size_t N);
+void brick_density_stochastic_avx2(const BrickGridView& view, const float* x, const float* y, const float* z, uint32_t* seeds, float* out, size_t N);
+void brick_majorant_avx2(const BrickGridView& view, const float* x, const float* y, const float* z, int mip, float* out, size_t N);
+
+// AVX-512F kernels (16 lanes), see brick_lookup_avx512.cpp
+void brick_density_avx512(const BrickGridView& view, const float* x, const float* y, const float* z, float* out, size_t N);
+void brick_density_trilinear_avx512(const BrickGridView& view, const float* x, const float* y, const float* z, float* out, size_t N);
+void brick_density_stochastic_avx512(const BrickGridView& view, const float* x, const float* y, const float* z, uint32_t* seeds, float* out, size_t N);
+void brick_majorant_avx512(const BrickGridView& view, const float* x, const float* y, const float* z, int mip, float* out, size_t N);
+
+#endif
@@ -0,0 +1,158 @@
+// SIMD brick grid lookup kernels, shared between ISAs.
+// Included by brick_lookup_avx2.cpp and brick_lookup_avx512.cpp, which define the vector traits V.
+// Every operation mirrors the scalar reference in brick_lookup.h one to one (same operations in the same order,
+// no fused multiply-add), so that results are bit-identical.
+
+template <typename V> struct BrickKernels {
+    using F = typename V::F;
+    using I = typename V::I;
+    using M = typename V::M;
+
+    static inline M in_bounds(I x, I y, I z, const int32_t* stride) {
+        return V::mand(V::mand(V::inside(x, stride[0]), V::inside(y, stride[1])), V::inside(z, stride[2]));
+    }
+
+    static inline I linear(I x, I y, I z, const int32_t* stride) {
+        return V::addi(V::mullo(V::addi(V::mullo(z, V::set1i(stride[1])), y), V::set1i(stride[0])), x);
+    }
+
+    static inline F mix(F a, F b, F f) {
+        return V::add(V::mul(a, V::sub(V::set1f(1.f), f)), V::mul(b, f));
+    }
+
+    static inline F rng(I& seed) {
+        seed = V::addi(V::mullo(seed, V::set1i(1664525)), V::set1i(1013904223));
+        return V::div(V::cvtf(V::andi(seed, V::set1i(0x00FFFFFF))), V::set1f(float(0x01000000u)));
+    }
+
+    // brick grid voxel lookup at integer voxel coordinates (lookup_density_brick)
+    static inline F voxel(const BrickGridView& g, I ix, I iy, I iz) {
+        const I bx = V::srai(ix, 3), by = V::srai(iy, 3), bz = V::srai(iz, 3);
+        // indirection
+        const I ind = V::gather(g.indirection, linear(bx, by, bz, g.indirection_stride), in_bounds(bx, by, bz, g.indirection_stride));
+        const I mask10 = V::set1i(0x3FF), mask3 = V::set1i(7);
+        const I ax = V::addi(V::slli(V::andi(V::srli(ind, 22), mask10), 3), V::andi(ix, mask3));
+        const I ay = V::addi(V::slli(V::andi(V::srli(ind, 12), mask10), 3), V::andi(iy, mask3));
+        const I az = V::addi(V::slli(V::andi(V::srli(ind, 2), mask10), 3), V::andi(iz, mask3));
+        // range
+        const I range = V::gather(g.range[0], linear(bx, by, bz, g.range_stride[0]), in_bounds(bx, by, bz, g.range_stride[0]));
+        const F rmin = V::half_to_float(V::andi(range, V::set1i(0xFFFF)));
+        const F rmax = V::half_to_float(V::srli(range, 16));
+        // atlas (aligned 32 bit gather, then extract byte)
+        const I aidx = linear(ax, ay, az, g.atlas_stride);
+        const I word = V::gather_bytes(g.atlas, V::andi(aidx, V::set1i(~3)), in_bounds(ax, ay, az, g.atlas_stride));
+        const I byte = V::andi(V::srlv(word, V::slli(V::andi(aidx, V::set1i(3)), 3)), V::set1i(0xFF));
+        const F value_unorm = V::div(V::cvtf(byte), V::set1f(255.f));
+        return V::add(rmin, V::mul(value_unorm, V::sub(rmax, rmin)));
+    }
+
+    static inline F density(const BrickGridView& g, F x, F y, F z) {
+        const I ix = V::cvti(V::floor(x)), iy = V::cvti(V::floor(y)), iz = V::cvti(V::floor(z));
+        return V::mul(V::set1f(g.scale), voxel(g, ix, iy, iz));
+    }
+
+    static inline F density_trilinear(const BrickGridView& g, F x, F y, F z) {
+        const F half = V::set1f(.5f);
+        const F xs = V::sub(x, half), ys = V::sub(y, half), zs = V::sub(z, half);
+        const F fx = V::sub(xs, V::floor(xs)), fy = V::sub(ys, V::floor(ys)), fz = V::sub(zs, V::floor(zs));
+        const I bx = V::cvti(V::floor(xs)), by = V::cvti(V::floor(ys)), bz = V::cvti(V::floor(zs));
+        const I one = V::set1i(1);
+        const I bx1 = V::addi(bx, one), by1 = V::addi(by, one), bz1 = V::addi(bz, one);
+        const F lx0 = mix(voxel(g, bx, by, bz), voxel(g, bx1, by, bz), fx);
+        const F lx1 = mix(voxel(g, bx, by1, bz), voxel(g, bx1, by1, bz), fx);
+        const F hx0 = mix(voxel(g, bx, by, bz1), voxel(g, bx1, by, bz1), fx);
+        const F hx1 = mix(voxel(g, bx, by1, bz1), voxel(g, bx1, by1, bz1), fx);
+        return V::mul(V::set1f(g.scale), mix(mix(lx0, lx1, fy), mix(hx0, hx1, fy), fz));
+    }
+
+    static inline F density_stochastic(const BrickGridView& g, F x, F y, F z, I& seed) {
+        const F half = V::set1f(.5f), three = V::set1f(3.f), sixth = V::set1f(1.f / 6.f);
+        const F pos[3] = { V::sub(x, half), V::sub(y, half), V::sub(z, half) };
+        I base[3], idx[3];
+        F t[3], t2[3], w[3], sumWt[3];
+        for (int i = 0; i < 3; ++i) {
+            base[i] = V::cvti(V::floor(pos[i]));
+            t[i] = V::sub(pos[i], V::cvtf(base[i]));
+            t2[i] = V::mul(t[i], t[i]);
+            // first tap always accepted
+            w[i] = V::mul(sixth, V::add(V::sub(V::add(V::mul(V::neg(t[i]), t2[i]), V::mul(three, t2[i])), V::mul(three, t[i])), V::set1f(1.f)));
+            sumWt[i] = w[i];
+            idx[i] = V::set1i(0);
+        }
+        const auto select = [&](int tap) {
+            for (int i = 0; i < 3; ++i) {
+                sumWt[i] = V::add(w[i], sumWt[i]);
+                const F p = V::div(w[i], V::max(V::set1f(1e-3f), sumWt[i]));
+                idx[i] = V::select(V::cmplt(rng(seed), p), idx[i], V::set1i(tap));
+            }
+        };
+        // second tap
+        for (int i = 0; i < 3; ++i)
+            w[i] = V::mul(sixth, V::add(V::sub(V::mul(V::mul(three, t[i]), t2[i]), V::mul(V::set1f(6.f), t2[i])), V::set1f(4.f)));
+        select(1);
+        // third tap
+        for (int i = 0; i < 3; ++i)
+            w[i] = V::mul(sixth, V::add(V::add(V::add(V::mul(V::mul(V::set1f(-3.f), t[i]), t2[i]), V::mul(three, t2[i])), V::mul(three, t[i])), V::set1f(1.f)));
+        select(2);
+        // fourth tap
+        for (int i = 0; i < 3; ++i)
+            w[i] = V::mul(V::mul(sixth, t[i]), t2[i]);
+        select(3);
+        // lookup at tap location
+        const I one = V::set1i(1);
+        const I tx = V::subi(V::addi(base[0], idx[0]), one);
+        const I ty = V::subi(V::addi(base[1], idx[1]), one);
+        const I tz = V::subi(V::addi(base[2], idx[2]), one);
+        return V::mul(V::set1f(g.scale), voxel(g, tx, ty, tz));
+    }
+
+    static inline F majorant(const BrickGridView& g, F x, F y, F z, int mip) {
+        if (mip >= g.n_range_levels) return V::set1f(0.f);
+        const I bx = V::srai(V::cvti(V::floor(x)), 3 + mip);
+        const I by = V::srai(V::cvti(V::floor(y)), 3 + mip);
+        const I bz = V::srai(V::cvti(V::floor(z)), 3 + mip);
+        const I range = V::gather(g.range[mip], linear(bx, by, bz, g.range_stride[mip]), in_bounds(bx, by, bz, g.range_stride[mip]));
+        return V::mul(V::set1f(g.scale), V::half_to_float(V::srli(range, 16)));
+    }
+
+    // run kernel over N positions, remainder is processed on zero-padded copies
+    template <typename Kernel>
+    static inline void batch(const float* x, const float* y, const float* z, uint32_t* seeds, float* out, size_t N, Kernel kernel) {
+        size_t i = 0;
+        for (; i + V::W <= N; i += V::W) {
+            I seed = seeds ? V::loadi(seeds + i) : V::set1i(0);
+            V::storef(out + i, kernel(V::loadf(x + i), V::loadf(y + i), V::loadf(z + i), seed));
+            if (seeds) V::storei(seeds + i, seed);
+        }
+        if (i == N) return;
+        alignas(64) float px[V::W] = { 0 }, py[V::W] = { 0 }, pz[V::W] = { 0 }, pout[V::W];
+        alignas(64) uint32_t pseeds[V::W] = { 0 };
+        for (size_t j = i; j < N; ++j) {
+            px[j - i] = x[j]; py[j - i] = y[j]; pz[j - i] = z[j];
+            if (seeds) pseeds[j - i] = seeds[j];
+        }
+        I seed = V::loadi(pseeds);
+        V::storef(pout, kernel(V::loadf(px), V::loadf(py), V::loadf(pz), seed));
+        V::storei(pseeds, seed);
+        for (size_t j = i; j < N; ++j) {
+            out[j] = pout[j - i];
+            if (seeds) seeds[j] = pseeds[j - i];
+        }
+    }
+
+    static void density(const BrickGridView& g, const float* x, const float* y, const float* z, float* out, size_t N) {
+        batch(x, y, z, nullptr, out, N, [&](F px, F py, F pz, I&) { return density(g, px, py, pz); });
+    }
+
+    static void density_trilinear(const BrickGridView& g, const float* x, const float* y, const float* z, float* out, size_t N) {
+        batch(x, y, z, nullptr, out, N, [&](F px, F py, F pz, I&) { return density_trilinear(g, px, py, pz); });
+    }
+
+    static void density_stochastic(const BrickGridView& g, const float* x, const float* y, const float* z, uint32_t* seeds, float* out, size_t N) {
+        batch(x, y, z, seeds, out, N, [&](F px, F py, F pz, I& seed) { return density_stochastic(g, px, py, pz, seed); });
+    }
+
+    static void majorant(const BrickGridView& g, const float* x, const float* y, const float* z, int mip, float* out, size_t N) {
+        batch(x, y, z, nullptr, out, N, [&](F px, F py, F pz, I&) { return majorant(g, px, py, pz, mip); });
+    }
+};
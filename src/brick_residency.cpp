@@ -0,0 +1,79 @@
+#include "brick_residency.h"
+
+// -----------------------------------------------------------
+// BrickResidency
+
+BrickResidency::BrickResidency(const UploadFunc& upload) : upload(upload) {}
+
+void BrickResidency::clear() {
+    frames.clear();
+    resident_bytes = 0;
+    resident_frames = 0;
+    clock = 0;
+}
+
+void BrickResidency::add(const BrickFrame& host) {
+    Frame frame;
+    frame.host = host;
+    frame.has_emission = host.emission != nullptr;
+    frame.bytes = host.density->texture_bytes() + (host.emission ? host.emission->texture_bytes() : 0);
+    frames.push_back(frame);
+    // upload right away while within budget, so that startup behaves as before if everything fits
+    if (budget_bytes == 0 || resident_bytes + frame.bytes <= budget_bytes)
+        make_resident(frames.back());
+    // without budget frames are never evicted, so free host memory
+    if (budget_bytes == 0)
+        frames.back().host = BrickFrame();
+}
+
+size_t BrickResidency::size() const {
+    return frames.size();
+}
+
+BrickResidency::Frame& BrickResidency::acquire(size_t i) {
+    Frame& frame = frames.at(i);
+    frame.last_used = ++clock;
+    if (frame.resident) {
+        ++hits;
+        return frame;
+    }
+    ++misses;
+    enforce_budget(frame.bytes);
+    make_resident(frame);
+    return frame;
+}
+
+void BrickResidency::enforce_budget(size_t reserve_bytes) {
+    if (budget_bytes == 0) return;
+    while (resident_bytes + reserve_bytes > budget_bytes) {
+        // find least recently used resident frame
+        Frame* lru = nullptr;
+        for (auto& frame : frames)
+            if (frame.resident && frame.host.density && (!lru || frame.last_used < lru->last_used))
+                lru = &frame;
+        if (!lru) break; // nothing left to evict, a single frame may exceed the budget
+        evict(*lru);
+        ++evictions;
+    }
+}
+
+void BrickResidency::reset_counters() {
+    hits = misses = evictions = 0;
+}
+
+void BrickResidency::make_resident(Frame& frame) {
+    frame.density = upload(*frame.host.density);
+    if (frame.has_emission)
+        frame.emission = upload(*frame.host.emission);
+    frame.resident = true;
+    resident_bytes += frame.bytes;
+    ++resident_frames;
+}
+
+void BrickResidency::evict(Frame& frame) {
+    frame.density = BrickGridGL();
+    frame.emission = BrickGridGL();
+    frame.resident = false;
+    resident_bytes -= frame.bytes;
+    --resident_frames;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cppgl.h>
+
+#include "volume_loader.h"
+
+// OpenGL texture name for texture types without cppgl wrapper, deleted with its last copy
+using TextureGL = std::shared_ptr<const GLuint>;
+
+struct BrickGridGL {
+    cppgl::Texture3D indirection;
+    cppgl::Texture3D range;
+    TextureGL atlas;                    // BC4 compressed 2D array texture, one layer per atlas slice (HostBrickGrid::atlas_bc4)
+    cppgl::Texture3D atlas_lod;         // coarser levels 1.. as mipmaps for level of detail (HostBrickGrid::atlas_levels)
+    glm::mat4 transform;
+    std::vector<glm::ivec3> range_size;     // per range mip level
+    std::pair<glm::vec3, glm::vec3> occupied;   // index-space bounds of bricks with non-zero values (HostBrickGrid::occupied)
+    int atlas_levels = 0;               // coarser atlas levels
+    // max. transfer function opacity per brick and range mip level, built on demand (see RendererOpenGL::update_tf_majorant())
+    cppgl::Texture3D tf_majorant;
+    std::vector<float> tf_majorant_key;     // transfer function state it was built for
+    std::pair<glm::vec3, glm::vec3> tf_occupied;    // index-space bounds of bricks with non-zero opacity
+};
+
+// --------------------------------------------------------------
+// GPU residency of per-frame brick textures
+// with a budget, host copies of all frames are kept and uploaded on demand, evicting the least recently used
+// frames once the byte size of the resident textures would exceed the budget (without, host copies are dropped after upload)
+
+class BrickResidency {
+public:
+    struct Frame {
+        BrickFrame host;            // host copy, empty if evicting is impossible
+        BrickGridGL density;
+        BrickGridGL emission;
+        bool has_emission = false;
+        size_t bytes = 0;
+        bool resident = false;
+        uint64_t last_used = 0;
+    };
+
+    using UploadFunc = std::function<BrickGridGL(const HostBrickGrid&)>;
+
+    BrickResidency(const UploadFunc& upload = UploadFunc());
+
+    // remove all frames
+    void clear();
+    // add host copy of the next frame, it is uploaded right away while within the budget
+    void add(const BrickFrame& frame);
+    // number of frames
+    size_t size() const;
+    // frame i with its textures resident, uploads and evicts as required
+    Frame& acquire(size_t i);
+    // evict frames until the resident bytes fit into the budget
+    void enforce_budget(size_t reserve_bytes = 0);
+    void reset_counters();
+
+    // settings
+    size_t budget_bytes = 0;        // 0: unlimited
+    UploadFunc upload;
+
+    // counters
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t resident_bytes = 0;
+    size_t resident_frames = 0;
+
+private:
+    void make_resident(Frame& frame);
+    void evict(Frame& frame);
+
+    std::vector<Frame> frames;
+    uint64_t clock = 0;
+};
@@ -1,53 +1,497 @@
 #include "environment.h"
+#include "glcontext.h"
+#include "brick_cache.h"
+#include "telemetry.h"
+#include <map>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <glm/gtc/packing.hpp>
 
 using namespace cppgl;
 
-// importance map parameters (power of two!)
-const uint32_t DIMENSION = 512;
-const uint32_t SAMPLES = 64;
+// importance map resolution bounds (power of two!)
+const uint32_t MIN_DIMENSION = 32;
+const uint32_t MAX_DIMENSION = 4096;
+// min. samples per importance texel and axis
+const uint32_t MIN_SAMPLES = 4;
 
-Environment::Environment(const std::string& path) : Environment(Texture2D("environment", path)) {}
+// -----------------------------------------------------------
+// helper funcs
+
+static float luma(const glm::vec3& col) { return glm::dot(col, glm::vec3(0.212671f, 0.715160f, 0.072169f)); }
+
+static glm::vec3 rgbe_to_float(const uint8_t rgbe[4]) {
+    if (rgbe[3] == 0) return glm::vec3(0);
+    const float f = std::ldexp(1.f, int(rgbe[3]) - (128 + 8));
+    return glm::vec3(rgbe[0], rgbe[1], rgbe[2]) * f;
+}
+
+// bilinear lookup with repeat wrap mode (uv in [0, 1])
+static glm::vec3 lookup_bilinear(const std::vector<glm::vec3>& data, const glm::uvec2& size, const glm::vec2& uv) {
+    const glm::vec2 st = uv * glm::vec2(size) - .5f;
+    const glm::ivec2 p = glm::ivec2(glm::floor(st));
+    const glm::vec2 f = st - glm::floor(st);
+    const int w = size.x, h = size.y;
+    const auto texel = [&](int x, int y) {
+        x = ((x % w) + w) % w;
+        y = ((y % h) + h) % h;
+        return data[size_t(y) * w + x];
+    };
+    return glm::mix(glm::mix(texel(p.x, p.y), texel(p.x + 1, p.y), f.x),
+            glm::mix(texel(p.x, p.y + 1), texel(p.x + 1, p.y + 1), f.x), f.y);
+}
+
+// run func(y) for y in [0, n) on n_threads threads (0: all cores), interleaved rows
+template <typename F> static void parallel_rows(uint32_t n, uint32_t n_threads, const F& func) {
+    if (n_threads == 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min(n_threads, n);
+    std::vector<std::thread> workers;
+    for (uint32_t t = 1; t < n_threads; ++t)
+        workers.emplace_back([&, t]() { for (uint32_t y = t; y < n; y += n_threads) func(y); });
+    for (uint32_t y = 0; y < n; y += n_threads) func(y);
+    for (auto& w : workers)
+        w.join();
+}
+
+std::vector<glm::vec3> Environment::load_hdr(const std::string& filename, glm::uvec2& size) {
+    const fs::path path = filename;
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Unable to read file: " + path.string());
+    // parse header
+    std::string line;
+    std::getline(file, line);
+    if (line.rfind("#?", 0) != 0)
+        throw std::runtime_error("Invalid RGBE header: " + path.string());
+    while (std::getline(file, line) && !line.empty()) {
+        if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe")
+            throw std::runtime_error("Unsupported RGBE format: " + path.string());
+    }
+    int w = 0, h = 0;
+    std::getline(file, line);
+    if (sscanf(line.c_str(), "-Y %d +X %d", &h, &w) != 2 || w <= 0 || h <= 0)
+        throw std::runtime_error("Unsupported RGBE orientation: " + path.string());
+    size = glm::uvec2(w, h);
+    // decode scanlines
+    std::vector<glm::vec3> data(size_t(w) * h);
+    std::vector<uint8_t> scanline(size_t(w) * 4);
+    for (int y = 0; y < h; ++y) {
+        uint8_t rgbe[4];
+        file.read((char*)rgbe, 4);
+        if (w < 8 || w > 0x7fff || rgbe[0] != 2 || rgbe[1] != 2 || (rgbe[2] & 0x80)) {
+            // flat scanline
+            memcpy(&scanline[0], rgbe, 4);
+            file.read((char*)&scanline[4], (w - 1) * 4);
+        } else {
+            // run length encoded scanline, one channel after another
+            if (((rgbe[2] << 8) | rgbe[3]) != w)
+                throw std::runtime_error("Invalid RGBE scanline: " + path.string());
+            for (int c = 0; c < 4; ++c) {
+                for (int x = 0; x < w;) {
+                    uint8_t count = 0, value = 0;
+                    file.read((char*)&count, 1);
+                    const bool run = count > 128;
+                    if (run) count -= 128;
+                    if (!file)
+                        throw std::runtime_error("Unexpected end of file: " + path.string());
+                    if (count == 0 || x + count > w)
+                        throw std::runtime_error("Invalid RGBE run length: " + path.string());
+                    if (run) {
+                        file.read((char*)&value, 1);
+                        for (int i = 0; i < count; ++i)
+                            scanline[4 * x++ + c] = value;
+                    } else {
+                        for (int i = 0; i < count; ++i)
+                            file.read((char*)&scanline[4 * x++ + c], 1);
+                    }
+                }
+            }
+        }
+        if (!file)
+            throw std::runtime_error("Unexpected end of file: " + path.string());
+        for (int x = 0; x < w; ++x)
+            data[size_t(h - 1 - y) * w + x] = rgbe_to_float(&scanline[4 * x]);
+    }
+    return data;
+}
+
+// -----------------------------------------------------------
+// envmap cache
+
+namespace {
+
+const char ENVMAP_MAGIC[8] = "VRENVMP";
+const uint32_t ENVMAP_VERSION = 1;
+const size_t ENVMAP_MAX_KEY = 2048;
+const char* ENVMAP_EXTENSION = ".vre";
+
+// followed by the envmap as RGB half floats (padded to 4 bytes) and the importance pyramid as floats, dim^2 down to 1x1
+struct EnvmapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t imp_dimension;
+    uint64_t file_size;
+    char key[ENVMAP_MAX_KEY];
+};
+
+size_t half_bytes(const glm::uvec2& size) { return (size_t(size.x) * size.y * 3 * sizeof(uint16_t) + 3) / 4 * 4; }
+
+size_t pyramid_floats(uint32_t dim) {
+    size_t n = 0;
+    for (uint32_t d = dim; d >= 1; d /= 2)
+        n += size_t(d) * d;
+    return n;
+}
+
+std::vector<uint16_t> pack_half(const std::vector<glm::vec3>& data) {
+    std::vector<uint16_t> half(data.size() * 3);
+    for (size_t i = 0; i < data.size(); ++i)
+        for (int c = 0; c < 3; ++c)
+            half[3 * i + c] = glm::packHalf1x16(glm::clamp(data[i][c], -65504.f, 65504.f));
+    return half;
+}
+
+std::vector<glm::vec3> unpack_half(const std::vector<uint16_t>& half) {
+    std::vector<glm::vec3> data(half.size() / 3);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = glm::vec3(glm::unpackHalf1x16(half[3 * i + 0]), glm::unpackHalf1x16(half[3 * i + 1]), glm::unpackHalf1x16(half[3 * i + 2]));
+    return data;
+}
+
+bool read_cache_file(const std::string& key, glm::uvec2& size, uint32_t& dim, std::vector<uint16_t>& half, std::vector<std::vector<float>>& pyramid) {
+    if (key.size() >= ENVMAP_MAX_KEY) return false;
+    const fs::path path = BrickCache::file_path(key, ENVMAP_EXTENSION);
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+    const size_t file_size = file.tellg();
+    file.seekg(0);
+    EnvmapHeader header;
+    std::memset(&header, 0, sizeof(header));
+    file.read((char*)&header, sizeof(header));
+    const glm::uvec2 header_size(header.width, header.height);
+    const bool valid = file && std::memcmp(header.magic, ENVMAP_MAGIC, sizeof(ENVMAP_MAGIC)) == 0 && header.version == ENVMAP_VERSION &&
+        header.file_size == file_size && std::strncmp(header.key, key.c_str(), ENVMAP_MAX_KEY) == 0 &&
+        header.imp_dimension > 0 && (header.imp_dimension & (header.imp_dimension - 1)) == 0 &&
+        file_size == sizeof(header) + half_bytes(header_size) + pyramid_floats(header.imp_dimension) * sizeof(float);
+    if (valid) {
+        size = header_size;
+        dim = header.imp_dimension;
+        half.resize(size_t(size.x) * size.y * 3);
+        file.read((char*)half.data(), half.size() * sizeof(uint16_t));
+        file.seekg(sizeof(header) + half_bytes(size));
+        pyramid.clear();
+        for (uint32_t d = dim; d >= 1; d /= 2) {
+            pyramid.emplace_back(size_t(d) * d);
+            file.read((char*)pyramid.back().data(), pyramid.back().size() * sizeof(float));
+        }
+    }
+    if (!valid || !file) {
+        std::cerr << "Discarding stale envmap cache entry " << path << std::endl;
+        std::error_code ec;
+        fs::remove(path, ec);
+        return false;
+    }
+    // mark as recently used
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+void write_cache_file(const std::string& key, const glm::uvec2& size, uint32_t dim, const std::vector<uint16_t>& half, const std::vector<std::vector<float>>& pyramid) {
+    if (key.size() >= ENVMAP_MAX_KEY)
+        throw std::runtime_error("EnvironmentCache: invalid key!");
+    EnvmapHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, ENVMAP_MAGIC, sizeof(ENVMAP_MAGIC));
+    header.version = ENVMAP_VERSION;
+    header.width = size.x;
+    header.height = size.y;
+    header.imp_dimension = dim;
+    header.file_size = sizeof(header) + half_bytes(size) + pyramid_floats(dim) * sizeof(float);
+    std::strncpy(header.key, key.c_str(), ENVMAP_MAX_KEY - 1);
+    if (header.file_size > BrickCache::max_bytes) return; // would be evicted right away
+    BrickCache::evict(header.file_size);
+    fs::create_directories(BrickCache::directory);
+
+    // write to temporary file and rename, so readers never see partial entries
+    const fs::path path = BrickCache::file_path(key, ENVMAP_EXTENSION);
+    fs::path tmp = path;
+    tmp += ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out) throw std::runtime_error("EnvironmentCache: unable to write " + tmp.string());
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)half.data(), half.size() * sizeof(uint16_t));
+        out.write("\0\0", half_bytes(size) - half.size() * sizeof(uint16_t));
+        for (const auto& level : pyramid)
+            out.write((const char*)level.data(), level.size() * sizeof(float));
+        if (!out) throw std::runtime_error("EnvironmentCache: unable to write " + tmp.string());
+    }
+    fs::rename(tmp, path);
+}
+
+// in-memory entries, textures with OpenGL or host data without
+struct CacheEntry {
+    bool gl;
+    glm::uvec2 envmap_size;
+    uint32_t imp_dimension;
+    Texture2D envmap, impmap;
+    std::vector<glm::vec3> envmap_host;
+    std::vector<std::vector<float>> impmap_host;
+    size_t bytes;
+    uint64_t last_used;
+};
+
+std::map<std::string, CacheEntry> cache;
+uint64_t cache_clock = 0;
+
+} // namespace
+
+bool EnvironmentCache::enabled = true;
+bool EnvironmentCache::persist = true;
+size_t EnvironmentCache::max_bytes = size_t(1) << 30;
+size_t EnvironmentCache::entries = 0;
+size_t EnvironmentCache::bytes = 0;
+uint64_t EnvironmentCache::hits = 0;
+uint64_t EnvironmentCache::disk_hits = 0;
+uint64_t EnvironmentCache::misses = 0;
+
+void EnvironmentCache::clear() {
+    cache.clear();
+    entries = 0;
+    bytes = 0;
+}
+
+void EnvironmentCache::evict(size_t reserve_bytes) {
+    while (!cache.empty() && bytes + reserve_bytes > max_bytes) {
+        auto lru = cache.begin();
+        for (auto it = cache.begin(); it != cache.end(); ++it)
+            if (it->second.last_used < lru->second.last_used)
+                lru = it;
+        bytes -= lru->second.bytes;
+        --entries;
+        cache.erase(lru);
+    }
+}
+
+// -----------------------------------------------------------
+// Environment
+
+Environment::Environment(const std::string& path) : transform(1), strength(1), envmap_size(0) {
+    TimingScope scope("environment");
+    const std::string key = EnvironmentCache::enabled || EnvironmentCache::persist ? BrickCache::file_key(path) : "";
+    if (!key.empty() && load_cached(key)) return;
+    if (!gl_context_current() || fs::path(path).extension() == ".hdr")
+        envmap_host = load_hdr(path, envmap_size);
+    else
+        envmap = Texture2D("environment", path);
+    if (key.empty()) {
+        build_impmap();
+        return;
+    }
+    ++EnvironmentCache::misses;
+    build_host_data();
+    std::vector<uint16_t> half;
+    if (EnvironmentCache::persist) {
+        half = pack_half(envmap_host);
+        try {
+            write_cache_file(key, envmap_size, imp_dimension, half, impmap_host);
+        } catch (std::exception& e) {
+            std::cerr << "Unable to store envmap in cache: " << e.what() << std::endl;
+        }
+        // use the half-float data from here on, so results do not depend on the cache state
+        envmap = Texture2D();
+        if (!gl_context_current())
+            envmap_host = unpack_half(half);
+    }
+    upload(half);
+    store_cached(key);
+}
 
 Environment::Environment(const Texture2D& envmap) :
     transform(1),
     strength(1),
     envmap(envmap),
-    impmap(envmap->name + "_importance", DIMENSION, DIMENSION, GL_R32F, GL_RED, GL_FLOAT)
+    envmap_size(0)
 {
-    // build importance map
-    static Shader setup_shader = Shader("env_setup", "shader/env_setup.glsl");
-    const uint32_t n_samples = (uint32_t)std::sqrt(SAMPLES);
-    setup_shader->bind();
-    impmap->bind_image(0, GL_WRITE_ONLY, GL_R32F);
-    setup_shader->uniform("envmap", envmap, 0);
-    setup_shader->uniform("output_size", glm::ivec2(DIMENSION));
-    setup_shader->uniform("output_size_samples", glm::ivec2(DIMENSION * n_samples, DIMENSION * n_samples));
-    setup_shader->uniform("num_samples", glm::ivec2(n_samples, n_samples));
-    setup_shader->uniform("inv_samples", 1.f / (n_samples * n_samples));
-    setup_shader->dispatch_compute(DIMENSION, DIMENSION);
-    impmap->unbind_image(0);
-    setup_shader->unbind();
+    build_impmap();
+}
+
+Environment::Environment(const glm::vec3& color) :
+    transform(1),
+    strength(1),
+    envmap_size(1),
+    envmap_host(1, color)
+{
+    build_impmap();
+}
+
+Environment::~Environment() {}
+
+void Environment::build_impmap() {
+    // build importance pyramid on the CPU
+    build_host_data();
+    upload();
+}
+
+void Environment::upload(const std::vector<uint16_t>& envmap_half) {
+    if (!gl_context_current()) return;
+    // upload envmap and pyramid (all mip levels, as expected by sample_environment)
+    if (!envmap) {
+        const std::string name = envmap_size == glm::uvec2(1) ? "background" : "environment";
+        if (envmap_half.empty())
+            envmap = Texture2D(name, envmap_size.x, envmap_size.y, GL_RGB32F, GL_RGB, GL_FLOAT, &envmap_host[0].x);
+        else {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+            envmap = Texture2D(name, envmap_size.x, envmap_size.y, GL_RGB16F, GL_RGB, GL_HALF_FLOAT, envmap_half.data());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+    }
+    impmap = Texture2D(envmap->name + "_importance", imp_dimension, imp_dimension, GL_R32F, GL_RED, GL_FLOAT, impmap_host[0].data());
     impmap->bind(0);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    for (uint32_t mip = 1; mip < impmap_host.size(); ++mip)
+        glTexImage2D(GL_TEXTURE_2D, mip, GL_R32F, imp_dimension >> mip, imp_dimension >> mip, 0, GL_RED, GL_FLOAT, impmap_host[mip].data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, impmap_host.size() - 1);
     impmap->unbind();
+    // free host memory, build_host_data() fetches the envmap again for CPU rendering
+    if (envmap_size != glm::uvec2(1)) {
+        envmap_host = std::vector<glm::vec3>();
+        impmap_host = std::vector<std::vector<float>>();
+    }
 }
 
-Environment::~Environment() {}
+void Environment::build_host_data() {
+    // fetch envmap from GPU?
+    if (envmap_host.empty()) {
+        envmap_size = glm::uvec2(envmap->w, envmap->h);
+        envmap_host.resize(size_t(envmap_size.x) * envmap_size.y);
+        envmap->bind(0);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &envmap_host[0].x);
+        envmap->unbind();
+    }
+    if (!impmap_host.empty()) return;
+    imp_dimension = importance_dimension(envmap_size);
+    impmap_host = build_importance(envmap_host, envmap_size, imp_dimension);
+}
+
+bool Environment::load_cached(const std::string& key) {
+    const bool gl = gl_context_current();
+    // in memory?
+    const auto it = EnvironmentCache::enabled ? cache.find(key) : cache.end();
+    if (it != cache.end() && it->second.gl == gl) {
+        const CacheEntry& entry = it->second;
+        it->second.last_used = ++cache_clock;
+        envmap_size = entry.envmap_size;
+        imp_dimension = entry.imp_dimension;
+        envmap = entry.envmap;
+        impmap = entry.impmap;
+        envmap_host = entry.envmap_host;
+        impmap_host = entry.impmap_host;
+        ++EnvironmentCache::hits;
+        return true;
+    }
+    // on disk?
+    std::vector<uint16_t> half;
+    if (!EnvironmentCache::persist || !read_cache_file(key, envmap_size, imp_dimension, half, impmap_host))
+        return false;
+    if (!gl)
+        envmap_host = unpack_half(half);
+    upload(half);
+    store_cached(key);
+    ++EnvironmentCache::disk_hits;
+    return true;
+}
+
+void Environment::store_cached(const std::string& key) {
+    if (!EnvironmentCache::enabled) return;
+    CacheEntry entry;
+    entry.gl = gl_context_current();
+    entry.envmap_size = envmap_size;
+    entry.imp_dimension = imp_dimension;
+    entry.envmap = envmap;
+    entry.impmap = impmap;
+    entry.envmap_host = envmap_host;
+    entry.impmap_host = impmap_host;
+    // texture or host memory
+    const size_t texel_bytes = entry.gl && EnvironmentCache::persist ? 3 * sizeof(uint16_t) : 3 * sizeof(float);
+    entry.bytes = size_t(envmap_size.x) * envmap_size.y * texel_bytes + pyramid_floats(imp_dimension) * sizeof(float);
+    entry.last_used = ++cache_clock;
+    const auto it = cache.find(key);
+    if (it != cache.end()) {
+        EnvironmentCache::bytes -= it->second.bytes;
+        --EnvironmentCache::entries;
+        cache.erase(it);
+    }
+    const size_t entry_bytes = entry.bytes;
+    if (entry_bytes > EnvironmentCache::max_bytes) return;
+    EnvironmentCache::evict(entry_bytes);
+    cache.emplace(key, std::move(entry));
+    EnvironmentCache::bytes += entry_bytes;
+    ++EnvironmentCache::entries;
+}
+
+glm::vec3 Environment::lookup_host(const glm::vec2& uv) const {
+    return lookup_bilinear(envmap_host, envmap_size, uv);
+}
+
+uint32_t Environment::importance_dimension(const glm::uvec2& envmap_size) {
+    // about one importance texel per envmap texel in y (i.e. two in x)
+    uint32_t dim = MIN_DIMENSION;
+    while (dim < MAX_DIMENSION && 2 * dim <= envmap_size.y)
+        dim *= 2;
+    return dim;
+}
+
+std::vector<std::vector<float>> Environment::build_importance(const std::vector<glm::vec3>& envmap, const glm::uvec2& size, uint32_t dim, uint32_t n_threads) {
+    // supersample each texel to cover all envmap texels within
+    const glm::uvec2 n_samples = glm::max(glm::uvec2(MIN_SAMPLES), (size + dim - 1u) / dim);
+    const glm::vec2 inv_size_samples = 1.f / glm::vec2(dim * n_samples);
+    std::vector<std::vector<float>> pyramid;
+    pyramid.emplace_back(size_t(dim) * dim);
+    parallel_rows(dim, n_threads, [&](uint32_t y) {
+        // solid angle weight sin(theta) of sample rows, normalized to an average of one over the sphere
+        std::vector<float> sin_t(n_samples.y);
+        for (uint32_t sy = 0; sy < n_samples.y; ++sy)
+            sin_t[sy] = std::sin((1.f - (y * n_samples.y + sy + .5f) * inv_size_samples.y) * float(M_PI)) * float(M_PI) / 2;
+        for (uint32_t x = 0; x < dim; ++x) {
+            float importance = 0.f;
+            for (uint32_t sy = 0; sy < n_samples.y; ++sy)
+                for (uint32_t sx = 0; sx < n_samples.x; ++sx)
+                    importance += sin_t[sy] * luma(lookup_bilinear(envmap, size, (glm::vec2(x * n_samples.x + sx, y * n_samples.y + sy) + .5f) * inv_size_samples));
+            pyramid[0][size_t(y) * dim + x] = importance / (n_samples.x * n_samples.y);
+        }
+    });
+    // build mip hierarchy (2x2 box filter, as glGenerateMipmap)
+    for (uint32_t d = dim / 2; d >= 1; d /= 2) {
+        const std::vector<float>& src = pyramid.back();
+        std::vector<float> dst(size_t(d) * d);
+        parallel_rows(d, d >= 256 ? n_threads : 1, [&](uint32_t y) {
+            for (uint32_t x = 0; x < d; ++x)
+                dst[size_t(y) * d + x] = .25f * (src[size_t(2*y) * 2*d + 2*x] + src[size_t(2*y) * 2*d + 2*x+1] + src[size_t(2*y+1) * 2*d + 2*x] + src[size_t(2*y+1) * 2*d + 2*x+1]);
+        });
+        pyramid.push_back(std::move(dst));
+    }
+    return pyramid;
+}
 
 uint32_t Environment::num_mip_levels() const {
-    return 1 + floor(log2(DIMENSION));
+    return 1 + floor(log2(imp_dimension));
 }
 
 uint32_t Environment::dimension() const {
-    return DIMENSION;
+    return imp_dimension;
 }
 
 void Environment::set_uniforms(const Shader& shader, uint32_t& texture_unit) const {
     shader->uniform("env_model", transform);
     shader->uniform("env_inv_model", glm::inverse(transform));
     shader->uniform("env_strength", strength);
-    shader->uniform("env_imp_inv_dim", glm::vec2(1.f / DIMENSION));
-    shader->uniform("env_imp_base_mip", int(floor(log2(DIMENSION))));
+    shader->uniform("env_imp_inv_dim", glm::vec2(1.f / imp_dimension));
+    shader->uniform("env_imp_base_mip", int(floor(log2(imp_dimension))));
     shader->uniform("env_envmap", envmap, texture_unit++);
     shader->uniform("env_impmap", impmap, texture_unit++);
 }
@@ -8,6 +8,7 @@ class Environment {
 public:
     Environment(const std::string& path);
     Environment(const cppgl::Texture2D& envmap);
+    Environment(const glm::vec3& color);
     virtual ~Environment();
 
     explicit inline operator bool() const  { return envmap->operator bool() && impmap->operator bool(); }
@@ -16,8 +17,62 @@ public:
     uint32_t dimension() const;
     void set_uniforms(const cppgl::Shader& shader, uint32_t& texture_unit) const;
 
+    // fetch envmap to host memory (if required) and build importance map on the CPU
+    void build_host_data();
+    // bilinear envmap lookup from host memory (uv in [0, 1])
+    glm::vec3 lookup_host(const glm::vec2& uv) const;
+
+    // load radiance RGBE (.hdr) file into host memory (bottom-up row order, as in OpenGL)
+    static std::vector<glm::vec3> load_hdr(const std::string& path, glm::uvec2& size);
+    // importance map resolution (power of two) adapted to the envmap resolution
+    static uint32_t importance_dimension(const glm::uvec2& envmap_size);
+    // build importance mip pyramid (dim^2 down to 1x1) on the CPU using n_threads (0: all cores),
+    // texels hold luma weighted by sin(theta) (normalized to average 1 over the sphere) for solid angle sampling
+    static std::vector<std::vector<float>> build_importance(const std::vector<glm::vec3>& envmap, const glm::uvec2& size, uint32_t dim, uint32_t n_threads = 0);
+
     // data
     glm::mat3 transform;
     float strength;
     cppgl::Texture2D envmap, impmap;
+
+    // host data (for CPU rendering)
+    glm::uvec2 envmap_size;
+    std::vector<glm::vec3> envmap_host;
+    std::vector<std::vector<float>> impmap_host; // mip hierarchy, dimension()^2 down to 1x1
+
+private:
+    // build importance pyramid from host envmap and upload both (if OpenGL is available)
+    void build_impmap();
+    // upload envmap (if not yet present) and importance pyramid, frees host data afterwards
+    void upload(const std::vector<uint16_t>& envmap_half = {});
+    // fetch from envmap cache (memory or disk), false on miss
+    bool load_cached(const std::string& key);
+    // store in envmap cache (memory and disk)
+    void store_cached(const std::string& key);
+
+    uint32_t imp_dimension = 1;
+};
+
+// --------------------------------------------------------------
+// cache of loaded envmaps, shared across Environment instances and keyed by source path (and modification time)
+// in memory: envmap and importance textures (host data without OpenGL), least recently used entries are evicted beyond max_bytes
+// on disk: half-float envmap plus importance pyramid in BrickCache::directory (sharing its size limit), skips decode and build
+
+struct EnvironmentCache {
+    // settings
+    static bool enabled;                // in-memory cache
+    static bool persist;                // on-disk cache
+    static size_t max_bytes;            // in-memory budget
+
+    // drop all in-memory entries (textures stay alive while in use)
+    static void clear();
+    // evict least recently used in-memory entries until at most max_bytes - reserve_bytes are held
+    static void evict(size_t reserve_bytes = 0);
+
+    // counters
+    static size_t entries;
+    static size_t bytes;
+    static uint64_t hits;
+    static uint64_t disk_hits;
+    static uint64_t misses;
 };
@@ -0,0 +1,157 @@
+#include "frame_output.h"
+#include "glcontext.h"
+#include "image_io.h"
+#include "telemetry.h"
+#include <chrono>
+#include <utility>
+#include <iostream>
+
+using namespace cppgl;
+
+// -----------------------------------------------------------
+// FrameOutput
+
+FrameOutput::FrameOutput(size_t max_in_flight, uint32_t n_threads) : slots(std::max(size_t(1), max_in_flight)), pool(n_threads) {}
+
+FrameOutput::~FrameOutput() {
+    finish();
+    if (!gl_context_current()) return;
+    for (auto& slot : slots) {
+        if (!slot.pbo) continue;
+        glUnmapNamedBuffer(slot.pbo);
+        glDeleteBuffers(1, &slot.pbo);
+    }
+}
+
+void FrameOutput::write(const Texture2D& color, const std::string& basename) {
+    Slot& slot = slots[acquire_slot()];
+    TimingScope scope("readback");
+    // (re-)allocate persistently mapped pixel buffer
+    const size_t bytes = size_t(color->w) * color->h * sizeof(glm::vec4);
+    if (slot.bytes != bytes) {
+        if (slot.pbo) {
+            glUnmapNamedBuffer(slot.pbo);
+            glDeleteBuffers(1, &slot.pbo);
+        }
+        const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &slot.pbo);
+        glNamedBufferStorage(slot.pbo, bytes, nullptr, flags);
+        slot.data = (glm::vec4*)glMapNamedBufferRange(slot.pbo, 0, bytes, flags);
+        slot.bytes = bytes;
+    }
+    // start readback
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, color->id);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    slot.w = color->w;
+    slot.h = color->h;
+    slot.basename = basename;
+    slot.format = format;
+    slot.frame = Telemetry::frame;
+}
+
+void FrameOutput::write(std::vector<glm::vec4> rgba, uint32_t w, uint32_t h, const std::string& basename) {
+    while (host_jobs.size() >= slots.size()) {
+        host_jobs.front().get();
+        host_jobs.pop_front();
+    }
+    auto data = std::make_shared<std::vector<glm::vec4>>(std::move(rgba));
+    host_jobs.push_back(pool.enqueue([this, data, w, h, basename, format = format, frame = Telemetry::frame]() {
+        Telemetry::frame = frame;
+        encode(data->data(), w, h, basename, format);
+        std::lock_guard<std::mutex> lock(written_mutex);
+        written.push_back(basename);
+    }));
+}
+
+void FrameOutput::poll() {
+    for (auto& slot : slots)
+        if (slot.fence && glClientWaitSync(slot.fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+            dispatch(slot);
+}
+
+void FrameOutput::finish() {
+    for (auto& slot : slots) {
+        if (slot.fence) {
+            while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+            dispatch(slot);
+        }
+    }
+    for (auto& slot : slots)
+        if (slot.job.valid()) slot.job.get();
+    for (auto& job : host_jobs)
+        job.get();
+    host_jobs.clear();
+}
+
+size_t FrameOutput::acquire_slot() {
+    while (true) {
+        poll();
+        // free slot?
+        for (size_t i = 0; i < slots.size(); ++i) {
+            Slot& slot = slots[i];
+            if (slot.fence) continue;
+            if (slot.job.valid() && slot.job.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+            if (slot.job.valid()) slot.job.get(); // rethrow writer errors
+            return i;
+        }
+        // wait for any pending readback or writer
+        for (auto& slot : slots) {
+            if (slot.fence) {
+                while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+                dispatch(slot);
+                break;
+            }
+            if (slot.job.valid()) {
+                slot.job.wait();
+                break;
+            }
+        }
+    }
+}
+
+void FrameOutput::dispatch(Slot& slot) {
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    Slot* s = &slot;
+    slot.job = pool.enqueue([this, s]() {
+        Telemetry::frame = s->frame;
+        encode(s->data, s->w, s->h, s->basename, s->format);
+        std::lock_guard<std::mutex> lock(written_mutex);
+        written.push_back(s->basename);
+    });
+}
+
+std::vector<std::string> FrameOutput::take_written() {
+    std::lock_guard<std::mutex> lock(written_mutex);
+    return std::exchange(written, {});
+}
+
+void FrameOutput::encode(const glm::vec4* rgba, uint32_t w, uint32_t h, const std::string& basename, const Format& format) {
+    // write to <basename>.tmp.<ext> and rename, so a killed writer never leaves a truncated frame that --resume would skip
+    if (format.png) {
+        std::vector<uint8_t> pixels(size_t(w) * h * 4);
+        {
+            TimingScope scope("tonemap");
+            tonemap_ldr(rgba, size_t(w) * h, pixels.data(), format.tonemap, format.exposure, format.gamma);
+        }
+        {
+            TimingScope scope("save_ldr");
+            image_store_ldr(fs::path(basename + ".tmp.png"), pixels.data(), w, h, 4);
+            fs::rename(basename + ".tmp.png", basename + ".png");
+        }
+        std::cout << basename + ".png written." << std::endl;
+    }
+    if (format.exr) {
+        TimingScope scope("save_exr");
+        image_store_exr(basename + ".tmp.exr", rgba, w, h, format.exr_half);
+        fs::rename(basename + ".tmp.exr", basename + ".exr");
+        std::cout << basename + ".exr written." << std::endl;
+    }
+}
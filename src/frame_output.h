@@ -0,0 +1,71 @@
+#pragma once
+
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cppgl.h>
+
+#include "thread_pool.h"
+
+// --------------------------------------------------------------
+// asynchronous output of rendered frames: results of the OpenGL backend are read back through persistently
+// mapped pixel buffer objects, encoding and writing happens in a thread pool while the next frame renders
+// at most max_in_flight frames are pending at any time, so memory stays flat on long sequences
+
+class FrameOutput {
+public:
+    FrameOutput(size_t max_in_flight = 3, uint32_t n_threads = 0);
+    ~FrameOutput();
+
+    FrameOutput(const FrameOutput&) = delete;
+    FrameOutput& operator=(const FrameOutput&) = delete;
+
+    // queue RGBA32F texture (asynchronous readback, requires a current OpenGL context), blocks while max_in_flight frames are pending
+    void write(const cppgl::Texture2D& color, const std::string& basename);
+    // queue host image (rows bottom-up), blocks while max_in_flight frames are pending
+    void write(std::vector<glm::vec4> rgba, uint32_t w, uint32_t h, const std::string& basename);
+    // hand finished readbacks over to the writers
+    void poll();
+    // wait until all queued frames are written
+    void finish();
+    // basenames of the frames written completely since the last call, in order of completion
+    std::vector<std::string> take_written();
+
+    // settings, applied to frames queued afterwards
+    struct Format {
+        bool png = true;                // tonemapped 8 bit PNG (including alpha)
+        bool exr = false;               // raw accumulation buffer as OpenEXR
+        bool exr_half = true;           // 16 bit half instead of 32 bit float EXR channels
+        bool tonemap = true;
+        float exposure = 5.f;
+        float gamma = 2.2f;
+    } format;
+
+private:
+    struct Slot {
+        GLuint pbo = 0;
+        glm::vec4* data = nullptr;      // persistent mapping of pbo
+        size_t bytes = 0;
+        GLsync fence = 0;               // readback pending
+        std::future<void> job;          // writer running
+        uint32_t w = 0, h = 0;
+        std::string basename;
+        Format format;
+        int64_t frame = -1;             // telemetry frame
+    };
+
+    // wait until a slot is free, returns its index
+    size_t acquire_slot();
+    // start writer for slot whose readback finished
+    void dispatch(Slot& slot);
+    // encode and write image according to format
+    static void encode(const glm::vec4* rgba, uint32_t w, uint32_t h, const std::string& basename, const Format& format);
+
+    std::vector<Slot> slots;
+    std::deque<std::future<void>> host_jobs;
+    std::mutex written_mutex;
+    std::vector<std::string> written;   // completed by the writers, see take_written()
+    ThreadPool pool;                    // declared last: joins before the slots referenced by its jobs are destroyed
+};
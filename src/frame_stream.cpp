@@ -0,0 +1,161 @@
+#include "frame_stream.h"
+#include "thread_pool.h"
+#include <iostream>
+
+// -----------------------------------------------------------
+// StreamFrame
+
+size_t StreamFrame::size_bytes() const {
+    return (bricks.density ? bricks.density->size_bytes() : 0) + (bricks.emission ? bricks.emission->size_bytes() : 0);
+}
+
+// -----------------------------------------------------------
+// FrameStream
+
+FrameStream::FrameStream(const std::string& folder, const std::vector<std::string>& gridnames, size_t window, size_t max_bytes)
+    : files(list_frame_files(folder)), gridnames(gridnames), window(std::max<size_t>(window, 1)), max_bytes(max_bytes) {
+    // frame indices wrap around modulo the number of files
+    if (files.empty()) throw std::runtime_error("no frames to stream in " + folder);
+    // global emission majorant, so emission normalization does not depend on which frames are loaded
+    {
+        ThreadPool pool;
+        std::vector<std::future<float>> futures;
+        for (const auto& file : files)
+            futures.push_back(pool.enqueue([&file, &gridnames]() { return load_emission_majorant(file, gridnames); }));
+        for (size_t i = 0; i < futures.size(); ++i) {
+            majorant = std::max(majorant, futures[i].get());
+            print_progress("Scanning emission", i + 1, futures.size());
+        }
+    }
+    worker = std::thread([this]() { prefetch(); });
+}
+
+FrameStream::~FrameStream() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_all();
+    worker.join();
+}
+
+size_t FrameStream::n_frames() const {
+    return files.size();
+}
+
+std::shared_ptr<StreamFrame> FrameStream::acquire(size_t i) {
+    i = i % files.size();
+    std::unique_lock<std::mutex> lock(mutex);
+    current = i;
+    // evict frames outside of the window
+    for (auto it = frames.begin(); it != frames.end();) {
+        if (in_window(it->first)) {
+            ++it;
+        } else {
+            bytes -= it->second->size_bytes();
+            it = frames.erase(it);
+        }
+    }
+    for (auto it = failed.begin(); it != failed.end();)
+        it = in_window(*it) ? std::next(it) : failed.erase(it);
+    cv.notify_all();
+    // wait for prefetch in progress
+    cv.wait(lock, [&]() { return frames.count(i) || !loading.count(i); });
+    if (frames.count(i)) return frames.at(i);
+    // load on calling thread
+    loading.insert(i);
+    lock.unlock();
+    std::shared_ptr<StreamFrame> frame;
+    try {
+        frame = load(i);
+    } catch (...) {
+        lock.lock();
+        loading.erase(i);
+        cv.notify_all();
+        throw;
+    }
+    lock.lock();
+    insert(i, frame);
+    return frame;
+}
+
+size_t FrameStream::resident_frames() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frames.size();
+}
+
+size_t FrameStream::resident_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+float FrameStream::majorant_emission() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return majorant;
+}
+
+// -----------------------------------------------------------
+// internal helpers (mutex held, unless noted otherwise)
+
+bool FrameStream::in_window(size_t i) const {
+    const size_t n = files.size();
+    return (i + n - current) % n < std::min(window, n);
+}
+
+bool FrameStream::next_prefetch(size_t& i) const {
+    if (max_bytes > 0 && !frames.empty()) {
+        // stop prefetching if another frame of average size would exceed the budget
+        const size_t estimate = bytes / frames.size();
+        if (bytes + estimate > max_bytes) return false;
+    }
+    for (size_t k = 0; k < std::min(window, files.size()); ++k) {
+        i = (current + k) % files.size();
+        if (!frames.count(i) && !loading.count(i) && !failed.count(i)) return true;
+    }
+    return false;
+}
+
+// called without mutex held
+std::shared_ptr<StreamFrame> FrameStream::load(size_t i) const {
+    auto frame = std::make_shared<StreamFrame>();
+    frame->grids = load_frame(files[i], gridnames);
+    if (frame->grids.find("density") == frame->grids.end())
+        throw std::runtime_error("no density grid in " + files[i]);
+    frame->bricks = convert_frame(frame->grids);
+    return frame;
+}
+
+void FrameStream::insert(size_t i, const std::shared_ptr<StreamFrame>& frame) {
+    loading.erase(i);
+    if (in_window(i) && !frames.count(i)) {
+        frames[i] = frame;
+        bytes += frame->size_bytes();
+    }
+    cv.notify_all();
+}
+
+void FrameStream::prefetch() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        size_t i = 0;
+        cv.wait(lock, [&]() { return stop || next_prefetch(i); });
+        if (stop) return;
+        loading.insert(i);
+        lock.unlock();
+        std::shared_ptr<StreamFrame> frame;
+        try {
+            frame = load(i);
+        } catch (std::exception& e) {
+            std::cerr << "Unable to prefetch " << files[i] << ": " << e.what() << std::endl;
+        }
+        lock.lock();
+        if (frame)
+            insert(i, frame);
+        else {
+            // do not retry failed frames while they stay in the window
+            loading.erase(i);
+            failed.insert(i);
+            cv.notify_all();
+        }
+    }
+}
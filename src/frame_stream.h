@@ -0,0 +1,64 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "volume_loader.h"
+
+// --------------------------------------------------------------
+// bounded-memory streaming of volume animations
+// only a sliding window of frames starting at the current frame is kept in host memory,
+// a background thread loads and converts upcoming frames while the current one renders
+
+struct StreamFrame {
+    GridFrame grids;
+    BrickFrame bricks;
+    size_t size_bytes() const;  // brick data
+};
+
+class FrameStream {
+public:
+    // window: number of resident frames (current and upcoming), max_bytes: host memory budget for brick data (0: unlimited)
+    // the emission majorant of all frames is determined up front (loading only the emission grids, in parallel)
+    FrameStream(const std::string& folder, const std::vector<std::string>& gridnames, size_t window = 8, size_t max_bytes = 0);
+    ~FrameStream();
+
+    FrameStream(const FrameStream&) = delete;
+    FrameStream& operator=(const FrameStream&) = delete;
+
+    size_t n_frames() const;
+
+    // make frame i current (blocks until loaded), evicts frames outside the window and starts prefetching
+    std::shared_ptr<StreamFrame> acquire(size_t i);
+
+    // stats
+    size_t resident_frames() const;
+    size_t resident_bytes() const;
+    float majorant_emission() const;    // max. over all frames
+
+    // settings
+    const std::vector<std::string> files;
+    const std::vector<std::string> gridnames;
+    const size_t window;
+    const size_t max_bytes;
+
+private:
+    bool in_window(size_t i) const;
+    bool next_prefetch(size_t& i) const;
+    std::shared_ptr<StreamFrame> load(size_t i) const;
+    void insert(size_t i, const std::shared_ptr<StreamFrame>& frame);
+    void prefetch();
+
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    std::map<size_t, std::shared_ptr<StreamFrame>> frames;
+    std::set<size_t> loading, failed;
+    size_t current = 0;
+    size_t bytes = 0;
+    float majorant = 0.f;               // constant after construction
+    bool stop = false;
+    std::thread worker;
+};
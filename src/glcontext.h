@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cppgl.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "headless.h"
+
+// check if a windowed (GLFW) OpenGL context is current on the calling thread
+inline bool gl_window_current() {
+    return glfwGetCurrentContext() != nullptr;
+}
+
+// check if an OpenGL context (windowed or headless) is current on the calling thread
+inline bool gl_context_current() {
+    return gl_window_current() || headless_context_current();
+}
+
+// render resolution of the current context
+inline glm::ivec2 gl_resolution() {
+    return gl_window_current() ? cppgl::Context::resolution() : headless_resolution();
+}
+
+// finish frame: swap buffers of the window, or just flush the headless context
+inline void gl_swap_buffers() {
+    if (gl_window_current())
+        cppgl::Context::swap_buffers();
+    else if (headless_context_current())
+        glFlush();
+}
+
+// update camera matrices (without window, the aspect ratio is taken from the headless resolution)
+inline void gl_update_camera() {
+    if (gl_window_current()) {
+        cppgl::current_camera()->update();
+        return;
+    }
+    const auto cam = cppgl::current_camera();
+    const glm::ivec2 res = glm::max(gl_resolution(), glm::ivec2(1));
+    cam->view = glm::lookAt(cam->pos, cam->pos + cam->dir, cam->up);
+    cam->proj = glm::perspective(glm::radians(cam->fov_degree), float(res.x) / res.y, cam->near, cam->far);
+}
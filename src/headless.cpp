@@ -0,0 +1,98 @@
+#include "headless.h"
+#include <cppgl.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// -----------------------------------------------------------
+// EGL state
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static glm::ivec2 resolution = glm::ivec2(0);
+
+static bool has_extension(const char* extensions, const char* name) {
+    if (!extensions) return false;
+    const size_t len = strlen(name);
+    for (const char* p = strstr(extensions, name); p; p = strstr(p + len, name))
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) return true;
+    return false;
+}
+
+static EGLDisplay get_display() {
+    // prefer the surfaceless platform (Mesa), which does not require any window system or device access
+    const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display && has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+        EGLDisplay dpy = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (dpy != EGL_NO_DISPLAY) return dpy;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+// -----------------------------------------------------------
+// headless context
+
+void headless_init(uint32_t width, uint32_t height, int gl_major, int gl_minor) {
+    if (context != EGL_NO_CONTEXT) throw std::runtime_error("headless context already initialized!");
+    display = get_display();
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        throw std::runtime_error("unable to initialize EGL display!");
+    if (!has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context"))
+        throw std::runtime_error("EGL_KHR_surfaceless_context not supported!");
+    if (!eglBindAPI(EGL_OPENGL_API))
+        throw std::runtime_error("unable to bind OpenGL API!");
+    // choose config (none required, as there is no surface)
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_no_config_context")) {
+        const EGLint config_attribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLint n_configs = 0;
+        if (!eglChooseConfig(display, config_attribs, &config, 1, &n_configs) || n_configs == 0)
+            throw std::runtime_error("no suitable EGL config found!");
+    }
+    // create core profile context
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, gl_major,
+        EGL_CONTEXT_MINOR_VERSION, gl_minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT)
+        throw std::runtime_error("unable to create OpenGL " + std::to_string(gl_major) + "." + std::to_string(gl_minor) + " context!");
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        throw std::runtime_error("unable to make headless context current!");
+#ifdef __glew_h__
+    // load function pointers, GLX specific errors can be ignored as the core functions are loaded regardless
+    glewExperimental = GL_TRUE;
+    glewInit();
+    glGetError(); // glewInit may raise GL_INVALID_ENUM on core contexts
+#endif
+    resolution = glm::ivec2(width, height);
+    std::cout << "Headless OpenGL context: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+}
+
+void headless_shutdown() {
+    if (context == EGL_NO_CONTEXT) return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    context = EGL_NO_CONTEXT;
+    display = EGL_NO_DISPLAY;
+}
+
+bool headless_context_current() {
+    return context != EGL_NO_CONTEXT && eglGetCurrentContext() == context;
+}
+
+glm::ivec2 headless_resolution() {
+    return resolution;
+}
+
+void headless_resize(uint32_t width, uint32_t height) {
+    resolution = glm::ivec2(width, height);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// --------------------------------------------------------------
+// headless OpenGL context via EGL (surfaceless), no display or window system required
+// (e.g. for batch rendering on Mesa llvmpipe), there is no default framebuffer
+
+// create context and make it current on the calling thread, throws std::runtime_error on failure
+void headless_init(uint32_t width, uint32_t height, int gl_major = 4, int gl_minor = 5);
+// destroy context
+void headless_shutdown();
+// is the headless context current on the calling thread?
+bool headless_context_current();
+// render resolution of the headless context
+glm::ivec2 headless_resolution();
+void headless_resize(uint32_t width, uint32_t height);
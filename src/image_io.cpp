@@ -0,0 +1,182 @@
+#include "image_io.h"
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <glm/gtc/packing.hpp>
+
+// -----------------------------------------------------------
+// tonemapping
+
+static glm::vec3 hable(const glm::vec3& rgb) {
+    const float A = 0.15f;
+    const float B = 0.50f;
+    const float C = 0.10f;
+    const float D = 0.20f;
+    const float E = 0.02f;
+    const float F = 0.30f;
+    return ((rgb * (A * rgb + C * B) + D * E) / (rgb * (A * rgb + B) + D * F)) - E / F;
+}
+
+void tonemap_ldr(const glm::vec4* rgba, size_t n, uint8_t* out, bool tonemap, float exposure, float gamma) {
+    const glm::vec3 white = hable(glm::vec3(11.2f));
+    for (size_t i = 0; i < n; ++i) {
+        glm::vec4 col = rgba[i];
+        if (tonemap)
+            col = glm::vec4(glm::pow(hable(exposure * glm::vec3(col)) / white, glm::vec3(1.f / gamma)), col.a);
+        for (int c = 0; c < 4; ++c) {
+            const float v = std::isnan(col[c]) || std::isinf(col[c]) ? 0.f : glm::clamp(col[c], 0.f, 1.f);
+            out[4 * i + c] = uint8_t(std::round(v * 255.f));
+        }
+    }
+}
+
+// -----------------------------------------------------------
+// OpenEXR (uncompressed scanlines, see "The OpenEXR File Layout")
+
+template <typename T> static void put(std::vector<char>& buf, const T& value) {
+    const char* ptr = reinterpret_cast<const char*>(&value); // little endian
+    buf.insert(buf.end(), ptr, ptr + sizeof(T));
+}
+
+static void put_attribute(std::vector<char>& buf, const char* name, const char* type, const std::vector<char>& value) {
+    buf.insert(buf.end(), name, name + strlen(name) + 1);
+    buf.insert(buf.end(), type, type + strlen(type) + 1);
+    put(buf, int32_t(value.size()));
+    buf.insert(buf.end(), value.begin(), value.end());
+}
+
+void image_store_exr(const std::string& filename, const glm::vec4* rgba, uint32_t w, uint32_t h, bool half) {
+    const int32_t pixel_type = half ? 1 : 2; // HALF or FLOAT
+    const size_t channel_bytes = half ? 2 : 4;
+    // header
+    std::vector<char> buf;
+    put(buf, int32_t(20000630)); // magic
+    put(buf, int32_t(2));        // version 2, single part scanline file
+    std::vector<char> channels;
+    for (const char* name : { "A", "B", "G", "R" }) { // alphabetical order
+        channels.insert(channels.end(), name, name + 2);
+        put(channels, pixel_type);
+        put(channels, int32_t(0)); // pLinear + reserved
+        put(channels, int32_t(1)); // x sampling
+        put(channels, int32_t(1)); // y sampling
+    }
+    channels.push_back(0);
+    put_attribute(buf, "channels", "chlist", channels);
+    put_attribute(buf, "compression", "compression", { 0 }); // NO_COMPRESSION
+    std::vector<char> window;
+    for (int32_t v : { 0, 0, int32_t(w) - 1, int32_t(h) - 1 })
+        put(window, v);
+    put_attribute(buf, "dataWindow", "box2i", window);
+    put_attribute(buf, "displayWindow", "box2i", window);
+    put_attribute(buf, "lineOrder", "lineOrder", { 0 }); // INCREASING_Y
+    std::vector<char> one, center;
+    put(one, 1.f);
+    put(center, 0.f);
+    put(center, 0.f);
+    put_attribute(buf, "pixelAspectRatio", "float", one);
+    put_attribute(buf, "screenWindowCenter", "v2f", center);
+    put_attribute(buf, "screenWindowWidth", "float", one);
+    buf.push_back(0);
+    // offset table, one scanline per block
+    const size_t line_bytes = size_t(w) * 4 * channel_bytes;
+    const size_t first_line = buf.size() + h * sizeof(uint64_t);
+    for (uint32_t y = 0; y < h; ++y)
+        put(buf, uint64_t(first_line + y * (8 + line_bytes)));
+    // scanlines (top-down), channels are stored planar per line
+    buf.reserve(buf.size() + h * (8 + line_bytes));
+    for (uint32_t y = 0; y < h; ++y) {
+        put(buf, int32_t(y));
+        put(buf, int32_t(line_bytes));
+        const glm::vec4* row = rgba + size_t(h - 1 - y) * w;
+        for (int c : { 3, 2, 1, 0 }) {
+            for (uint32_t x = 0; x < w; ++x) {
+                if (half)
+                    put(buf, uint16_t(glm::packHalf1x16(row[x][c])));
+                else
+                    put(buf, row[x][c]);
+            }
+        }
+    }
+    // write
+    std::ofstream file(filename, std::ios::binary);
+    if (!file || !file.write(buf.data(), buf.size()))
+        throw std::runtime_error("unable to write " + filename);
+}
+
+template <typename T> static T get(const std::vector<char>& buf, size_t& pos) {
+    if (pos + sizeof(T) > buf.size()) throw std::runtime_error("unexpected end of file");
+    T value;
+    memcpy(&value, buf.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+}
+
+static std::string get_string(const std::vector<char>& buf, size_t& pos) {
+    const size_t end = std::find(buf.begin() + pos, buf.end(), 0) - buf.begin();
+    if (end >= buf.size()) throw std::runtime_error("unexpected end of file");
+    const std::string str(buf.data() + pos, end - pos);
+    pos = end + 1;
+    return str;
+}
+
+std::vector<glm::vec4> image_load_exr(const std::string& filename, uint32_t& w, uint32_t& h) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) throw std::runtime_error("unable to read " + filename);
+    const std::vector<char> buf((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    try {
+        // header
+        size_t pos = 0;
+        if (get<int32_t>(buf, pos) != 20000630) throw std::runtime_error("not an OpenEXR file");
+        const int32_t version = get<int32_t>(buf, pos);
+        if ((version & 0xFF) != 2 || (version & 0x1A00)) throw std::runtime_error("only single part scanline files are supported");
+        std::vector<std::pair<int, int32_t>> channels; // rgba index (-1: skipped), pixel type
+        int32_t window[4] = { 0, 0, -1, -1 };
+        for (std::string name = get_string(buf, pos); !name.empty(); name = get_string(buf, pos)) {
+            get_string(buf, pos); // type
+            const int32_t size = get<int32_t>(buf, pos);
+            size_t value = pos;
+            pos += size;
+            if (name == "channels") {
+                for (std::string channel = get_string(buf, value); !channel.empty(); channel = get_string(buf, value)) {
+                    const int32_t type = get<int32_t>(buf, value);
+                    value += 12; // pLinear, reserved, sampling
+                    const size_t c = std::string("RGBA").find(channel);
+                    channels.emplace_back(channel.size() == 1 && c != std::string::npos ? int(c) : -1, type);
+                }
+            } else if (name == "compression") {
+                if (buf.at(value) != 0) throw std::runtime_error("only uncompressed files are supported");
+            } else if (name == "dataWindow") {
+                for (int i = 0; i < 4; ++i)
+                    window[i] = get<int32_t>(buf, value);
+            }
+        }
+        w = uint32_t(window[2] - window[0] + 1);
+        h = uint32_t(window[3] - window[1] + 1);
+        std::vector<glm::vec4> rgba(size_t(w) * h, glm::vec4(0, 0, 0, 1));
+        // offset table, one scanline per block (rows are stored top-down, returned bottom-up)
+        const size_t table = pos;
+        for (uint32_t i = 0; i < h; ++i) {
+            pos = table + i * sizeof(uint64_t);
+            pos = size_t(get<uint64_t>(buf, pos));
+            const int32_t y = get<int32_t>(buf, pos) - window[1];
+            get<int32_t>(buf, pos); // size
+            if (y < 0 || y >= int32_t(h)) throw std::runtime_error("invalid scanline");
+            glm::vec4* row = rgba.data() + size_t(h - 1 - y) * w;
+            for (const auto& [c, type] : channels) {
+                for (uint32_t x = 0; x < w; ++x) {
+                    float v = 0.f;
+                    if (type == 1) v = glm::unpackHalf1x16(get<uint16_t>(buf, pos));
+                    else if (type == 2) v = get<float>(buf, pos);
+                    else v = float(get<uint32_t>(buf, pos));
+                    if (c >= 0) row[x][c] = v;
+                }
+            }
+        }
+        return rgba;
+    } catch (std::runtime_error& e) {
+        throw std::runtime_error("unable to read " + filename + ": " + e.what());
+    }
+}
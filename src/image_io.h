@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// --------------------------------------------------------------
+// image output helpers (rows bottom-up, as in OpenGL)
+
+// tonemap (same as shader/tonemap.glsl) and quantize rgba to 8 bit, or just clamp and quantize if tonemap is false
+void tonemap_ldr(const glm::vec4* rgba, size_t n, uint8_t* out, bool tonemap, float exposure, float gamma);
+
+// write rgba as uncompressed scanline OpenEXR file (lossless, 16 bit half or 32 bit float channels)
+void image_store_exr(const std::string& filename, const glm::vec4* rgba, uint32_t w, uint32_t h, bool half = true);
+// read rgba from uncompressed scanline OpenEXR file (as written by image_store_exr()), missing channels are zero (alpha: one)
+std::vector<glm::vec4> image_load_exr(const std::string& filename, uint32_t& w, uint32_t& h);
@@ -1,6 +1,10 @@
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <csignal>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -12,6 +16,13 @@
 #include <pybind11/eval.h>
 
 #include "renderer.h"
+#include "renderer_cpu.h"
+#include "glcontext.h"
+#include "volume_loader.h"
+#include "brick_cache.h"
+#include "frame_output.h"
+#include "telemetry.h"
+#include "shard.h"
 
 using namespace cppgl;
 
@@ -25,29 +36,71 @@ static bool animate = false;
 static float animation_fps = 30;
 
 static bool interactive = true;
+static bool write_exr = false;          // also write raw accumulation buffer as OpenEXR in offline mode
+static bool exr_half = true;            // 16 bit half (else 32 bit float) EXR channels
+static size_t frames_in_flight = 3;     // max. number of frames being read back or written in offline mode
+static float dispatch_limit_ms = 500;   // max. GPU time of a trace() batch in offline mode (stay below driver watchdog timeouts)
+static bool headless = false;           // offline rendering without window system (EGL)
+static bool write_timings = true;       // per-frame stage timings as <output>_timings.json/csv in offline mode
 static std::string out_filename = "output.png";
-
-static std::shared_ptr<RendererOpenGL> renderer;
+static FrameRange frame_range;          // frames rendered in offline mode (default: all)
+static int tile_index = 0, n_tiles = 1; // offline rendering of horizontal strip tile_index of n_tiles (top to bottom)
+static glm::ivec2 image_offset = glm::ivec2(0), image_size = glm::ivec2(0); // of the tile in the full image
+static float checkpoint_interval_s = -1; // write checkpoints of the accumulation buffers in offline mode (0: never, < 0: not given)
+static bool resume = false;             // continue from checkpoints and skip written frames in offline mode
+static std::string scene_sources;       // paths and modification times of the loaded files, part of the checkpoint scene hash
+static volatile std::sig_atomic_t terminate_signal = 0;
+
+static std::string backend = "gl";
+
+static size_t stream_window = 0;        // number of resident frames when streaming animations (0: load all frames)
+static size_t stream_budget_mb = 0;     // host memory budget for streamed brick data (0: unlimited)
+static size_t vram_budget_mb = 0;       // budget for resident brick textures (0: unlimited)
+static int lod_mode = 0;                // level of detail mode, the coarser atlas levels are built when volumes are committed
+static int lod_levels = 3;
+static float lod_quality = 1.f;
+static std::shared_ptr<Renderer> renderer;
 
 // ------------------------------------------
 // helper funcs
 
 inline float randf() { return rand() / (RAND_MAX + 1.f); }
 
+void terminate_handler(int signal) {
+    terminate_signal = signal;
+}
+
+glm::ivec2 render_resolution() {
+    if (auto cpu = std::dynamic_pointer_cast<RendererCPU>(renderer))
+        return glm::ivec2(cpu->resolution);
+    return gl_resolution();
+}
+
 void load_volume(const std::string& path) {
+    TimingScope scope("load_volume");
     try {
         std::cout << "load volume: " << path << std::endl;
-        if (fs::is_directory(path)) {
-            // load contents of folder
-            renderer->volume = voldata::Volume::load_folder(path, { "density", "temperature", "flame", "flames" });
+        renderer->stream.reset();
+        if (fs::is_directory(path) && stream_window > 0) {
+            // stream contents of folder, only a window of frames is resident
+            renderer->stream = std::make_shared<FrameStream>(path, FRAME_GRID_NAMES, stream_window, stream_budget_mb << 20);
+            renderer->stream_frame = 0;
+            renderer->volume = std::make_shared<voldata::Volume>();
+            renderer->volume->add_grid_frame(renderer->stream->acquire(0)->grids);
+        } else if (fs::is_directory(path)) {
+            // load contents of folder (in parallel)
+            renderer->volume = load_folder_parallel(path, FRAME_GRID_NAMES);
         } else {
             // load single grid
             renderer->volume = std::make_shared<voldata::Volume>(path);
+            BrickCache::register_source(renderer->volume->current_grid(), path, "density");
             // try to add emission grid
             if (std::filesystem::path(path).extension() == ".vdb") {
-                for (const auto& name : { "flame", "flames", "temperature" }) {
+                for (const auto& name : EMISSION_GRID_NAMES) {
                     try {
-                        renderer->volume->update_grid_frame(renderer->volume->grid_frame_counter, voldata::Volume::load_grid(path, name), name);
+                        const auto grid = voldata::Volume::load_grid(path, name);
+                        BrickCache::register_source(grid, path, name);
+                        renderer->volume->update_grid_frame(renderer->volume->grid_frame_counter, grid, name);
                     } catch (std::runtime_error& e) {}
                 }
             }
@@ -74,7 +127,6 @@ void load_transferfunc(const std::string& path) {
     try {
         renderer->transferfunc = std::make_shared<TransferFunction>(path);
         renderer->transferfunc->upload_gpu();
-        renderer->trace_shader = Shader("trace_tf", "shader/pathtracer_brick_tf.glsl");
         renderer->show_environment = false;
         renderer->sample = 0;
     } catch (std::runtime_error& e) {
@@ -93,6 +145,7 @@ void run_script(const std::string& path) {
 }
 
 void handle_path(const std::string& path) {
+    scene_sources += path + " " + std::to_string(fs::last_write_time(path).time_since_epoch().count()) + "\n";
     if (std::filesystem::path(path).extension() == ".py")
         run_script(path);
     else if (std::filesystem::path(path).extension() == ".hdr")
@@ -173,14 +226,34 @@ void gui_callback(void) {
         est_ravg = glm::mix(est_ravg, float(Context::frame_time() * (renderer->sppx - renderer->sample) / 1000.f), 0.1f);
         ImGui::Text("Sample: %i/%i (est: %um, %us)", renderer->sample, renderer->sppx, uint32_t(est_ravg) / 60, uint32_t(est_ravg) % 60);
         if (ImGui::InputInt("Sppx", &renderer->sppx)) renderer->reset();
+        if (ImGui::InputInt("Samples/dispatch", &renderer->samples_per_dispatch))
+            renderer->samples_per_dispatch = std::max(1, renderer->samples_per_dispatch);
         if (ImGui::InputInt("Bounces", &renderer->bounces)) renderer->reset();
         if (ImGui::Checkbox("Vsync", &use_vsync)) Context::set_swap_interval(use_vsync ? 1 : 0);
+        if (ImGui::Checkbox("Adaptive", &renderer->adaptive)) renderer->reset();
+        ImGui::SameLine();
+        if (ImGui::DragFloat("Threshold", &renderer->adaptive_threshold, 0.001f, 0.f, 1.f, "%.3f")) renderer->reset();
+        if (renderer->adaptive)
+            ImGui::Text("Active tiles: %u / %u", renderer->tiles_active, renderer->tiles_total);
+        if (ImGui::Button("Save heatmap")) renderer->save_heatmap("heatmap.png");
+        if (ImGui::Checkbox("Counters", &renderer->instrumented)) renderer->reset();
+        if (renderer->instrumented) {
+            // hot-path counters since reset, per path
+            renderer->read_counters();
+            const TraceCounters& counters = renderer->counters;
+            const double paths = double(std::max(uint64_t(1), renderer->pixel_samples));
+            for (int i = 0; i < TraceCounters::BOUNCES; ++i)
+                ImGui::Text("%s: %.2f / path (%lu)", TraceCounters::name(i), counters[i] / paths, counters[i]);
+            float histogram[TraceCounters::N_BOUNCE_BINS];
+            for (int i = 0; i < TraceCounters::N_BOUNCE_BINS; ++i)
+                histogram[i] = float(counters.bounces(i) / paths);
+            ImGui::PlotHistogram("Bounces", histogram, TraceCounters::N_BOUNCE_BINS, 0, 0, 0.f, FLT_MAX, ImVec2(0, 60));
+        }
         ImGui::Separator();
         if (ImGui::Checkbox("Environment", &renderer->show_environment)) renderer->reset();
         if (ImGui::DragFloat("Env strength", &renderer->environment->strength, 0.01f, 0.f, 1000.f)) renderer->reset();
         if (ImGui::Button("White background")) {
-            glm::vec3 color(1);
-            renderer->environment = std::make_shared<Environment>(Texture2D("white_background", 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT, &color.x));
+            renderer->environment = std::make_shared<Environment>(glm::vec3(1));
             renderer->reset();
         }
         ImGui::Separator();
@@ -193,8 +266,18 @@ void gui_callback(void) {
         if (ImGui::DragFloat("Density scale", &renderer->density_scale, 0.1f, 0.f, 1e6f)) renderer->reset();
         if (ImGui::DragFloat("Emission scale", &renderer->emission_scale, 0.1f, 0.f, 1e6f)) renderer->reset();
         if (ImGui::SliderFloat("Phase g", &renderer->phase, -.95f, .95f)) renderer->reset();
-        size_t frame_min = 0, frame_max = renderer->volume->n_grid_frames() - 1;
-        if (ImGui::SliderScalar("Grid frame", ImGuiDataType_U64, &renderer->volume->grid_frame_counter, &frame_min, &frame_max)) renderer->reset();
+        size_t frame = renderer->current_frame(), frame_min = 0, frame_max = renderer->n_frames() - 1;
+        if (ImGui::SliderScalar("Grid frame", ImGuiDataType_U64, &frame, &frame_min, &frame_max)) {
+            renderer->set_frame(frame);
+            renderer->reset();
+        }
+        if (renderer->stream)
+            ImGui::Text("Streaming: %lu frames resident (%.1f MB)", renderer->stream->resident_frames(), renderer->stream->resident_bytes() / 1e6);
+        if (auto gl = std::dynamic_pointer_cast<RendererOpenGL>(renderer)) {
+            const BrickResidency& res = gl->residency;
+            ImGui::Text("VRAM: %lu / %lu frames resident (%.1f MB)", res.resident_frames, res.size(), res.resident_bytes / 1e6);
+            ImGui::Text("hits: %lu, misses: %lu, evictions: %lu", res.hits, res.misses, res.evictions);
+        }
         ImGui::Checkbox("Animate Volume", &animate);
         ImGui::SameLine();
         ImGui::DragFloat("FPS", &animation_fps, 0.01, 1, 60);
@@ -256,6 +339,10 @@ void gui_callback(void) {
                     renderer->transferfunc->write_to_file("tf_lut.txt");
             if (ImGui::DragFloat("Window left", &renderer->transferfunc->window_left, 0.01f, -1.f, 1.f)) renderer->reset();
             if (ImGui::DragFloat("Window width", &renderer->transferfunc->window_width, 0.01f, 0.f, 1.f)) renderer->reset();
+            if (ImGui::Checkbox("DVR", &renderer->dvr)) renderer->reset();
+            ImGui::SameLine();
+            if (ImGui::Checkbox("Pre-integrated", &renderer->dvr_preintegrated)) renderer->reset();
+            if (ImGui::SliderInt("DVR steps", &renderer->dvr_steps, 1, 1024)) renderer->reset();
         }
         ImGui::Separator();
         if (ImGui::SliderFloat("Vol crop min X", &renderer->vol_clip_min.x, 0.f, 1.f)) renderer->reset();
@@ -264,6 +351,13 @@ void gui_callback(void) {
         if (ImGui::SliderFloat("Vol crop max X", &renderer->vol_clip_max.x, 0.f, 1.f)) renderer->reset();
         if (ImGui::SliderFloat("Vol crop max Y", &renderer->vol_clip_max.y, 0.f, 1.f)) renderer->reset();
         if (ImGui::SliderFloat("Vol crop max Z", &renderer->vol_clip_max.z, 0.f, 1.f)) renderer->reset();
+        if (ImGui::Checkbox("Tight bounds", &renderer->tight_bounds)) renderer->reset();
+        const int prev_lod_mode = renderer->lod_mode;
+        if (ImGui::Combo("LOD", &renderer->lod_mode, "Off\0Biased\0Unbiased\0")) {
+            if (prev_lod_mode == 0) renderer->commit(); // build coarser levels
+            renderer->reset();
+        }
+        if (renderer->lod_mode != 0 && ImGui::DragFloat("LOD quality", &renderer->lod_quality, 0.01f, 0.01f, 100.f)) renderer->reset();
         ImGui::Separator();
         ImGui::Text("Modelmatrix:");
         glm::mat4 row_maj = glm::transpose(renderer->volume->transform);
@@ -310,7 +404,7 @@ void gui_callback(void) {
 // command line options
 
 // parse gl cmd line args
-static void init_opengl_from_args(int argc, char** argv) {
+static ContextParameters parse_context_params(int argc, char** argv) {
     // collect args
     ContextParameters params;
     params.title = "VolRen";
@@ -347,11 +441,38 @@ static void init_opengl_from_args(int argc, char** argv) {
         else if (arg == "--fontsize")
             params.font_size_pixels = std::stoi(argv[++i]);
     }
+    return params;
+}
+
+// restrict render resolution to the tile (if any) of the image size given by the context parameters
+static void apply_tile(ContextParameters& params) {
+    if (n_tiles <= 1) return;
+    const auto [y, h] = tile_rows(params.height, tile_index, n_tiles);
+    image_offset = glm::ivec2(0, y);
+    image_size = glm::ivec2(params.width, params.height);
+    params.height = h;
+}
+
+// create gl context from cmd line args
+static void init_opengl_from_args(int argc, char** argv) {
+    ContextParameters params = parse_context_params(argc, argv);
+    apply_tile(params);
+    if (headless) {
+        headless_init(params.width, params.height, params.gl_major, params.gl_minor);
+        return;
+    }
     // create context
     try  {
         Context::init(params);
     } catch (std::runtime_error& e) {
         std::cerr << "Failed to create context: " << e.what() << std::endl;
+        if (!interactive) {
+            // no window system available (e.g. container), fall back to headless context
+            std::cerr << "Retrying headless..." << std::endl;
+            headless = true;
+            headless_init(params.width, params.height, params.gl_major, params.gl_minor);
+            return;
+        }
         std::cerr << "Retrying for offline rendering..." << std::endl;
         params.visible = GLFW_FALSE;
         Context::init(params);
@@ -364,8 +485,45 @@ static void parse_cmd(int argc, char** argv) {
         const std::string arg = argv[i];
         if (arg == "--render") {
             interactive = false;
+        } else if (arg == "--backend" || arg == "--cache-dir" || arg == "--cache-size" || arg == "--stream" || arg == "--stream-budget" || arg == "--vram-budget" || arg == "--tile" ||
+                arg == "--lod" || arg == "--lod-levels" || arg == "--lod-quality") {
+            ++i; // handled in init_renderer_from_args()
+        } else if (arg == "--no-cache" || arg == "--headless" || arg == "--no-timings") {
+            // handled in init_renderer_from_args()
+        } else if (arg == "--threads") {
+            if (auto cpu = std::dynamic_pointer_cast<RendererCPU>(renderer))
+                cpu->n_threads = std::stoi(argv[++i]);
+            else
+                ++i;
         } else if (arg == "--output") {
             out_filename = argv[++i];
+        } else if (arg == "--adaptive") {
+            renderer->adaptive = true;
+            renderer->adaptive_threshold = std::stof(argv[++i]);
+        } else if (arg == "--dvr") {
+            renderer->dvr = true;
+            renderer->dvr_steps = std::stoi(argv[++i]);
+        } else if (arg == "--dvr-points") {
+            renderer->dvr = true;
+            renderer->dvr_preintegrated = false;
+            renderer->dvr_steps = std::stoi(argv[++i]);
+        } else if (arg == "--exr") {
+            write_exr = true;
+        } else if (arg == "--exr-float") {
+            write_exr = true;
+            exr_half = false;
+        } else if (arg == "--checkpoint") { // in s
+            checkpoint_interval_s = std::stof(argv[++i]);
+        } else if (arg == "--resume") {
+            resume = true;
+        } else if (arg == "--frames") {
+            frame_range = FrameRange::parse(argv[++i]);
+        } else if (arg == "--frames-in-flight") {
+            frames_in_flight = std::stoul(argv[++i]);
+        } else if (arg == "--batch") {
+            renderer->samples_per_dispatch = std::stoi(argv[++i]);
+        } else if (arg == "--dispatch-limit") { // in ms
+            dispatch_limit_ms = std::stof(argv[++i]);
         } else if (arg == "--samples" || arg == "--spp" || arg == "--sppx") {
             renderer->sppx = std::stoi(argv[++i]);
         } else if (arg == "--bounces") {
@@ -430,31 +588,175 @@ static void parse_cmd(int argc, char** argv) {
             renderer->vol_clip_max.x = std::stof(argv[++i]);
             renderer->vol_clip_max.y = std::stof(argv[++i]);
             renderer->vol_clip_max.z = std::stof(argv[++i]);
+        } else if (arg == "--no-tight-bounds") {
+            renderer->tight_bounds = false;
+        } else if (arg == "--counters") {
+            renderer->instrumented = true;
         } else if (fs::is_regular_file(argv[i]) || fs::is_directory(argv[i])) {
             handle_path(argv[i]);
         }
     }
+    // independent of the argument order, an explicit --checkpoint always wins
+    if (checkpoint_interval_s < 0)
+        checkpoint_interval_s = resume ? 600 : 0;
+}
+
+// select backend and create renderer (and OpenGL context, if required)
+static void init_renderer_from_args(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--backend")
+            backend = argv[++i];
+        else if (arg == "--render")
+            interactive = false;
+        else if (arg == "--headless") {
+            interactive = false;
+            headless = true;
+        }
+        else if (arg == "--no-timings")
+            write_timings = false;
+        else if (arg == "--tile") { // i/n
+            const std::string tile = argv[++i];
+            tile_index = std::stoi(tile.substr(0, tile.find('/')));
+            n_tiles = tile.find('/') == std::string::npos ? 1 : std::stoi(tile.substr(tile.find('/') + 1));
+            if (n_tiles < 1 || tile_index < 0 || tile_index >= n_tiles)
+                throw std::runtime_error("Invalid tile: " + tile + " (expected i/n with 0 <= i < n)");
+        }
+        // brick (and envmap) cache settings, before any volume is loaded
+        else if (arg == "--cache-dir")
+            BrickCache::directory = argv[++i];
+        else if (arg == "--cache-size") // in GB
+            BrickCache::max_bytes = size_t(std::stod(argv[++i]) * (1 << 30));
+        else if (arg == "--no-cache") {
+            BrickCache::enabled = false;
+            EnvironmentCache::persist = false;
+        }
+        // streaming settings
+        else if (arg == "--stream")
+            stream_window = std::stoul(argv[++i]);
+        else if (arg == "--stream-budget") // in MB
+            stream_budget_mb = std::stoul(argv[++i]);
+        else if (arg == "--vram-budget") // in MB
+            vram_budget_mb = std::stoul(argv[++i]);
+        // level of detail settings, before any volume is committed
+        else if (arg == "--lod")
+            lod_mode = std::stoi(argv[++i]);
+        else if (arg == "--lod-levels")
+            lod_levels = std::stoi(argv[++i]);
+        else if (arg == "--lod-quality")
+            lod_quality = std::stof(argv[++i]);
+    }
+    if (backend == "gl") {
+        init_opengl_from_args(argc, argv);
+        auto gl = std::make_shared<RendererOpenGL>();
+        gl->residency.budget_bytes = vram_budget_mb << 20;
+        renderer = gl;
+    } else if (backend == "cpu") {
+        renderer = std::make_shared<RendererCPU>();
+        if (interactive) // OpenGL for display only
+            init_opengl_from_args(argc, argv);
+        else {
+            ContextParameters params = parse_context_params(argc, argv);
+            apply_tile(params);
+            renderer->resize(params.width, params.height);
+        }
+    } else
+        throw std::runtime_error("Unknown backend: " + backend);
+    renderer->image_offset = image_offset;
+    renderer->image_size = image_size;
+    renderer->lod_mode = lod_mode;
+    renderer->lod_levels = lod_levels;
+    renderer->lod_quality = lod_quality;
+    // time loading and setup as well
+    Telemetry::enabled = !interactive && write_timings;
+}
+
+// coordinator mode (--workers): run the offline render as shards in worker processes with the remaining args
+static int run_coordinator(int argc, char** argv) {
+    ShardCoordinator coordinator;
+    coordinator.executable = fs::read_symlink("/proc/self/exe").string();
+    bool offline = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        // coordinator settings
+        if (arg == "--workers")
+            coordinator.n_workers = std::stoul(argv[++i]);
+        else if (arg == "--tiles")
+            coordinator.n_tiles = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--retries")
+            coordinator.max_retries = std::stoi(argv[++i]);
+        else if (arg == "--hosts") { // comma separated
+            std::stringstream hosts(argv[++i]);
+            for (std::string host; std::getline(hosts, host, ',');)
+                if (!host.empty()) coordinator.hosts.push_back(host);
+        } else if (arg == "--frames")
+            coordinator.frames = FrameRange::parse(argv[++i]);
+        else if (arg == "--tile")
+            ++i;
+        else {
+            // worker args, some also needed for stitching
+            coordinator.worker_args.push_back(arg);
+            if (arg == "--render" || arg == "--headless")
+                offline = true;
+            else if (arg == "--output" && i + 1 < argc)
+                coordinator.out_stem = fs::path(argv[i + 1]).stem().string();
+            else if (arg == "--exr" || arg == "--exr-float") {
+                coordinator.exr = true;
+                coordinator.exr_half = arg == "--exr";
+            } else if (arg == "--exposure" && i + 1 < argc)
+                coordinator.exposure = std::stof(argv[i + 1]);
+            else if (arg == "--gamma" && i + 1 < argc)
+                coordinator.gamma = std::stof(argv[i + 1]);
+        }
+    }
+    const auto output = std::find(coordinator.worker_args.begin(), coordinator.worker_args.end(), "--output");
+    const std::string extension = output != coordinator.worker_args.end() && output + 1 != coordinator.worker_args.end() ? fs::path(*(output + 1)).extension().string() : ".png";
+    coordinator.png = extension != ".exr";
+    coordinator.exr = coordinator.exr || extension == ".exr";
+    if (!offline)
+        coordinator.worker_args.push_back("--render");
+    coordinator.resume = std::find(coordinator.worker_args.begin(), coordinator.worker_args.end(), "--resume") != coordinator.worker_args.end();
+    // number of frames of the input volume (as in handle_path(): the last volume file or folder, scripts may load anything)
+    for (size_t i = 0; i < coordinator.worker_args.size(); ++i) {
+        const std::string& arg = coordinator.worker_args[i];
+        const fs::path path(arg);
+        if (i > 0 && (coordinator.worker_args[i - 1] == "--output" || coordinator.worker_args[i - 1] == "--cache-dir"))
+            continue;
+        else if (path.extension() == ".py" && fs::is_regular_file(path)) {
+            coordinator.n_frames = 0;
+            break;
+        } else if (fs::is_directory(path))
+            coordinator.n_frames = list_frame_files(arg).size();
+        else if (fs::is_regular_file(path) && path.extension() != ".hdr" && path.extension() != ".txt")
+            coordinator.n_frames = 1;
+    }
+    if (coordinator.n_tiles > 1) // lossless tiles
+        coordinator.worker_args.push_back("--exr-float");
+    return coordinator.run();
 }
 
 // ------------------------------------------
 // main
 
 int main(int argc, char** argv) {
-    // initialize OpenGL
-    init_opengl_from_args(argc, argv);
+    // distribute offline rendering across worker processes?
+    if (std::find_if(argv + 1, argv + argc, [](const char* arg) { return std::string(arg) == "--workers"; }) != argv + argc)
+        return run_coordinator(argc, argv);
 
-    // initialize Renderer
-    renderer = std::make_shared<RendererOpenGL>();
+    // initialize OpenGL and Renderer
+    init_renderer_from_args(argc, argv);
     renderer->init();
 
-    // install callbacks for interactive mode
-    Context::set_resize_callback(resize_callback);
-    Context::set_keyboard_callback(keyboard_callback);
-    Context::set_mouse_button_callback(mouse_button_callback);
-    Context::set_mouse_callback(mouse_callback);
-    gui_add_callback("vol_gui", gui_callback);
-    glfwSetDropCallback(Context::instance().glfw_window, drag_drop_callback);
-    Context::swap_buffers(); // fetch updates once
+    // install callbacks for interactive mode (only with a window)
+    if (gl_window_current()) {
+        Context::set_resize_callback(resize_callback);
+        Context::set_keyboard_callback(keyboard_callback);
+        Context::set_mouse_button_callback(mouse_button_callback);
+        Context::set_mouse_callback(mouse_callback);
+        gui_add_callback("vol_gui", gui_callback);
+        glfwSetDropCallback(Context::instance().glfw_window, drag_drop_callback);
+        Context::swap_buffers(); // fetch updates once
+    }
 
     // default cam pos
     current_camera()->pos = glm::vec3(1, 0, 1);
@@ -501,7 +803,7 @@ int main(int argc, char** argv) {
                 animation_timer -= Context::frame_time();
                 if (animation_timer <= 0) {
                     animation_timer = 1000 / animation_fps;
-                    renderer->volume->grid_frame_counter = (renderer->volume->grid_frame_counter + 1) % renderer->volume->n_grid_frames();
+                    renderer->set_frame((renderer->current_frame() + 1) % renderer->n_frames());
                     renderer->reset();
                 }
             }
@@ -512,7 +814,7 @@ int main(int argc, char** argv) {
                 renderer->trace();
                 timer_trace->end();
                 if (renderer->sample == renderer->sppx)
-                    renderer->color->save_ldr(out_filename, true, true); // TODO: apply tonemapping?
+                    renderer->save(out_filename, false); // TODO: apply tonemapping?
             } else
                 glfwWaitEventsTimeout(1.f / 10); // 10fps idle
 
@@ -525,37 +827,139 @@ int main(int argc, char** argv) {
         }
     } else {
         // prepare rendering
-        current_camera()->update();
-        reload_modified_shaders();
+        if (gl_context_current()) {
+            gl_update_camera();
+            reload_modified_shaders();
+        }
+        // asynchronous readback and writing of results (frame i is written while frame i+1 renders)
+        FrameOutput output(frames_in_flight);
+        output.format.exr = write_exr || fs::path(out_filename).extension() == ".exr";
+        output.format.png = fs::path(out_filename).extension() != ".exr";
+        output.format.exr_half = exr_half;
+        // tiles are written as raw accumulation buffers only, to be stitched (see ShardCoordinator)
+        std::string out_stem = fs::path(out_filename).stem().string();
+        if (n_tiles > 1) {
+            out_stem = tile_stem(out_stem, tile_index);
+            output.format.png = false;
+            output.format.exr = true;
+        }
+        // timing log: csv is appended per frame (as stages complete), json written at the end
+        // (per shard: tiles are told apart by their stem, interleaved frame ranges by first frame and step)
+        std::string timings_basename = out_stem + "_timings";
+        if (!frame_range.all())
+            timings_basename += "_frames" + std::to_string(frame_range.first) + "-" + std::to_string(frame_range.step);
+        std::vector<Telemetry::Stage> timings;
+        const auto log_timings = [&]() {
+            if (!Telemetry::enabled) return;
+            const std::vector<Telemetry::Stage> stages = Telemetry::collect();
+            Telemetry::merge(timings, stages);
+            Telemetry::append_csv(timings_basename + ".csv", stages);
+        };
+        if (Telemetry::enabled && !resume)
+            fs::remove(timings_basename + ".csv");
+        log_timings();
+        // checkpoints: per frame, removed once the writer of the frame completed
+        // on SIGTERM (e.g. preemption) or SIGINT, a final checkpoint is written before exiting
+        const auto remove_written_checkpoints = [&]() {
+            for (const std::string& written : output.take_written())
+                if (checkpoint_interval_s > 0) fs::remove(written + ".checkpoint");
+        };
+        if (checkpoint_interval_s > 0) {
+            std::signal(SIGTERM, terminate_handler);
+            std::signal(SIGINT, terminate_handler);
+        }
         // render
         std::cout << "rendering..." << std::endl;
-        for (int i = 0; i < renderer->volume->n_grid_frames(); ++i) {
+        for (size_t i = frame_range.first; i < std::min(frame_range.last, renderer->n_frames()) && !terminate_signal; i += frame_range.step) {
+            const size_t n_zero = 6;
+            const std::string frame_id = std::string(n_zero - std::min(n_zero, std::to_string(i).length()), '0') + std::to_string(i);
+            const std::string basename = out_stem + "_" + frame_id;
+            if (resume && (!output.format.png || fs::exists(basename + ".png")) && (!output.format.exr || fs::exists(basename + ".exr"))) {
+                std::cout << "frame " << i << ": already written, skipped" << std::endl;
+                continue;
+            }
+            Telemetry::frame = i;
             renderer->reset();
-            renderer->volume->grid_frame_counter = i;
+            renderer->set_frame(i);
+            const std::string checkpoint = basename + ".checkpoint";
+            const uint64_t scene_hash = checkpoint_interval_s > 0 ? renderer->scene_hash(scene_sources) : 0;
+            if (resume && renderer->load_checkpoint(checkpoint, scene_hash))
+                std::cout << "frame " << i << ": resumed from " << checkpoint << " at " << renderer->sample << " / " << renderer->sppx << std::endl;
+            const uint64_t resumed_samples = renderer->pixel_samples;
+            const auto t_start = std::chrono::steady_clock::now();
+            auto t_checkpoint = t_start;
+            auto t_signaled = t_start;
+            GLsync fence = 0;
+            // wait for fenced batch, reduce batch size if its GPU time exceeds the dispatch limit
+            const auto wait_for = [&](GLsync sync) {
+                while (glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+                glDeleteSync(sync);
+                const auto t_now = std::chrono::steady_clock::now();
+                const float batch_ms = std::chrono::duration<float, std::milli>(t_now - t_signaled).count();
+                t_signaled = t_now;
+                if (batch_ms > dispatch_limit_ms && renderer->samples_per_dispatch > 1) {
+                    renderer->samples_per_dispatch = std::max(1, renderer->samples_per_dispatch / 2);
+                    std::cout << "batch took " << batch_ms << "ms, reducing to " << renderer->samples_per_dispatch << " samples per dispatch" << std::endl;
+                }
+            };
             while (renderer->sample < renderer->sppx) {
                 renderer->trace();
                 std::cout << renderer->sample << " / " << renderer->sppx << "\r" << std::flush;
-                Context::swap_buffers(); // sync (this is required for >= 1024spp)
+                if (gl_context_current()) {
+                    // keep at most one batch in flight: wait for the previous while the current one is queued
+                    GLsync next = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                    if (fence) wait_for(fence);
+                    fence = next;
+                    output.poll();
+                }
+                // periodic checkpoint (syncs), or final one when terminated
+                if (checkpoint_interval_s > 0 && renderer->sample < renderer->sppx &&
+                        (terminate_signal || std::chrono::duration<float>(std::chrono::steady_clock::now() - t_checkpoint).count() >= checkpoint_interval_s)) {
+                    renderer->save_checkpoint(checkpoint, scene_hash);
+                    t_checkpoint = std::chrono::steady_clock::now();
+                    std::cout << "checkpoint at " << renderer->sample << " / " << renderer->sppx << " written to " << checkpoint << std::endl;
+                    if (terminate_signal) break;
+                }
             }
-            glMemoryBarrier(GL_ALL_BARRIER_BITS);
-            // tonemap
-            static Shader tonemap_shader("tonemap", "shader/tonemap.glsl");
-            tonemap_shader->bind();
-            renderer->color->bind_image(0, GL_READ_WRITE, GL_RGBA32F);
-            const glm::ivec2 resolution = Context::resolution();
-            tonemap_shader->uniform("resolution", resolution);
-            tonemap_shader->uniform("exposure", renderer->tonemap_exposure);
-            tonemap_shader->uniform("gamma", renderer->tonemap_gamma);
-            tonemap_shader->dispatch_compute(resolution.x, resolution.y);
-            renderer->color->unbind_image(0);
-            tonemap_shader->unbind();
-            glMemoryBarrier(GL_ALL_BARRIER_BITS);
-            // write result
-            const size_t n_zero = 6;
-            std::string out_fn = fs::path(out_filename).stem().string() + "_" + std::string(n_zero - std::min(n_zero, std::to_string(i).length()), '0') + std::to_string(i) + ".png";
-            renderer->color->save_ldr(out_fn);
-            std::cout << out_fn << " written." << std::endl;
-            Context::swap_buffers();
+            if (fence) wait_for(fence);
+            if (renderer->sample < renderer->sppx) break; // terminated
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+            const glm::ivec2 res = render_resolution();
+            const uint64_t traced = renderer->pixel_samples - resumed_samples;
+            const double spp = double(traced) / std::max(1, res.x * res.y);
+            std::cout << "frame " << i << ": " << spp << " spp in " << seconds << "s (" << spp / seconds << " spp/s, " <<
+                traced / seconds / 1e6 << " M samples/s)" << std::endl;
+            // queue result for tonemapping and writing
+            output.format.tonemap = renderer->tonemapping;
+            output.format.exposure = renderer->tonemap_exposure;
+            output.format.gamma = renderer->tonemap_gamma;
+            if (auto cpu = std::dynamic_pointer_cast<RendererCPU>(renderer))
+                output.write(cpu->color, cpu->resolution.x, cpu->resolution.y, basename);
+            else
+                output.write(std::static_pointer_cast<RendererOpenGL>(renderer)->color, basename);
+            if (renderer->adaptive) // sample counts per pixel
+                renderer->save_heatmap(out_stem + "_spp_" + frame_id + ".png");
+            if (renderer->instrumented) { // hot-path counters
+                renderer->read_counters();
+                std::ofstream(out_stem + "_counters_" + frame_id + ".json") << renderer->counters.json(renderer->pixel_samples);
+            }
+            if (gl_context_current())
+                gl_swap_buffers();
+            log_timings();
+            remove_written_checkpoints();
+        }
+        output.finish();
+        remove_written_checkpoints();
+        log_timings();
+        if (Telemetry::enabled) {
+            Telemetry::write_json(timings_basename + ".json", timings);
+            std::cout << timings_basename << ".json/.csv written." << std::endl;
+        }
+        if (terminate_signal) {
+            std::cerr << "terminated by signal " << terminate_signal << ", continue with --resume" << std::endl;
+            headless_shutdown();
+            return 128 + terminate_signal;
         }
     }
+    headless_shutdown();
 }
@@ -0,0 +1,114 @@
+#include "readback.h"
+#include "glcontext.h"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <glm/gtc/packing.hpp>
+
+using namespace cppgl;
+
+// -----------------------------------------------------------
+// ImageReadback
+
+ImageReadback::ImageReadback(size_t n_slots) : slots(std::max(size_t(1), n_slots)) {}
+
+ImageReadback::~ImageReadback() {
+    if (!gl_context_current()) return;
+    for (auto& slot : slots) {
+        if (slot.fence) glDeleteSync(slot.fence);
+        if (!slot.buffer) continue;
+        glUnmapNamedBuffer(slot.buffer);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+uint64_t ImageReadback::request(const Texture2D& color, const Format& format) {
+    auto it = std::find_if(slots.begin(), slots.end(), [](const Slot& slot) { return !slot.fence; });
+    if (it == slots.end())
+        throw std::runtime_error("ImageReadback: too many pending requests (" + std::to_string(slots.size()) + "), wait for one first");
+    Slot& slot = *it;
+    // (re-)allocate persistently mapped buffer, rounded up to whole words
+    const size_t bytes = format.bytes(color->w, color->h);
+    if (slot.capacity < bytes) {
+        if (slot.buffer) {
+            glUnmapNamedBuffer(slot.buffer);
+            glDeleteBuffers(1, &slot.buffer);
+        }
+        const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        slot.capacity = (bytes + 3) & ~size_t(3);
+        glCreateBuffers(1, &slot.buffer);
+        glNamedBufferStorage(slot.buffer, slot.capacity, nullptr, flags);
+        slot.data = glMapNamedBufferRange(slot.buffer, 0, slot.capacity, flags);
+    }
+    if (!shader)
+        shader = Shader("readback", "shader/readback.glsl");
+    // convert, one invocation per word
+    const size_t n_words = format.half ? (size_t(color->w) * color->h * format.channels() + 1) / 2 : size_t(color->w) * color->h * format.channels();
+    const uint32_t n_groups = uint32_t((n_words + 255) / 256);
+    const uint32_t n_groups_x = std::min(n_groups, 65535u);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    shader->bind();
+    color->bind_image(0, GL_READ_ONLY, GL_RGBA32F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, slot.buffer);
+    shader->uniform("resolution", glm::ivec2(color->w, color->h));
+    shader->uniform("channels", int(format.channels()));
+    shader->uniform("half_float", format.half ? 1 : 0);
+    shader->uniform("planar", format.planar ? 1 : 0);
+    shader->uniform("flip", format.flip ? 1 : 0);
+    glDispatchCompute(n_groups_x, (n_groups + n_groups_x - 1) / n_groups_x, 1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    color->unbind_image(0);
+    shader->unbind();
+    // coherent mapping: visible to the host once the fence signaled, following trace() calls may overwrite color
+    glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    slot.bytes = bytes;
+    slot.format = format;
+    slot.size = glm::uvec2(color->w, color->h);
+    slot.id = next_id++;
+    return slot.id;
+}
+
+bool ImageReadback::pending(uint64_t id, Format& format, glm::uvec2& size) const {
+    auto it = std::find_if(slots.begin(), slots.end(), [&](const Slot& slot) { return slot.fence && slot.id == id; });
+    if (it == slots.end()) return false;
+    format = it->format;
+    size = it->size;
+    return true;
+}
+
+void ImageReadback::wait(uint64_t id, void* dst, size_t bytes) {
+    auto it = std::find_if(slots.begin(), slots.end(), [&](const Slot& slot) { return slot.fence && slot.id == id; });
+    if (it == slots.end())
+        throw std::runtime_error("ImageReadback: no pending request with id " + std::to_string(id));
+    Slot& slot = *it;
+    if (bytes != slot.bytes)
+        throw std::runtime_error("ImageReadback: destination size (" + std::to_string(bytes) + " bytes) does not match result (" + std::to_string(slot.bytes) + " bytes)");
+    while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    memcpy(dst, slot.data, bytes);
+}
+
+void ImageReadback::read(const Texture2D& color, const Format& format, void* dst, size_t bytes) {
+    wait(request(color, format), dst, bytes);
+}
+
+void ImageReadback::convert(const glm::vec4* rgba, uint32_t w, uint32_t h, const Format& format, void* dst) {
+    const uint32_t channels = format.channels();
+    const size_t n_pixels = size_t(w) * h;
+    for (uint32_t y = 0; y < h; ++y) {
+        const glm::vec4* row = rgba + size_t(format.flip ? h - 1 - y : y) * w;
+        for (uint32_t x = 0; x < w; ++x) {
+            const size_t p = size_t(y) * w + x;
+            for (uint32_t c = 0; c < channels; ++c) {
+                const size_t e = format.planar ? c * n_pixels + p : p * channels + c;
+                if (format.half)
+                    ((uint16_t*)dst)[e] = uint16_t(glm::packHalf1x16(row[x][c]));
+                else
+                    ((float*)dst)[e] = row[x][c];
+            }
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <cppgl.h>
+
+// --------------------------------------------------------------
+// readback of RGBA32F images into caller provided host memory: a compute pass converts to fp32 or fp16 with 3 or 4 channels
+// into persistently mapped buffers. requests are fenced, so rendering continues while they are pending,
+// the only copy is from the mapped buffer to the destination when a request is waited for
+
+class ImageReadback {
+public:
+    struct Format {
+        bool half = false;              // fp16 instead of fp32
+        bool alpha = false;             // rgba instead of rgb
+        bool planar = false;            // channel planes (chw) instead of interleaved channels (hwc)
+        bool flip = true;               // rows top-down (as in image files and numpy) instead of bottom-up (as in OpenGL)
+
+        uint32_t channels() const { return alpha ? 4 : 3; }
+        size_t bytes(uint32_t w, uint32_t h) const { return size_t(w) * h * channels() * (half ? 2 : 4); }
+    };
+
+    ImageReadback(size_t n_slots = 3);
+    ~ImageReadback();
+
+    ImageReadback(const ImageReadback&) = delete;
+    ImageReadback& operator=(const ImageReadback&) = delete;
+
+    // queue conversion of color (requires a current OpenGL context), returns request id
+    // throws if n_slots requests are already pending
+    uint64_t request(const cppgl::Texture2D& color, const Format& format);
+    // format and image size of a pending request, false if there is none with this id
+    bool pending(uint64_t id, Format& format, glm::uvec2& size) const;
+    // wait for request and copy its result to dst (size: format.bytes(w, h) of the request)
+    void wait(uint64_t id, void* dst, size_t bytes);
+    // request and wait
+    void read(const cppgl::Texture2D& color, const Format& format, void* dst, size_t bytes);
+    // max. number of pending requests
+    size_t n_slots() const { return slots.size(); }
+
+    // same conversion for host images (rows bottom-up)
+    static void convert(const glm::vec4* rgba, uint32_t w, uint32_t h, const Format& format, void* dst);
+
+private:
+    struct Slot {
+        GLuint buffer = 0;
+        void* data = nullptr;           // persistent mapping of buffer
+        size_t capacity = 0;
+        size_t bytes = 0;               // size of the pending result
+        Format format;                  // of the pending result
+        glm::uvec2 size = glm::uvec2(0);
+        GLsync fence = 0;               // request pending
+        uint64_t id = 0;
+    };
+
+    std::vector<Slot> slots;
+    uint64_t next_id = 1;
+    cppgl::Shader shader;
+};
@@ -0,0 +1,73 @@
+#include "render_batch.h"
+#include "renderer_cpu.h"
+#include "glcontext.h"
+#include <deque>
+
+using namespace cppgl;
+
+static void apply(Renderer& renderer, const RenderJob& job) {
+    if (job.cam_pos) current_camera()->pos = *job.cam_pos;
+    if (job.cam_dir) current_camera()->dir = glm::normalize(*job.cam_dir);
+    if (job.cam_fov) current_camera()->fov_degree = *job.cam_fov;
+    if (job.volume && job.volume != renderer.volume) {
+        renderer.stream.reset();
+        renderer.volume = job.volume;
+        renderer.commit();
+    }
+    if (job.frame) renderer.set_frame(*job.frame);
+    if (job.albedo) renderer.albedo = *job.albedo;
+    if (job.phase) renderer.phase = *job.phase;
+    if (job.density_scale) renderer.density_scale = *job.density_scale;
+    if (job.emission_scale) renderer.emission_scale = *job.emission_scale;
+    if (job.transferfunc) renderer.transferfunc = *job.transferfunc;
+    if (job.environment) renderer.environment = job.environment;
+    if (job.env_strength) renderer.environment->strength = *job.env_strength;
+    if (job.show_environment) renderer.show_environment = *job.show_environment;
+    if (job.seed) renderer.seed = *job.seed;
+    if (job.bounces) renderer.bounces = *job.bounces;
+}
+
+void render_batch(Renderer& renderer, const std::vector<RenderJob>& jobs, const ImageReadback::Format& format, void* out) {
+    auto cpu = dynamic_cast<RendererCPU*>(&renderer);
+    auto gl = dynamic_cast<RendererOpenGL*>(&renderer);
+    const glm::ivec2 res = cpu ? glm::ivec2(cpu->resolution) : gl_resolution();
+    const size_t image_bytes = format.bytes(res.x, res.y);
+    // pending readbacks (id, job), at most one per readback slot
+    std::deque<std::pair<uint64_t, size_t>> pending;
+    const auto wait_oldest = [&]() {
+        gl->readback.wait(pending.front().first, (uint8_t*)out + pending.front().second * image_bytes, image_bytes);
+        pending.pop_front();
+    };
+    const int sppx = renderer.sppx;
+    try {
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            apply(renderer, jobs[i]);
+            if (gl) gl_update_camera();
+            renderer.reset();
+            renderer.sppx = jobs[i].spp.value_or(sppx); // limits batch size and adaptive early stop
+            while (renderer.sample < renderer.sppx)
+                renderer.trace();
+            if (gl) {
+                if (pending.size() >= gl->readback.n_slots())
+                    wait_oldest();
+                pending.emplace_back(gl->readback.request(gl->color, format), i);
+                gl_swap_buffers(); // submit, keep window responsive
+            } else
+                ImageReadback::convert(cpu->color.data(), res.x, res.y, format, (uint8_t*)out + i * image_bytes);
+        }
+        while (!pending.empty())
+            wait_oldest();
+    } catch (...) {
+        // restore settings and drain queued readbacks, so their slots are free for following requests
+        renderer.sppx = sppx;
+        while (!pending.empty()) {
+            try {
+                wait_oldest();
+            } catch (...) {
+                pending.pop_front();
+            }
+        }
+        throw;
+    }
+    renderer.sppx = sppx;
+}
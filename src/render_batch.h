@@ -0,0 +1,31 @@
+#pragma once
+
+#include <optional>
+#include "renderer.h"
+#include "readback.h"
+
+// --------------------------------------------------------------
+// batched rendering for dataset generation: jobs are rendered back-to-back and each result is read back while the
+// following jobs render (OpenGL: fenced GPU conversion). unset parameters keep the current settings, the parameters
+// of the last job stay set afterwards (as with the equivalent sequence of single renders)
+
+struct RenderJob {
+    // camera
+    std::optional<glm::vec3> cam_pos, cam_dir;
+    std::optional<float> cam_fov;
+    // volume
+    std::shared_ptr<voldata::Volume> volume;                        // committed if it differs from the current volume
+    std::optional<size_t> frame;
+    std::optional<glm::vec3> albedo;
+    std::optional<float> phase, density_scale, emission_scale;
+    std::optional<std::shared_ptr<TransferFunction>> transferfunc;  // nullptr: no transfer function
+    // environment
+    std::shared_ptr<Environment> environment;
+    std::optional<float> env_strength;
+    std::optional<bool> show_environment;
+    // sampling
+    std::optional<int> seed, spp, bounces;
+};
+
+// render jobs into out: jobs.size() images of format.bytes(w, h) bytes each
+void render_batch(Renderer& renderer, const std::vector<RenderJob>& jobs, const ImageReadback::Format& format, void* out);
@@ -1,4 +1,10 @@
 #include "renderer.h"
+#include "volume_loader.h"
+#include "telemetry.h"
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <typeinfo>
 
 using namespace cppgl;
 
@@ -23,68 +29,155 @@ void tonemap(const Texture2D& tex, float exposure, float gamma) {
     tonemap_shader->unbind();
 }
 
+void save_sample_heatmap(const std::string& filename, const std::vector<float>& counts, uint32_t w, uint32_t h, int sppx) {
+    std::vector<uint8_t> pixels(counts.size() * 3);
+    double sum = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        const auto col = tinycolormap::GetColor(counts[i] / std::max(1, sppx), tinycolormap::ColormapType::Turbo);
+        pixels[3 * i + 0] = col.ri();
+        pixels[3 * i + 1] = col.gi();
+        pixels[3 * i + 2] = col.bi();
+        sum += counts[i];
+    }
+    image_store_ldr(fs::path(filename), pixels.data(), w, h, 3);
+    const double avg = counts.empty() ? 0.0 : sum / counts.size();
+    std::cout << filename << " written (avg. " << avg << " spp, " << 100.0 * avg / std::max(1, sppx) << "% of " << sppx << " spp)." << std::endl;
+}
+
 // -----------------------------------------------------------
 // OpenGL renderer
 
+RendererOpenGL::~RendererOpenGL() {
+    if (tile_buffer && gl_context_current())
+        glDeleteBuffers(1, &tile_buffer);
+    if (tf_bounds_buffer && gl_context_current())
+        glDeleteBuffers(1, &tf_bounds_buffer);
+    if (counter_buffer && gl_context_current())
+        glDeleteBuffers(1, &counter_buffer);
+}
+
 void RendererOpenGL::init() {
     // load default volume
     if (!volume)
         volume = std::make_shared<voldata::Volume>();
 
     // load default environment map
-    if (!environment) {
-        glm::vec3 color(1.f);
-        environment = std::make_shared<Environment>(Texture2D("background", 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT, &color.x));
-    }
+    if (!environment)
+        environment = std::make_shared<Environment>(glm::vec3(1.f));
     // compile shaders
     if (!trace_shader)
         trace_shader = Shader("trace", "shader/pathtracer_brick.glsl");
     if (!trace_shader_tf)
         trace_shader_tf = Shader("trace_tf", "shader/pathtracer_brick_tf.glsl");
+    if (!tonemap_shader)
+        tonemap_shader = Shader("tonemap_compute", "shader/tonemap.glsl");
+    if (!adaptive_shader)
+        adaptive_shader = Shader("adaptive", "shader/adaptive.glsl");
+    if (!tf_majorant_shader)
+        tf_majorant_shader = Shader("tf_majorant", "shader/tf_majorant.glsl");
 
     // setup color texture
     if (!color) {
-        const glm::ivec2 res = Context::resolution();
+        const glm::ivec2 res = gl_resolution();
         color = Texture2D("color", res.x, res.y, GL_RGBA32F, GL_RGBA, GL_FLOAT);
     }
+    if (!stats) {
+        const glm::ivec2 res = gl_resolution();
+        stats = Texture2D("stats", res.x, res.y, GL_RGBA32F, GL_RGBA, GL_FLOAT);
+    }
+    // sampler3D units must not default to 0 (the indirection usampler3D) when there are no coarser atlas levels
+    if (!lod_fallback) {
+        const uint8_t zero = 0;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        lod_fallback = Texture3D("brick atlas lod fallback", 1, 1, 1, GL_R8, GL_RED, GL_UNSIGNED_BYTE, &zero);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
 }
 
 void RendererOpenGL::resize(uint32_t w, uint32_t h) {
     if (color) color->resize(w, h);
+    if (stats) stats->resize(w, h);
 }
 
 void RendererOpenGL::commit() {
-    density_grids.clear();
-    emission_grids.clear();
+    TimingScope scope("commit");
+    residency.clear();
+    residency.upload = [this](const HostBrickGrid& grid) { return brick_grid_to_textures(grid); };
     majorant_emission = 0.f;
-    std::cout << "Preparing brick grids for OpenGL..." << std::endl;
-    for (const auto& frame : volume->grids) {
-        voldata::Volume::GridPtr density_grid = frame.at("density");
-        density_grids.push_back(brick_grid_to_textures(voldata::Volume::to_brick_grid(density_grid)));
-        voldata::Volume::GridPtr emission_grid;
-        for (const auto& name : { "flame", "flames", "temperature" }) {
-            if (frame.find(name) != frame.end()) {
-                emission_grid = frame.at(name);
-                break;
-            }
+    atlas_error[0] = atlas_error[1] = BC4Stats();
+    const auto upload = [&](BrickFrame& frame) {
+        // BC4 encoded atlas (no-op for brick cache entries), coarser levels for level of detail
+        frame.density->encode_atlas_bc4();
+        atlas_error[0].add(frame.density->atlas_bc4_stats);
+        if (frame.emission) {
+            frame.emission->encode_atlas_bc4();
+            atlas_error[1].add(frame.emission->atlas_bc4_stats);
         }
-        if (emission_grid) {
-            emission_grids.push_back(brick_grid_to_textures(voldata::Volume::to_brick_grid(emission_grid)));
-            majorant_emission = std::max(majorant_emission, emission_grid->minorant_majorant().second);
+        if (lod_mode != 0) {
+            frame.density->build_atlas_levels(lod_levels);
+            if (frame.emission) frame.emission->build_atlas_levels(lod_levels);
         }
+        residency.add(frame);
+        majorant_emission = std::max(majorant_emission, frame.majorant_emission);
+    };
+    if (stream) {
+        // streaming: only the current frame is uploaded, upcoming frames are prefetched on the host
+        BrickFrame frame = stream->acquire(stream_frame)->bricks;
+        upload(frame);
+        majorant_emission = stream->majorant_emission();
+        return;
+    }
+    std::cout << "Preparing brick grids for OpenGL..." << std::endl;
+    // convert in parallel, upload in frame order while later frames are still being converted
+    convert_frames_parallel(volume, [&](size_t i, BrickFrame& frame) { upload(frame); });
+    for (int i = 0; i < 2; ++i) {
+        const BC4Stats& stats = atlas_error[i];
+        if (stats.texels == 0) continue;
+        std::cout << (i == 0 ? "Density" : "Emission") << " atlas BC4 encoded: " << (stats.texels >> 20) << " MB -> " << (stats.texels >> 21) << " MB, RMSE " <<
+            stats.rmse() << ", max. error " << stats.max_error << " (of 255), PSNR " << stats.psnr() << " dB" << std::endl;
     }
 }
 
 void RendererOpenGL::trace() {
-    // select shader
-    Shader& shader = transferfunc ? trace_shader_tf : trace_shader;
+    TimingScope scope("trace");
+    // adaptive sampling: update active tiles, stop early once all converged
+    if (adaptive_check_due()) {
+        adaptive_last_check = sample;
+        if (find_active_tiles() == 0) {
+            sample = sppx;
+            return;
+        }
+    }
+    const bool adaptive_dispatch = adaptive && adaptive_last_check > 0;
+
+    // density brick grid of the current frame, with transfer function majorants up to date
+    BrickResidency::Frame& frame = residency.acquire(volume->grid_frame_counter);
+    if (transferfunc) update_tf_majorant(frame.density);
+
+    // select shader (instrumented variants and their counter buffer are only created when needed)
+    if (instrumented && !counter_buffer) {
+        trace_shader_counters = Shader("trace_counters", "shader/pathtracer_brick_counters.glsl");
+        trace_shader_tf_counters = Shader("trace_tf_counters", "shader/pathtracer_brick_tf_counters.glsl");
+        const std::vector<uint32_t> zero(2 * TraceCounters::SIZE, 0);
+        glGenBuffers(1, &counter_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, zero.size() * sizeof(uint32_t), zero.data(), GL_DYNAMIC_READ);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    Shader& shader = instrumented ? (transferfunc ? trace_shader_tf_counters : trace_shader_counters) : (transferfunc ? trace_shader_tf : trace_shader);
 
     // bind
     shader->bind();
+    if (instrumented) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counter_buffer);
     color->bind_image(0, GL_READ_WRITE, GL_RGBA32F);
+    stats->bind_image(1, GL_READ_WRITE, GL_RGBA32F);
 
     // uniforms
     uint32_t tex_unit = 0;
+    const auto uniform_atlas = [&](const std::string& name, const TextureGL& atlas) { // 2D array, no cppgl texture
+        glBindTextureUnit(tex_unit, *atlas);
+        shader->uniform(name, int(tex_unit++));
+    };
     shader->uniform("bounces", bounces);
     shader->uniform("seed", seed);
     shader->uniform("show_environment", show_environment ? 1 : 0);
@@ -94,10 +187,11 @@ void RendererOpenGL::trace() {
     shader->uniform("cam_fov", current_camera()->fov_degree);
     shader->uniform("cam_transform", glm::inverse(glm::mat3(current_camera()->view)));
     // volume
-    const auto [bb_min, bb_max] = volume->AABB();
+    const BrickGridGL& density = frame.density;
+    const auto [bb_min, bb_max] = trace_bounds(volume->transform * density.transform, transferfunc ? density.tf_occupied : density.occupied);
     const auto [min, maj] = volume->minorant_majorant();
-    shader->uniform("vol_bb_min", bb_min + vol_clip_min * (bb_max - bb_min));
-    shader->uniform("vol_bb_max", bb_min + vol_clip_max * (bb_max - bb_min));
+    shader->uniform("vol_bb_min", bb_min);
+    shader->uniform("vol_bb_max", bb_max);
     shader->uniform("vol_minorant", min * density_scale);
     shader->uniform("vol_majorant", maj * density_scale);
     shader->uniform("vol_inv_majorant", 1.f / (maj * density_scale));
@@ -107,23 +201,36 @@ void RendererOpenGL::trace() {
     shader->uniform("vol_emission_scale", emission_scale);
     shader->uniform("vol_emission_norm", majorant_emission > 0.f ? 1.f / fmaxf(majorant_emission, 1e-4f) : 1.f);
     // density brick grid data
-    const BrickGridGL density = density_grids[volume->grid_frame_counter];
     shader->uniform("vol_density_transform", volume->transform * density.transform);
     shader->uniform("vol_density_inv_transform", glm::inverse(volume->transform * density.transform));
     shader->uniform("vol_density_indirection", density.indirection, tex_unit++);
     shader->uniform("vol_density_range", density.range, tex_unit++);
-    shader->uniform("vol_density_atlas", density.atlas, tex_unit++);
+    uniform_atlas("vol_density_atlas", density.atlas);
+    shader->uniform("vol_density_atlas_lod", density.atlas_lod ? density.atlas_lod : lod_fallback, tex_unit++);
+    if (transferfunc) shader->uniform("vol_density_tf_majorant", density.tf_majorant, tex_unit++);
+    // level of detail (levels available in both grids, without emission the density levels)
+    const int n_lod_levels = std::min(density.atlas_levels, frame.has_emission ? frame.emission.atlas_levels : density.atlas_levels);
+    shader->uniform("lod_mode", n_lod_levels > 0 ? lod_mode : 0);
+    shader->uniform("lod_levels", n_lod_levels);
+    shader->uniform("lod_quality", std::max(lod_quality, 1e-3f));
     // emission brick grid data
-    if (volume->grid_frame_counter < emission_grids.size()) {
-        const BrickGridGL emission = emission_grids[volume->grid_frame_counter];
+    if (frame.has_emission) {
+        const BrickGridGL& emission = frame.emission;
         shader->uniform("vol_emission_transform", volume->transform * emission.transform);
         shader->uniform("vol_emission_inv_transform", glm::inverse(volume->transform * emission.transform));
         shader->uniform("vol_emission_indirection", emission.indirection, tex_unit++);
         shader->uniform("vol_emission_range", emission.range, tex_unit++);
-        shader->uniform("vol_emission_atlas", emission.atlas, tex_unit++);
-    }
+        uniform_atlas("vol_emission_atlas", emission.atlas);
+        shader->uniform("vol_emission_atlas_lod", emission.atlas_lod ? emission.atlas_lod : lod_fallback, tex_unit++);
+    } else
+        shader->uniform("vol_emission_atlas_lod", lod_fallback, tex_unit++);
     // transfer function
-    if (transferfunc) transferfunc->set_uniforms(shader, 4);
+    if (transferfunc) {
+        transferfunc->set_uniforms(shader, 4);
+        shader->uniform("tf_preint", transferfunc->preint, tex_unit++);
+        shader->uniform("dvr", dvr ? (dvr_preintegrated ? 2 : 1) : 0);
+        shader->uniform("dvr_steps", std::max(1, dvr_steps));
+    }
     // environment
     shader->uniform("env_transform", environment->transform);
     shader->uniform("env_inv_transform", glm::inverse(environment->transform));
@@ -134,16 +241,152 @@ void RendererOpenGL::trace() {
     shader->uniform("env_impmap", environment->impmap, tex_unit++);
 
     // trace
-    const glm::ivec2 resolution = Context::resolution();
-    shader->uniform("current_sample", ++sample);
+    const glm::ivec2 resolution = gl_resolution();
+    const int n_samples = batch_size();
+    shader->uniform("current_sample", sample + 1);
+    shader->uniform("samples", n_samples);
     shader->uniform("resolution", resolution);
-    shader->dispatch_compute(resolution.x, resolution.y);
+    shader->uniform("image_offset", image_offset);
+    shader->uniform("image_size", image_size.x > 0 ? image_size : resolution);
+    shader->uniform("lod_pixel_spread", 2.f * tanf(glm::radians(.5f * current_camera()->fov_degree)) / (image_size.x > 0 ? image_size : resolution).y);
+    shader->uniform("adaptive_dispatch", adaptive_dispatch ? 1 : 0);
+    if (adaptive_dispatch) {
+        // one work group per active tile
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tile_buffer);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, tile_buffer);
+        glDispatchComputeIndirect(0);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+        pixel_samples += uint64_t(n_samples) * tiles_active * 16 * 16;
+    } else {
+        shader->dispatch_compute(resolution.x, resolution.y);
+        tiles_total = tiles_active = ((resolution.x + 15) / 16) * ((resolution.y + 15) / 16);
+        pixel_samples += uint64_t(n_samples) * resolution.x * resolution.y;
+    }
+    sample += n_samples;
 
     // unbind
+    if (instrumented) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, 0);
+    stats->unbind_image(1);
     color->unbind_image(0);
     shader->unbind();
 }
 
+uint32_t RendererOpenGL::find_active_tiles() {
+    const glm::ivec2 resolution = gl_resolution();
+    const glm::uvec2 n_tiles = (glm::uvec2(resolution) + 15u) / 16u;
+    // (re-)allocate tile buffer: indirect dispatch arguments, number of tiles in x, tile list
+    if (!tile_buffer)
+        glGenBuffers(1, &tile_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_buffer);
+    if (tiles_total != n_tiles.x * n_tiles.y) {
+        tiles_total = n_tiles.x * n_tiles.y;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (4 + tiles_total) * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+    }
+    const uint32_t header[4] = { 0, 1, 1, n_tiles.x };
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    // check convergence per tile
+    adaptive_shader->bind();
+    stats->bind_image(0, GL_READ_ONLY, GL_RGBA32F);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tile_buffer);
+    adaptive_shader->uniform("resolution", resolution);
+    adaptive_shader->uniform("threshold", adaptive_threshold);
+    adaptive_shader->dispatch_compute(resolution.x, resolution.y);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+    stats->unbind_image(0);
+    adaptive_shader->unbind();
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    // read back number of active tiles (syncs once per check interval)
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t), &tiles_active);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return tiles_active;
+}
+
+void RendererOpenGL::update_tf_majorant(BrickGridGL& grid) {
+    // transfer function state as seen by the tracer: window, value scale and opacities of the density-CDF lut
+    const std::vector<glm::vec4> lut_cdf = TransferFunction::compute_lut_cdf(transferfunc->lut);
+    const auto [min, maj] = volume->minorant_majorant();
+    std::vector<float> key = { transferfunc->window_left, transferfunc->window_width, 1.f / maj };
+    for (const auto& rgba : lut_cdf)
+        key.push_back(rgba.a);
+    if (key == grid.tf_majorant_key) return;
+
+    // only bricks overlapping the lut entries with changed opacity need an update, if window and scale are unchanged
+    glm::vec2 update = glm::vec2(0, 1);
+    if (grid.tf_majorant && grid.tf_majorant_key.size() == key.size() && std::equal(key.begin(), key.begin() + 3, grid.tf_majorant_key.begin())) {
+        int first = int(key.size()), last = -1;
+        for (int i = 3; i < int(key.size()); ++i) {
+            if (key[i] != grid.tf_majorant_key[i]) {
+                first = std::min(first, i - 3);
+                last = i - 3;
+            }
+        }
+        // tf_lookup() interpolates between neighbouring entries
+        update = glm::vec2(first - 1, last + 1) / float(lut_cdf.size());
+    }
+    grid.tf_majorant_key = key;
+    if (update.x > update.y) return; // only colors changed
+
+    // allocate all levels of the range texture
+    if (!grid.tf_majorant) {
+        const glm::ivec3 size = grid.range_size[0];
+        grid.tf_majorant = Texture3D("brick tf majorant", size.x, size.y, size.z, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+        grid.tf_majorant->bind(0);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, grid.range_size.size() - 1);
+        for (size_t i = 1; i < grid.range_size.size(); ++i)
+            glTexImage3D(GL_TEXTURE_3D, i, GL_R32F, grid.range_size[i].x, grid.range_size[i].y, grid.range_size[i].z, 0, GL_RED, GL_FLOAT, nullptr);
+        grid.tf_majorant->unbind();
+    }
+
+    // level 0 from the brick value ranges, coarser levels as max. of the finer ones
+    tf_majorant_shader->bind();
+    transferfunc->set_uniforms(tf_majorant_shader, 4);
+    tf_majorant_shader->uniform("tf_majorant_range", grid.range, 0);
+    tf_majorant_shader->uniform("tf_majorant_inv_scale", 1.f / maj);
+    tf_majorant_shader->uniform("tf_majorant_update", update);
+    for (size_t mip = 0; mip < grid.range_size.size(); ++mip) {
+        const glm::ivec3 size = grid.range_size[mip];
+        glBindImageTexture(0, grid.tf_majorant->id, mip, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+        glBindImageTexture(1, grid.tf_majorant->id, mip > 0 ? mip - 1 : 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+        tf_majorant_shader->uniform("tf_majorant_mip", int(mip));
+        tf_majorant_shader->uniform("tf_majorant_size", size);
+        tf_majorant_shader->dispatch_compute(size.x, size.y, size.z);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+    // bounds of the bricks with non-zero opacity on level 0 (syncs once per transfer function change)
+    if (!tf_bounds_buffer)
+        glGenBuffers(1, &tf_bounds_buffer);
+    const int32_t init[6] = { INT32_MAX, INT32_MAX, INT32_MAX, -1, -1, -1 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tf_bounds_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(init), init, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, tf_bounds_buffer);
+    glBindImageTexture(1, grid.tf_majorant->id, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+    tf_majorant_shader->uniform("tf_majorant_mip", -1);
+    tf_majorant_shader->uniform("tf_majorant_size", grid.range_size[0]);
+    tf_majorant_shader->dispatch_compute(grid.range_size[0].x, grid.range_size[0].y, grid.range_size[0].z);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, 0);
+    glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+    tf_majorant_shader->unbind();
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    int32_t bricks[6];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tf_bounds_buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(bricks), bricks);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    if (bricks[3] < 0)
+        grid.tf_occupied = { glm::vec3(1), glm::vec3(0) };
+    else
+        grid.tf_occupied = { glm::vec3(bricks[0], bricks[1], bricks[2]) * 8.f, glm::vec3(bricks[3] + 1, bricks[4] + 1, bricks[5] + 1) * 8.f };
+}
+
 void RendererOpenGL::draw() {
     if (!color) return;
     if (tonemapping)
@@ -154,18 +397,95 @@ void RendererOpenGL::draw() {
 
 void RendererOpenGL::reset() {
     sample = 0;
+    pixel_samples = 0;
+    adaptive_last_check = 0;
+    counters = TraceCounters();
+    if (counter_buffer) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter_buffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+}
+
+void RendererOpenGL::read_counters() {
+    if (!counter_buffer) return;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    uint32_t data[2 * TraceCounters::SIZE];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter_buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(data), data);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    for (int i = 0; i < TraceCounters::SIZE; ++i)
+        counters.values[i] = (uint64_t(data[2 * i + 1]) << 32) | data[2 * i];
+}
+
+void RendererOpenGL::save(const std::string& filename, bool tonemap) {
+    if (!tonemap) {
+        TimingScope scope("save_ldr");
+        color->save_ldr(filename, true, true);
+        return;
+    }
+    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    // tonemap (in-place)
+    {
+        TimingScope scope("tonemap");
+        tonemap_shader->bind();
+        color->bind_image(0, GL_READ_WRITE, GL_RGBA32F);
+        const glm::ivec2 resolution = gl_resolution();
+        tonemap_shader->uniform("resolution", resolution);
+        tonemap_shader->uniform("exposure", tonemap_exposure);
+        tonemap_shader->uniform("gamma", tonemap_gamma);
+        tonemap_shader->dispatch_compute(resolution.x, resolution.y);
+        color->unbind_image(0);
+        tonemap_shader->unbind();
+    }
+    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    // write result
+    TimingScope scope("save_ldr");
+    color->save_ldr(filename);
+}
+
+void RendererOpenGL::save_heatmap(const std::string& filename) {
+    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    std::vector<glm::vec4> data(size_t(stats->w) * stats->h);
+    stats->bind(0);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &data[0].x);
+    stats->unbind();
+    std::vector<float> counts(data.size());
+    for (size_t i = 0; i < data.size(); ++i)
+        counts[i] = sample > 0 ? data[i].z : 0.f;
+    save_sample_heatmap(filename, counts, stats->w, stats->h, sppx);
 }
 
-BrickGridGL RendererOpenGL::brick_grid_to_textures(const std::shared_ptr<voldata::BrickGrid>& bricks) {
+glm::uvec2 RendererOpenGL::get_accumulation(std::vector<glm::vec4>& color_data, std::vector<glm::vec4>& stats_data) {
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    color_data.resize(size_t(color->w) * color->h);
+    stats_data.resize(size_t(stats->w) * stats->h);
+    glGetTextureImage(color->id, 0, GL_RGBA, GL_FLOAT, color_data.size() * sizeof(glm::vec4), color_data.data());
+    glGetTextureImage(stats->id, 0, GL_RGBA, GL_FLOAT, stats_data.size() * sizeof(glm::vec4), stats_data.data());
+    return glm::uvec2(color->w, color->h);
+}
+
+bool RendererOpenGL::set_accumulation(const std::vector<glm::vec4>& color_data, const std::vector<glm::vec4>& stats_data, const glm::uvec2& size) {
+    if (size != glm::uvec2(color->w, color->h) || color_data.size() != size_t(size.x) * size.y || stats_data.size() != color_data.size()) return false;
+    glTextureSubImage2D(color->id, 0, 0, 0, size.x, size.y, GL_RGBA, GL_FLOAT, color_data.data());
+    glTextureSubImage2D(stats->id, 0, 0, 0, size.x, size.y, GL_RGBA, GL_FLOAT, stats_data.data());
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    return true;
+}
+
+BrickGridGL RendererOpenGL::brick_grid_to_textures(const HostBrickGrid& bricks) {
+    TimingScope scope("brick_grid_to_textures");
+    // upload directly from host data (converted grid or memory mapped cache entry)
+    const BrickGridView& view = bricks.view;
     // create indirection texture
     Texture3D indirection = Texture3D("brick indirection",
-            bricks->indirection.stride.x,
-            bricks->indirection.stride.y,
-            bricks->indirection.stride.z,
+            view.indirection_stride[0],
+            view.indirection_stride[1],
+            view.indirection_stride[2],
             GL_RGB10_A2UI,
             GL_RGBA_INTEGER,
             GL_UNSIGNED_INT_10_10_10_2,
-            bricks->indirection.data.data());
+            view.indirection);
     indirection->bind(0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
@@ -175,13 +495,13 @@ BrickGridGL RendererOpenGL::brick_grid_to_textures(const std::shared_ptr<voldata
     indirection->unbind();
     // create range texture
     Texture3D range = Texture3D("brick range",
-            bricks->range.stride.x,
-            bricks->range.stride.y,
-            bricks->range.stride.z,
+            view.range_stride[0][0],
+            view.range_stride[0][1],
+            view.range_stride[0][2],
             GL_RG16F,
             GL_RG,
             GL_HALF_FLOAT,
-            bricks->range.data.data());
+            view.range[0]);
     range->bind(0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
@@ -190,41 +510,92 @@ BrickGridGL RendererOpenGL::brick_grid_to_textures(const std::shared_ptr<voldata
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     // create min/max mipmaps
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, bricks->range_mipmaps.size());
-    for (uint32_t i = 0; i < bricks->range_mipmaps.size(); ++i) {
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, view.n_range_levels - 1);
+    for (int i = 0; i < view.n_range_levels - 1; ++i) {
         glTexImage3D(GL_TEXTURE_3D,
                 i + 1,
                 GL_RG16F,
-                bricks->range_mipmaps[i].stride.x,
-                bricks->range_mipmaps[i].stride.y,
-                bricks->range_mipmaps[i].stride.z,
+                view.range_stride[i + 1][0],
+                view.range_stride[i + 1][1],
+                view.range_stride[i + 1][2],
                 0,
                 GL_RG,
                 GL_HALF_FLOAT,
-                bricks->range_mipmaps[i].data.data());
+                view.range[i + 1]);
     }
     range->unbind();
-    // create atlas texture
-    Texture3D atlas = Texture3D("brick atlas",
-            bricks->atlas.stride.x,
-            bricks->atlas.stride.y,
-            bricks->atlas.stride.z,
-            GL_COMPRESSED_RED,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            bricks->atlas.data.data());
-    atlas->bind(0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    atlas->unbind();
+    // create atlas texture: BC4 compressed 2D array (RGTC formats are not supported for 3D textures),
+    // uncompressed if not encoded. uploaded in slabs of layers, as the atlas may exceed the max. size of a single upload
+    const int w = view.atlas_stride[0], h = view.atlas_stride[1], d = view.atlas_stride[2];
+    GLuint atlas_id;
+    glGenTextures(1, &atlas_id);
+    const TextureGL atlas(new GLuint(atlas_id), [](const GLuint* id) { glDeleteTextures(1, id); delete id; });
+    glBindTexture(GL_TEXTURE_2D_ARRAY, atlas_id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, bricks.atlas_bc4 ? GL_COMPRESSED_RED_RGTC1 : GL_R8, w, h, std::max(d, 1));
+    const size_t layer_bytes = size_t(w) * h / (bricks.atlas_bc4 ? 2 : 1);
+    const int slab = int(std::max(size_t(1), (size_t(1) << 30) / std::max(layer_bytes, size_t(1))));
+    for (int z = 0; z < d; z += slab) {
+        const int n = std::min(slab, d - z);
+        if (bricks.atlas_bc4)
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, z, w, h, n, GL_COMPRESSED_RED_RGTC1, GLsizei(layer_bytes * n), bricks.atlas_bc4 + layer_bytes * z);
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, z, w, h, n, GL_RED, GL_UNSIGNED_BYTE, view.atlas + layer_bytes * z);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    // coarser levels for level of detail as mipmaps (built on the host, texelFetch() only)
+    const int n_atlas_levels = int(bricks.atlas_levels.size());
+    Texture3D atlas_lod;
+    if (n_atlas_levels > 0) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of the coarser levels (a texel per brick on level 3) are not 4 byte aligned
+        atlas_lod = Texture3D("brick atlas lod", w >> 1, h >> 1, d >> 1, GL_R8, GL_RED, GL_UNSIGNED_BYTE, bricks.atlas_levels[0].data());
+        atlas_lod->bind(0);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, n_atlas_levels - 1);
+        for (int i = 1; i < n_atlas_levels; ++i)
+            glTexImage3D(GL_TEXTURE_3D, i, GL_R8, w >> (i + 1), h >> (i + 1), d >> (i + 1), 0, GL_RED, GL_UNSIGNED_BYTE, bricks.atlas_levels[i].data());
+        atlas_lod->unbind();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
     // return BrickGridGL
-    return BrickGridGL{ indirection, range, atlas, bricks->transform };
+    std::vector<glm::ivec3> range_size;
+    for (int i = 0; i < view.n_range_levels; ++i)
+        range_size.push_back(glm::ivec3(view.range_stride[i][0], view.range_stride[i][1], view.range_stride[i][2]));
+    BrickGridGL grid = BrickGridGL{ indirection, range, atlas, atlas_lod, bricks.transform, range_size, bricks.occupied };
+    grid.atlas_levels = n_atlas_levels;
+    return grid;
 }
 
-void RendererOpenGL::scale_and_move_to_unit_cube() {
+// -----------------------------------------------------------
+// TraceCounters
+
+const char* TraceCounters::name(int i) {
+    static const char* names[BOUNCES] = { "dda_steps", "null_collisions", "real_collisions", "density_lookups", "shadow_steps", "rr_terminations" };
+    return names[i];
+}
+
+std::string TraceCounters::json(uint64_t pixel_samples) const {
+    std::stringstream ss;
+    ss << "{\n    \"paths\": " << pixel_samples << ",\n";
+    for (int i = 0; i < BOUNCES; ++i)
+        ss << "    \"" << name(i) << "\": " << values[i] << ",\n";
+    ss << "    \"bounces\": [";
+    for (int i = 0; i < N_BOUNCE_BINS; ++i)
+        ss << (i ? ", " : "") << bounces(i);
+    ss << "],\n    \"per_path\": {";
+    for (int i = 0; i < BOUNCES; ++i)
+        ss << (i ? ", " : " ") << "\"" << name(i) << "\": " << double(values[i]) / std::max(uint64_t(1), pixel_samples);
+    ss << " }\n}\n";
+    return ss.str();
+}
+
+// -----------------------------------------------------------
+// Renderer
+
+void Renderer::scale_and_move_to_unit_cube() {
     // compute max AABB over whole volume (animation)
     glm::vec3 bb_min = glm::vec3(FLT_MAX), bb_max = glm::vec3(FLT_MIN);
     for (const auto frame : volume->grids) {
@@ -239,4 +610,189 @@ void RendererOpenGL::scale_and_move_to_unit_cube() {
         volume->transform = glm::translate(glm::scale(glm::mat4(1), glm::vec3(1.f / size)), -bb_min - 0.5f * extent);
         density_scale *= size;
     }
-}
\ No newline at end of file
+}
+
+int Renderer::batch_size() const {
+    return std::max(1, std::min(samples_per_dispatch, sppx - sample));
+}
+
+std::pair<glm::vec3, glm::vec3> Renderer::trace_bounds(const glm::mat4& index_to_world, const std::pair<glm::vec3, glm::vec3>& occupied) const {
+    const auto [bb_min, bb_max] = volume->AABB();
+    const glm::vec3 clip_a = bb_min + vol_clip_min * (bb_max - bb_min);
+    const glm::vec3 clip_b = bb_min + vol_clip_max * (bb_max - bb_min);
+    if (!tight_bounds) return { clip_a, clip_b };
+    // world-space AABB of the occupied bricks, padded by the reach of the (stochastic tricubic) lookup filter
+    const auto [occ_min, occ_max] = occupied;
+    glm::vec3 lo = glm::min(clip_a, clip_b), hi = glm::max(clip_a, clip_b);
+    if (glm::all(glm::lessThanEqual(occ_min, occ_max))) {
+        glm::vec3 occ_lo = glm::vec3(FLT_MAX), occ_hi = glm::vec3(-FLT_MAX);
+        for (int i = 0; i < 8; ++i) {
+            const glm::vec3 corner = glm::mix(occ_min - 2.f, occ_max + 2.f, glm::vec3(i & 1, (i >> 1) & 1, i >> 2));
+            const glm::vec3 wpos = glm::vec3(index_to_world * glm::vec4(corner, 1));
+            occ_lo = glm::min(occ_lo, wpos);
+            occ_hi = glm::max(occ_hi, wpos);
+        }
+        lo = glm::max(lo, occ_lo);
+        hi = glm::min(hi, occ_hi);
+    } else
+        hi = lo - 1.f;
+    // nothing visible: collapse to a point, so (almost) all rays miss and no ray marches
+    if (glm::any(glm::greaterThan(lo, hi)))
+        return { glm::min(clip_a, clip_b), glm::min(clip_a, clip_b) };
+    return { lo, hi };
+}
+
+bool Renderer::adaptive_check_due() const {
+    if (!adaptive || sample < std::max(1, adaptive_min_samples)) return false;
+    return adaptive_last_check == 0 || sample < adaptive_last_check || sample - adaptive_last_check >= std::max(1, adaptive_interval);
+}
+
+size_t Renderer::n_frames() const {
+    return stream ? stream->n_frames() : volume->n_grid_frames();
+}
+
+size_t Renderer::current_frame() const {
+    return stream ? stream_frame : volume->grid_frame_counter;
+}
+
+void Renderer::set_frame(size_t i) {
+    if (!stream) {
+        volume->grid_frame_counter = i;
+        return;
+    }
+    if (i == stream_frame && !volume->grids.empty()) return;
+    const auto frame = stream->acquire(i);
+    volume->grids = { frame->grids };
+    volume->grid_frame_counter = 0;
+    stream_frame = i;
+    commit();
+}
+
+// FNV-1a over raw bytes
+static void hash_bytes(uint64_t& hash, const void* data, size_t size) {
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ ((const uint8_t*)data)[i]) * 0x100000001b3ull;
+}
+
+template <typename T> static void hash_value(uint64_t& hash, const T& value) {
+    hash_bytes(hash, &value, sizeof(T));
+}
+
+uint64_t Renderer::scene_hash(const std::string& sources) const {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash_bytes(hash, sources.data(), sources.size());
+    const std::string type = typeid(*this).name();
+    hash_bytes(hash, type.data(), type.size());
+    // settings
+    hash_value(hash, bounces);
+    hash_value(hash, show_environment);
+    hash_value(hash, image_offset);
+    hash_value(hash, image_size);
+    hash_value(hash, adaptive);
+    hash_value(hash, adaptive_threshold);
+    hash_value(hash, adaptive_min_samples);
+    hash_value(hash, adaptive_interval);
+    hash_value(hash, dvr);
+    hash_value(hash, dvr_preintegrated);
+    hash_value(hash, dvr_steps);
+    if (lod_mode != 0) {
+        hash_value(hash, lod_mode);
+        hash_value(hash, lod_levels);
+        hash_value(hash, lod_quality);
+    }
+    // camera
+    const auto cam = current_camera();
+    hash_value(hash, cam->pos);
+    hash_value(hash, cam->dir);
+    hash_value(hash, cam->up);
+    hash_value(hash, cam->fov_degree);
+    // volume
+    hash_value(hash, albedo);
+    hash_value(hash, phase);
+    hash_value(hash, density_scale);
+    hash_value(hash, emission_scale);
+    hash_value(hash, vol_clip_min);
+    hash_value(hash, vol_clip_max);
+    hash_value(hash, current_frame());
+    hash_value(hash, n_frames());
+    if (volume && !volume->grids.empty()) {
+        hash_value(hash, volume->transform);
+        hash_value(hash, volume->AABB());
+        hash_value(hash, volume->minorant_majorant());
+    }
+    // environment and transfer function
+    if (environment) {
+        hash_value(hash, environment->transform);
+        hash_value(hash, environment->strength);
+        hash_value(hash, environment->envmap_size);
+    }
+    if (transferfunc) {
+        hash_value(hash, transferfunc->window_left);
+        hash_value(hash, transferfunc->window_width);
+        hash_bytes(hash, transferfunc->lut.data(), transferfunc->lut.size() * sizeof(glm::vec4));
+    }
+    return hash;
+}
+
+// checkpoint file: header followed by the color and stats buffers
+struct CheckpointHeader {
+    char magic[8] = { 'V', 'R', 'C', 'K', 'P', 'T', '0', '1' };
+    uint64_t scene_hash = 0;
+    uint32_t w = 0, h = 0;
+    int32_t sample = 0, seed = 0;
+    uint64_t pixel_samples = 0;
+};
+
+void Renderer::save_checkpoint(const std::string& filename, uint64_t scene_hash) {
+    TimingScope scope("checkpoint");
+    std::vector<glm::vec4> color_data, stats_data;
+    const glm::uvec2 size = get_accumulation(color_data, stats_data);
+    CheckpointHeader header;
+    header.scene_hash = scene_hash;
+    header.w = size.x;
+    header.h = size.y;
+    header.sample = sample;
+    header.seed = seed;
+    header.pixel_samples = pixel_samples;
+    // write to temporary file and rename, so an interrupted write never replaces the previous checkpoint
+    const std::string tmp = filename + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)color_data.data(), color_data.size() * sizeof(glm::vec4));
+        out.write((const char*)stats_data.data(), stats_data.size() * sizeof(glm::vec4));
+        if (!out) throw std::runtime_error("unable to write checkpoint " + tmp);
+    }
+    fs::rename(tmp, filename);
+}
+
+bool Renderer::load_checkpoint(const std::string& filename, uint64_t scene_hash) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) return false;
+    CheckpointHeader header, expected;
+    in.read((char*)&header, sizeof(header));
+    if (!in || memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) {
+        std::cerr << "invalid checkpoint " << filename << ", ignored" << std::endl;
+        return false;
+    }
+    if (header.scene_hash != scene_hash) {
+        std::cerr << "checkpoint " << filename << " belongs to another scene, ignored" << std::endl;
+        return false;
+    }
+    std::vector<glm::vec4> color_data(size_t(header.w) * header.h), stats_data(size_t(header.w) * header.h);
+    in.read((char*)color_data.data(), color_data.size() * sizeof(glm::vec4));
+    in.read((char*)stats_data.data(), stats_data.size() * sizeof(glm::vec4));
+    if (!in) {
+        std::cerr << "truncated checkpoint " << filename << ", ignored" << std::endl;
+        return false;
+    }
+    if (!set_accumulation(color_data, stats_data, glm::uvec2(header.w, header.h))) {
+        std::cerr << "checkpoint " << filename << " has another resolution (" << header.w << "x" << header.h << "), ignored" << std::endl;
+        return false;
+    }
+    sample = header.sample;
+    seed = header.seed;
+    pixel_samples = header.pixel_samples;
+    adaptive_last_check = 0; // find active tiles of the restored result with the next trace()
+    return true;
+}
@@ -1,35 +1,87 @@
 #pragma once
 
+#include <array>
 #include <cppgl.h>
 #include <voldata.h>
 
 #include "environment.h"
 #include "transferfunc.h"
+#include "brick_lookup.h"
+#include "frame_stream.h"
+#include "brick_residency.h"
+#include "readback.h"
 
-struct BrickGridGL {
-    cppgl::Texture3D indirection;
-    cppgl::Texture3D range;
-    cppgl::Texture3D atlas;
-    glm::mat4 transform;
+// helper funcs
+void blit(const cppgl::Texture2D& tex);
+void tonemap(const cppgl::Texture2D& tex, float exposure, float gamma);
+// write per-pixel sample counts color coded (turbo, normalized to sppx) and print the average sample count
+void save_sample_heatmap(const std::string& filename, const std::vector<float>& counts, uint32_t w, uint32_t h, int sppx);
+
+// hot-path counters of the instrumented trace shaders (same layout as the COUNTER_* defines in shader/common.glsl)
+struct TraceCounters {
+    enum { DDA_STEPS, NULL_COLLISIONS, REAL_COLLISIONS, DENSITY_LOOKUPS, SHADOW_STEPS, RR_TERMINATIONS, BOUNCES, N_BOUNCE_BINS = 32, SIZE = BOUNCES + N_BOUNCE_BINS };
+    static const char* name(int i);     // json/display name of counter i < BOUNCES
+
+    uint64_t operator[](int i) const { return values[i]; }
+    uint64_t bounces(int depth) const { return values[BOUNCES + depth]; }  // paths that terminated after depth bounces (last bin: or more)
+    // counters, bounce histogram and averages per path as JSON object
+    std::string json(uint64_t pixel_samples) const;
+
+    std::array<uint64_t, SIZE> values = {};
 };
 
-struct RendererOpenGL {
+struct Renderer {
+    virtual ~Renderer() {}
+
     // Renderer interface
-    void init();
-    void resize(uint32_t w, uint32_t h);
-    void commit();
-    void trace();
-    void draw();
-    void reset();
+    virtual void init() = 0;
+    virtual void resize(uint32_t w, uint32_t h) = 0;
+    virtual void commit() = 0;
+    virtual void trace() = 0;
+    virtual void draw() = 0;
+    virtual void reset() = 0;
+    // write current result (including alpha) to given file
+    virtual void save(const std::string& filename, bool tonemap = true) = 0;
+    // write per-pixel sample count heatmap of current result
+    virtual void save_heatmap(const std::string& filename) = 0;
+    // accumulation buffers (color and stats, rows bottom-up) for checkpoints, set fails (false) on size mismatch
+    virtual glm::uvec2 get_accumulation(std::vector<glm::vec4>& color_data, std::vector<glm::vec4>& stats_data) = 0;
+    virtual bool set_accumulation(const std::vector<glm::vec4>& color_data, const std::vector<glm::vec4>& stats_data, const glm::uvec2& size) = 0;
 
-    // helper to convert brick grid to OpenGL 3D textures
-    BrickGridGL brick_grid_to_textures(const std::shared_ptr<voldata::BrickGrid>& grid);
     // scale and move volume to fit into [-0.5, 0.5] unit cube
     void scale_and_move_to_unit_cube();
 
+    // animation frames, either all frames of volume or the frames of stream
+    size_t n_frames() const;
+    size_t current_frame() const;
+    void set_frame(size_t i);           // when streaming, swaps frame i into volume and commits it
+
+    // number of samples the next trace() call accumulates (samples_per_dispatch, limited to the remaining samples)
+    int batch_size() const;
+    // adaptive sampling: convergence check due (after min. samples, then every interval samples)?
+    bool adaptive_check_due() const;
+
+    // world-space ray entry bounds: volume AABB cropped by the clip planes and, with tight_bounds, intersected with
+    // the given index-space bounds of the occupied bricks of the current frame
+    std::pair<glm::vec3, glm::vec3> trace_bounds(const glm::mat4& index_to_world, const std::pair<glm::vec3, glm::vec3>& occupied) const;
+
+    // fetch the hot-path counters accumulated since reset() into counters (with instrumented, syncs)
+    virtual void read_counters() {}
+
+    // Checkpoints: accumulation buffers, sample counts and seed of the current result, tagged with a scene hash
+    // hash of everything that affects the result of the current frame (renderer type, settings, camera, volume, environment,
+    // transfer function), plus the given description of the scene sources (e.g. file names and modification times)
+    uint64_t scene_hash(const std::string& sources = "") const;
+    // write checkpoint (atomically, through a temporary file)
+    void save_checkpoint(const std::string& filename, uint64_t scene_hash);
+    // continue from checkpoint, false (and nothing changed) if there is none or it belongs to another scene or resolution
+    bool load_checkpoint(const std::string& filename, uint64_t scene_hash);
+
     // General settings
     int sample = 0;
     int sppx = 1024;
+    int samples_per_dispatch = 1;       // paths per pixel traced in a single trace() call
+    uint64_t pixel_samples = 0;         // paths traced since reset (fewer than sample * pixels with adaptive sampling)
     int seed = 42;
     int bounces = 100;
     float tonemap_exposure = 5.f;
@@ -37,27 +89,94 @@ struct RendererOpenGL {
     bool tonemapping = true;
     bool show_environment = true;
 
+    // Tiled rendering: the render target is the window at image_offset (rows bottom-up) of a larger image of image_size,
+    // camera rays and random sequences are those of the full image, so tiles rendered separately stitch seamlessly
+    glm::ivec2 image_offset = glm::ivec2(0);
+    glm::ivec2 image_size = glm::ivec2(0); // 0: render target is the full image
+
+    // Instrumentation: trace with separately compiled shader variants that count hot-path events (OpenGL only),
+    // the regular shaders contain no counting code
+    bool instrumented = false;
+    TraceCounters counters;             // accumulated since reset(), updated by read_counters()
+
+    // Adaptive sampling: tiles stop receiving samples once the relative error of all their pixels is below the threshold,
+    // rendering stops early (sample = sppx) when all tiles converged
+    bool adaptive = false;
+    float adaptive_threshold = 0.01f;   // relative standard error of the mean pixel luminance
+    int adaptive_min_samples = 16;      // samples before the first convergence check
+    int adaptive_interval = 8;          // samples between convergence checks
+    int adaptive_last_check = 0;        // sample count at last convergence check (0: none since reset)
+    uint32_t tiles_active = 0;          // tiles still receiving samples
+    uint32_t tiles_total = 0;
+
+    // Direct volume rendering (emission-absorption ray marching with the transfer function instead of path tracing, OpenGL only)
+    bool dvr = false;
+    bool dvr_preintegrated = true;      // integrate slabs between samples using the pre-integrated transfer function
+    int dvr_steps = 64;                 // samples along each ray
+
+    // Level of detail: lookups with a wide ray footprint (distance, deep bounces, shadow rays) use coarser atlas levels
+    // built in commit(), to save memory bandwidth (OpenGL only, the density of transfer function rendering stays on level 0)
+    int lod_mode = 0;                   // 0: off, 1: all lookups on the selected level, 2: unbiased (see shader/common.glsl)
+    int lod_levels = 3;                 // coarser levels built in commit() (1 - 3, level 3: one value per brick)
+    float lod_quality = 1.f;            // footprint scale, larger values select finer levels
+
     // Volume settings
     glm::vec3 albedo = glm::vec3(0.9);  // volume albedo
     float phase = 0.f;                  // volume phase (henyey-greenstein g parameter)
     float density_scale = 1.f;          // volume density scaling factor
     float emission_scale = 100.f;       // volume emission scaling factor
 
-    // OpenGL data
-    cppgl::Shader trace_shader, trace_shader_tf, tonemap_shader;
-    cppgl::Texture2D color;
-    std::vector<BrickGridGL> density_grids;
-    std::vector<BrickGridGL> emission_grids;
-    float majorant_emission = 0.f;
-
     // Volume data
     std::shared_ptr<voldata::Volume> volume;
+    std::shared_ptr<FrameStream> stream;    // streaming source for long animations (volume then only holds the current frame)
+    size_t stream_frame = 0;
 
     // Volume clip planes
     glm::vec3 vol_clip_min = glm::vec3(0.f);
     glm::vec3 vol_clip_max = glm::vec3(1.f);
+    bool tight_bounds = true;           // skip empty bricks around the occupied region of each frame on ray entry
 
     // Scene data
     std::shared_ptr<Environment> environment;
     std::shared_ptr<TransferFunction> transferfunc;
 };
+
+struct RendererOpenGL : public Renderer {
+    // Renderer interface
+    void init();
+    void resize(uint32_t w, uint32_t h);
+    void commit();
+    void trace();
+    void draw();
+    void reset();
+    void save(const std::string& filename, bool tonemap = true);
+    void save_heatmap(const std::string& filename);
+    glm::uvec2 get_accumulation(std::vector<glm::vec4>& color_data, std::vector<glm::vec4>& stats_data);
+    bool set_accumulation(const std::vector<glm::vec4>& color_data, const std::vector<glm::vec4>& stats_data, const glm::uvec2& size);
+    void read_counters();
+
+    ~RendererOpenGL();
+
+    // adaptive sampling: collect unconverged tiles into tile_buffer, returns their count
+    uint32_t find_active_tiles();
+
+    // (re-)build per-brick transfer function majorants of a grid if the transfer function changed since
+    void update_tf_majorant(BrickGridGL& grid);
+
+    // helper to convert brick grid to OpenGL 3D textures
+    BrickGridGL brick_grid_to_textures(const HostBrickGrid& grid);
+
+    // OpenGL data
+    cppgl::Shader trace_shader, trace_shader_tf, tonemap_shader, adaptive_shader, tf_majorant_shader;
+    cppgl::Shader trace_shader_counters, trace_shader_tf_counters;  // instrumented variants, compiled on first use
+    cppgl::Texture2D color;
+    cppgl::Texture2D stats;             // running luminance mean, M2 and sample count per pixel
+    cppgl::Texture3D lod_fallback;      // 1x1x1 texture bound to the atlas level samplers of grids without coarser levels
+    GLuint tile_buffer = 0;             // indirect dispatch arguments and list of active tiles
+    BrickResidency residency;           // per-frame brick textures, residency.budget_bytes limits VRAM usage
+    float majorant_emission = 0.f;
+    GLuint tf_bounds_buffer = 0;        // reduction of the occupied transfer function majorant bricks
+    GLuint counter_buffer = 0;          // hot-path counters of the instrumented shaders (64 bit as low, high uint)
+    ImageReadback readback;             // fenced fp32/fp16 readback of color into host memory
+    BC4Stats atlas_error[2];            // BC4 encoding error of the density and emission atlases of the committed frames
+};
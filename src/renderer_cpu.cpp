@@ -0,0 +1,739 @@
+#include "renderer_cpu.h"
+#include "glcontext.h"
+#include "brick_lookup.h"
+#include "volume_loader.h"
+#include "image_io.h"
+#include "telemetry.h"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace cppgl;
+
+// -----------------------------------------------------------
+// work-stealing tile scheduler
+
+// each worker owns a contiguous range of tiles and pops from its front,
+// idle workers steal from the back of the other queues
+class TileScheduler {
+public:
+    TileScheduler(uint32_t n_workers, uint32_t n_tiles) : queues(n_workers), mutexes(n_workers) {
+        for (uint32_t w = 0; w < n_workers; ++w)
+            for (uint32_t i = w * n_tiles / n_workers; i < (w + 1) * n_tiles / n_workers; ++i)
+                queues[w].push_back(i);
+    }
+
+    bool next(uint32_t worker, uint32_t& tile) {
+        for (uint32_t i = 0; i < queues.size(); ++i) {
+            const uint32_t victim = (worker + i) % queues.size();
+            std::lock_guard<std::mutex> lock(mutexes[victim]);
+            if (queues[victim].empty()) continue;
+            if (victim == worker) {
+                tile = queues[victim].front();
+                queues[victim].pop_front();
+            } else {
+                tile = queues[victim].back();
+                queues[victim].pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+private:
+    std::vector<std::deque<uint32_t>> queues;
+    std::vector<std::mutex> mutexes;
+};
+
+// -----------------------------------------------------------
+// constants and helper funcs (port of shader/common.glsl)
+
+namespace {
+
+const uint32_t TILE_SIZE = 16;
+
+const float PI = 3.14159265358979323846f;
+const float inv_4PI = 1.f / (4 * PI);
+
+const int MIP_START = 3;
+const float MIP_SPEED_UP = 0.25f;
+const float MIP_SPEED_DOWN = 2.f;
+
+inline float sqr(float x) { return x * x; }
+inline glm::vec3 sqr(const glm::vec3& x) { return x * x; }
+
+inline float luma(const glm::vec3& col) { return glm::dot(col, glm::vec3(0.212671f, 0.715160f, 0.072169f)); }
+
+inline float saturate(float x) { return glm::clamp(x, 0.f, 1.f); }
+
+inline glm::vec4 sanitize(const glm::vec4& x) {
+    glm::vec4 r = x;
+    for (int i = 0; i < 4; ++i)
+        if (std::isnan(r[i]) || std::isinf(r[i])) r[i] = 0.f;
+    return r;
+}
+
+inline glm::vec3 align(const glm::vec3& N, const glm::vec3& v) {
+    // build tangent frame
+    const glm::vec3 T = std::abs(N.x) > std::abs(N.y) ?
+        glm::vec3(-N.z, 0, N.x) / std::sqrt(N.x * N.x + N.z * N.z) :
+        glm::vec3(0, N.z, -N.y) / std::sqrt(N.y * N.y + N.z * N.z);
+    const glm::vec3 B = glm::cross(N, T);
+    // tangent to world
+    return glm::normalize(v.x * T + v.y * B + v.z * N);
+}
+
+inline float power_heuristic(float a, float b) { return sqr(a) / (sqr(a) + sqr(b)); }
+
+// per-trace state, mirrors the uniforms of the trace shaders
+struct TraceContext {
+    // camera
+    glm::vec3 cam_pos;
+    float cam_fov;
+    glm::mat3 cam_transform;
+    // environment
+    const Environment* env;
+    glm::mat3 env_transform, env_inv_transform;
+    float env_strength;
+    glm::vec2 env_imp_inv_dim;
+    int env_imp_base_mip;
+    // volume
+    glm::vec3 vol_bb_min, vol_bb_max;
+    float vol_majorant, vol_inv_majorant;
+    glm::vec3 vol_albedo;
+    float vol_phase_g, vol_density_scale, vol_emission_scale, vol_emission_norm;
+    const BrickGridView* density;
+    glm::mat4 vol_density_transform, vol_density_inv_transform;
+    const BrickGridView* emission;
+    glm::mat4 vol_emission_transform, vol_emission_inv_transform;
+    // transfer function (nullptr if unused)
+    const std::vector<glm::vec4>* tf_lut;
+    float tf_window_left, tf_window_width;
+    const std::vector<std::vector<float>>* tf_majorant; // per range mip level
+    // path tracing
+    int bounces;
+    bool show_environment;
+};
+
+// camera helper
+
+inline glm::vec3 view_dir(const TraceContext& ctx, const glm::ivec2& xy, const glm::ivec2& wh, const glm::vec2& pixel_sample) {
+    const glm::vec2 pixel = (glm::vec2(xy) + pixel_sample - glm::vec2(wh) * .5f) / float(wh.y);
+    const float z = -.5f / std::tan(.5f * PI * ctx.cam_fov / 180.f);
+    return glm::normalize(ctx.cam_transform * glm::normalize(glm::vec3(pixel.x, pixel.y, z)));
+}
+
+// environment helper (input vectors assumed in world space!)
+
+inline float impmap_fetch(const TraceContext& ctx, const glm::ivec2& pos, int mip) {
+    const int dim = ctx.env->dimension() >> mip;
+    if (pos.x < 0 || pos.y < 0 || pos.x >= dim || pos.y >= dim) return 0.f;
+    return ctx.env->impmap_host[mip][pos.y * dim + pos.x];
+}
+
+inline glm::vec3 lookup_environment(const TraceContext& ctx, const glm::vec3& dir) {
+    const glm::vec3 idir = ctx.env_inv_transform * dir;
+    const float u = std::atan2(idir.z, idir.x) / (2 * PI) + 0.5f;
+    const float v = 1.f - std::acos(glm::clamp(idir.y, -1.f, 1.f)) / PI;
+    return ctx.env_strength * ctx.env->lookup_host(glm::vec2(u, v));
+}
+
+inline glm::vec4 sample_environment(const TraceContext& ctx, glm::vec2 p, glm::vec3& w_i) {
+    glm::ivec2 pos = glm::ivec2(0); // pixel position
+    // warp sample over mip hierarchy
+    for (int mip = ctx.env_imp_base_mip - 1; mip >= 0; mip--) {
+        pos *= 2; // scale to mip
+        float w[4]; // four relevant texels
+        w[0] = impmap_fetch(ctx, pos + glm::ivec2(0, 0), mip);
+        w[1] = impmap_fetch(ctx, pos + glm::ivec2(1, 0), mip);
+        w[2] = impmap_fetch(ctx, pos + glm::ivec2(0, 1), mip);
+        w[3] = impmap_fetch(ctx, pos + glm::ivec2(1, 1), mip);
+        float q[2]; // bottom / top
+        q[0] = w[0] + w[2];
+        q[1] = w[1] + w[3];
+        // horizontal
+        int off_x;
+        const float d = q[0] / std::max(1e-8f, q[0] + q[1]);
+        if (p.x < d) { // left
+            off_x = 0;
+            p.x = p.x / d;
+        } else { // right
+            off_x = 1;
+            p.x = (p.x - d) / (1.f - d);
+        }
+        pos.x += off_x;
+        // vertical
+        const float e = w[off_x] / q[off_x];
+        if (p.y < e) { // bottom
+            p.y = p.y / e;
+        } else { // top
+            pos.y += 1;
+            p.y = (p.y - e) / (1.f - e);
+        }
+    }
+    // compute sample uv coordinate and (world-space) direction
+    const glm::vec2 uv = (glm::vec2(pos) + p) * ctx.env_imp_inv_dim;
+    const float theta = saturate(1.f - uv.y) * PI;
+    const float phi = (saturate(uv.x) * 2.f - 1.f) * PI;
+    const float sin_t = std::sin(theta);
+    w_i = ctx.env_transform * glm::vec3(sin_t * std::cos(phi), std::cos(theta), sin_t * std::sin(phi));
+    // sample envmap and compute pdf
+    const glm::vec3 Le = ctx.env_strength * ctx.env->lookup_host(uv);
+    const float avg_w = impmap_fetch(ctx, glm::ivec2(0, 0), ctx.env_imp_base_mip);
+    const float pdf = impmap_fetch(ctx, pos, 0) / avg_w;
+    return glm::vec4(Le, pdf * inv_4PI / (.5f * PI * std::max(sin_t, 1e-4f))); // uv to solid angle (importance includes sin(theta) * PI/2)
+}
+
+inline float pdf_environment(const TraceContext& ctx, const glm::vec3& dir) {
+    const glm::vec3 idir = ctx.env_inv_transform * dir;
+    const glm::vec2 uv = glm::vec2(std::atan2(idir.z, idir.x) / (2 * PI) + 0.5f, 1.f - std::acos(glm::clamp(idir.y, -1.f, 1.f)) / PI);
+    const glm::ivec2 pos = glm::clamp(glm::ivec2(uv / ctx.env_imp_inv_dim), glm::ivec2(0), glm::ivec2(1.f / ctx.env_imp_inv_dim) - 1);
+    const float avg_w = impmap_fetch(ctx, glm::ivec2(0, 0), ctx.env_imp_base_mip);
+    const float pdf = impmap_fetch(ctx, pos, 0) / avg_w;
+    const float sin_t = std::sqrt(std::max(0.f, 1.f - sqr(idir.y)));
+    return pdf * inv_4PI / (.5f * PI * std::max(sin_t, 1e-4f));
+}
+
+// box intersect helper
+
+inline bool intersect_box(const glm::vec3& pos, const glm::vec3& dir, const glm::vec3& bb_min, const glm::vec3& bb_max, glm::vec2& near_far) {
+    const glm::vec3 inv_dir = 1.f / dir;
+    const glm::vec3 lo = (bb_min - pos) * inv_dir;
+    const glm::vec3 hi = (bb_max - pos) * inv_dir;
+    const glm::vec3 tmin = glm::min(lo, hi), tmax = glm::max(lo, hi);
+    near_far.x = std::max(0.f, std::max(tmin.x, std::max(tmin.y, tmin.z)));
+    near_far.y = std::min(tmax.x, std::min(tmax.y, tmax.z));
+    return near_far.x <= near_far.y;
+}
+
+// phase function helpers
+
+inline float phase_henyey_greenstein(float cos_t, float g) {
+    const float denom = 1 + sqr(g) + 2 * g * cos_t;
+    return inv_4PI * (1 - sqr(g)) / (denom * std::sqrt(denom));
+}
+
+inline glm::vec3 sample_phase_henyey_greenstein(const glm::vec3& dir, float g, const glm::vec2& phase_sample) {
+    const float cos_t = std::abs(g) < 1e-4f ? 1.f - 2.f * phase_sample.x :
+        (1 + sqr(g) - sqr((1 - sqr(g)) / (1 - g + 2 * g * phase_sample.x))) / (2 * g);
+    const float sin_t = std::sqrt(std::max(0.f, 1.f - sqr(cos_t)));
+    const float phi = 2.f * PI * phase_sample.y;
+    return align(dir, glm::vec3(sin_t * std::cos(phi), sin_t * std::sin(phi), cos_t));
+}
+
+// transfer function helper
+
+inline float tf_window(const TraceContext& ctx, float d) {
+    return glm::clamp((d - ctx.tf_window_left) / ctx.tf_window_width, 0.f, 1.f - 1e-6f);
+}
+
+inline glm::vec4 tf_lookup(const TraceContext& ctx, float d) {
+    const std::vector<glm::vec4>& lut = *ctx.tf_lut;
+    const float tc = tf_window(ctx, d);
+    const int idx = int(std::floor(tc * lut.size()));
+    const float f = glm::fract(tc * lut.size());
+    return glm::mix(lut[idx], lut[std::min<size_t>(idx + 1, lut.size() - 1)], f);
+}
+
+// max. opacity of tf_lookup() over densities in [d_min, d_max] (piecewise linear between lut entries)
+inline float tf_max_opacity(const TraceContext& ctx, float d_min, float d_max) {
+    const std::vector<glm::vec4>& lut = *ctx.tf_lut;
+    float a = std::max(tf_lookup(ctx, d_min).a, tf_lookup(ctx, d_max).a);
+    const int last = std::min(int(std::floor(tf_window(ctx, d_max) * lut.size())), int(lut.size()) - 1);
+    for (int i = int(std::ceil(tf_window(ctx, d_min) * lut.size())); i <= last; ++i)
+        a = std::max(a, lut[i].a);
+    return a;
+}
+
+// brick majorant lookup (nearest neighbor)
+inline float lookup_majorant(const TraceContext& ctx, const glm::vec3& ipos, int mip) {
+    return ctx.vol_density_scale * brick_majorant(*ctx.density, ipos, mip);
+}
+
+// density lookup (nearest neighbor)
+inline float lookup_density(const TraceContext& ctx, const glm::vec3& ipos) {
+    return ctx.vol_density_scale * brick_lookup(*ctx.density, ipos);
+}
+
+// density lookup (trilinear filter)
+inline float lookup_density_trilinear(const TraceContext& ctx, const glm::vec3& ipos) {
+    return ctx.vol_density_scale * brick_lookup_trilinear(*ctx.density, ipos);
+}
+
+// density lookup (stochastic tricubic filter)
+inline float lookup_density_stochastic(const TraceContext& ctx, const glm::vec3& ipos, uint32_t& seed) {
+    return lookup_density(ctx, glm::vec3(stochastic_tricubic_filter(ipos, seed)));
+}
+
+// emission lookup (stochastic tricubic filter)
+inline glm::vec3 lookup_emission(const TraceContext& ctx, const glm::vec3& ipos, uint32_t& seed) {
+    const glm::vec3 ipos_emission = glm::vec3(ctx.vol_emission_inv_transform * ctx.vol_density_transform * glm::vec4(ipos, 1));
+    const glm::ivec3 tap = stochastic_tricubic_filter(ipos_emission, seed); // always consume samples to match the GPU sequence
+    if (!ctx.emission) return glm::vec3(0);
+    const float t = brick_lookup(*ctx.emission, glm::vec3(tap)) * ctx.vol_emission_norm;
+    return ctx.vol_emission_scale * sqr(glm::vec3(t, sqr(t), sqr(sqr(t))));
+}
+
+// density at index-space position, either plain or mapped through the transfer function
+inline float lookup_extinction(const TraceContext& ctx, const glm::vec3& ipos, uint32_t& seed, glm::vec4& rgba) {
+    if (ctx.tf_lut) {
+        rgba = tf_lookup(ctx, lookup_density_trilinear(ctx, ipos) * ctx.vol_inv_majorant);
+        return ctx.vol_majorant * rgba.a;
+    }
+    return lookup_density_stochastic(ctx, ipos, seed);
+}
+
+inline float lookup_local_majorant(const TraceContext& ctx, const glm::vec3& ipos, int mip) {
+    if (ctx.tf_lut) {
+        size_t i;
+        const glm::ivec3 brick = glm::ivec3(glm::floor(ipos)) >> (3 + mip);
+        if (mip >= ctx.density->n_range_levels || !brick_fetch_index(brick, ctx.density->range_stride[mip], i)) return 0.f;
+        return ctx.vol_majorant * (*ctx.tf_majorant)[mip][i];
+    }
+    return lookup_majorant(ctx, ipos, mip);
+}
+
+// max. transfer function opacity per brick and range mip level, see shader/tf_majorant.glsl
+static std::vector<std::vector<float>> build_tf_majorant(const TraceContext& ctx, const BrickGridView& grid, float inv_scale) {
+    std::vector<std::vector<float>> levels(grid.n_range_levels);
+    for (int mip = 0; mip < grid.n_range_levels; ++mip) {
+        const int32_t* stride = grid.range_stride[mip];
+        levels[mip].resize(size_t(stride[0]) * stride[1] * stride[2]);
+        for (int z = 0; z < stride[2]; ++z) {
+            for (int y = 0; y < stride[1]; ++y) {
+                for (int x = 0; x < stride[0]; ++x) {
+                    float a = 0.f;
+                    if (mip == 0) {
+                        const glm::vec2 range = brick_fetch_range(grid, glm::ivec3(x, y, z), 0) * inv_scale;
+                        a = tf_max_opacity(ctx, range.x, range.y);
+                    } else {
+                        for (int i = 0; i < 8; ++i) {
+                            size_t j;
+                            if (brick_fetch_index(2 * glm::ivec3(x, y, z) + glm::ivec3(i & 1, (i >> 1) & 1, i >> 2), grid.range_stride[mip - 1], j))
+                                a = std::max(a, levels[mip - 1][j]);
+                        }
+                    }
+                    levels[mip][(size_t(z) * stride[1] + y) * stride[0] + x] = a;
+                }
+            }
+        }
+    }
+    return levels;
+}
+
+// DDA-based null-collision methods
+
+// perform DDA step on given mip level
+inline float stepDDA(const glm::vec3& pos, const glm::vec3& inv_dir, int mip) {
+    const float dim = float(8 << mip);
+    glm::vec3 offs;
+    for (int i = 0; i < 3; ++i)
+        offs[i] = inv_dir[i] >= 0.f ? dim + 0.5f : -0.5f;
+    const glm::vec3 tmax = (glm::floor(pos * (1.f / dim)) * dim + offs - pos) * inv_dir;
+    return std::min(tmax.x, std::min(tmax.y, tmax.z));
+}
+
+// DDA-based transmittance
+float transmittanceDDA(const TraceContext& ctx, const glm::vec3& wpos, const glm::vec3& wdir, uint32_t& seed) {
+    // clip volume
+    glm::vec2 near_far;
+    if (!intersect_box(wpos, wdir, ctx.vol_bb_min, ctx.vol_bb_max, near_far)) return 1.f;
+    // to index-space
+    const glm::vec3 ipos = glm::vec3(ctx.vol_density_inv_transform * glm::vec4(wpos, 1));
+    const glm::vec3 idir = glm::vec3(ctx.vol_density_inv_transform * glm::vec4(wdir, 0)); // non-normalized!
+    const glm::vec3 ri = 1.f / idir;
+    // march brick grid
+    float t = near_far.x + 1e-6f, Tr = 1.f, tau = -std::log(1.f - rng(seed)), mip = MIP_START;
+    while (t < near_far.y) {
+        const glm::vec3 curr = ipos + t * idir;
+        const float majorant = lookup_local_majorant(ctx, curr, int(std::round(mip)));
+        const float dt = stepDDA(curr, ri, int(std::round(mip)));
+        t += dt;
+        tau -= majorant * dt;
+        mip = std::min(mip + MIP_SPEED_UP, 3.f);
+        if (tau > 0) continue; // no collision, step ahead
+        t += tau / majorant; // step back to point of collision
+        if (t >= near_far.y) break;
+        glm::vec4 rgba;
+        const float d = lookup_extinction(ctx, ipos + t * idir, seed, rgba);
+        if (rng(seed) * majorant < d) { // check if real or null collision
+            Tr *= std::max(0.f, 1.f - ctx.vol_majorant / majorant); // adjust by ratio of global to local majorant
+            // russian roulette
+            if (Tr < .1f) {
+                const float prob = 1 - Tr;
+                if (rng(seed) < prob) return 0.f;
+                Tr /= 1 - prob;
+            }
+        }
+        tau = -std::log(1.f - rng(seed));
+        mip = std::max(0.f, mip - MIP_SPEED_DOWN);
+    }
+    return Tr;
+}
+
+// DDA-based volume sampling
+bool sample_volumeDDA(const TraceContext& ctx, const glm::vec3& wpos, const glm::vec3& wdir, float& t, glm::vec3& throughput, glm::vec3& Le, uint32_t& seed) {
+    // clip volume
+    glm::vec2 near_far;
+    if (!intersect_box(wpos, wdir, ctx.vol_bb_min, ctx.vol_bb_max, near_far)) return false;
+    // to index-space
+    const glm::vec3 ipos = glm::vec3(ctx.vol_density_inv_transform * glm::vec4(wpos, 1));
+    const glm::vec3 idir = glm::vec3(ctx.vol_density_inv_transform * glm::vec4(wdir, 0)); // non-normalized!
+    const glm::vec3 ri = 1.f / idir;
+    // march brick grid
+    t = near_far.x + 1e-6f;
+    float tau = -std::log(1.f - rng(seed)), mip = MIP_START;
+    while (t < near_far.y) {
+        const glm::vec3 curr = ipos + t * idir;
+        const float majorant = lookup_local_majorant(ctx, curr, int(std::round(mip)));
+        const float dt = stepDDA(curr, ri, int(std::round(mip)));
+        t += dt;
+        tau -= majorant * dt;
+        mip = std::min(mip + MIP_SPEED_UP, 3.f);
+        if (tau > 0) continue; // no collision, step ahead
+        t += tau / majorant; // step back to point of collision
+        if (t >= near_far.y) break;
+        glm::vec4 rgba;
+        const float d = lookup_extinction(ctx, ipos + t * idir, seed, rgba);
+        Le += throughput * (1.f - ctx.vol_albedo) * lookup_emission(ctx, ipos + t * idir, seed) * d * ctx.vol_inv_majorant;
+        if (rng(seed) * majorant < d) { // check if real or null collision
+            throughput *= ctx.vol_albedo;
+            if (ctx.tf_lut) throughput *= glm::vec3(rgba);
+            return true;
+        }
+        tau = -std::log(1.f - rng(seed));
+        mip = std::max(0.f, mip - MIP_SPEED_DOWN);
+    }
+    return false;
+}
+
+// volumetric path tracing
+
+glm::vec4 trace_path(const TraceContext& ctx, glm::vec3 pos, glm::vec3 dir, uint32_t& seed) {
+    // trace path
+    glm::vec3 L = glm::vec3(0);
+    glm::vec3 throughput = glm::vec3(1);
+    bool free_path = true;
+    uint32_t n_paths = 0;
+    float t, f_p = 0.f; // t: end of ray segment (i.e. sampled position or out of volume), f_p: last phase function sample for MIS
+    while (sample_volumeDDA(ctx, pos, dir, t, throughput, L, seed)) {
+        // advance ray
+        pos = pos + t * dir;
+
+        // sample light source (environment)
+        glm::vec3 w_i;
+        const glm::vec4 Le_pdf = sample_environment(ctx, rng2(seed), w_i);
+        if (Le_pdf.w > 0) {
+            f_p = phase_henyey_greenstein(glm::dot(-dir, w_i), ctx.vol_phase_g);
+            const float mis_weight = ctx.show_environment ? power_heuristic(Le_pdf.w, f_p) : 1.f;
+            const float Tr = transmittanceDDA(ctx, pos, w_i, seed);
+            L += throughput * mis_weight * f_p * Tr * glm::vec3(Le_pdf) / Le_pdf.w;
+        }
+
+        // early out?
+        if (int(++n_paths) >= ctx.bounces) { free_path = false; break; }
+        // russian roulette
+        const float rr_val = luma(throughput);
+        if (rr_val < .1f) {
+            const float prob = 1 - rr_val;
+            if (rng(seed) < prob) { free_path = false; break; }
+            throughput /= 1 - prob;
+        }
+
+        // scatter ray
+        const glm::vec3 scatter_dir = sample_phase_henyey_greenstein(dir, ctx.vol_phase_g, rng2(seed));
+        f_p = phase_henyey_greenstein(glm::dot(-dir, scatter_dir), ctx.vol_phase_g);
+        dir = scatter_dir;
+    }
+
+    // free path? -> add envmap contribution
+    if (free_path && ctx.show_environment) {
+        const glm::vec3 Le = lookup_environment(ctx, dir);
+        const float mis_weight = n_paths > 0 ? power_heuristic(f_p, pdf_environment(ctx, dir)) : 1.f;
+        L += throughput * mis_weight * Le;
+    }
+
+    return glm::vec4(L, glm::clamp(float(n_paths), 0.f, 1.f));
+}
+
+} // namespace
+
+// -----------------------------------------------------------
+// CPU renderer
+
+RendererCPU::~RendererCPU() {
+    pool.reset(); // join workers
+}
+
+void RendererCPU::init() {
+    start_workers();
+
+    // load default volume
+    if (!volume)
+        volume = std::make_shared<voldata::Volume>();
+
+    // load default environment map
+    if (!environment)
+        environment = std::make_shared<Environment>(glm::vec3(1.f));
+
+    // setup color buffer
+    if (resolution.x == 0 || resolution.y == 0) {
+        const glm::ivec2 res = gl_context_current() ? gl_resolution() : glm::ivec2(1024);
+        resize(res.x, res.y);
+    }
+}
+
+uint32_t RendererCPU::start_workers() {
+    const uint32_t n_workers = n_threads > 0 ? n_threads : std::max(1u, std::thread::hardware_concurrency());
+    if (n_workers > 1 && (!pool || pool->size() != n_workers - 1))
+        pool = std::make_unique<ThreadPool>(n_workers - 1);
+    else if (n_workers == 1)
+        pool.reset();
+    return n_workers;
+}
+
+void RendererCPU::resize(uint32_t w, uint32_t h) {
+    resolution = glm::uvec2(w, h);
+    color.assign(size_t(w) * h, glm::vec4(0));
+    stats.assign(size_t(w) * h, glm::vec4(0));
+}
+
+void RendererCPU::commit() {
+    TimingScope scope("commit");
+    density_grids.clear();
+    emission_grids.clear();
+    majorant_emission = 0.f;
+    tf_majorant_grid = nullptr;
+    const auto add = [&](BrickFrame& frame) {
+        density_grids.push_back(frame.density);
+        if (frame.emission) {
+            emission_grids.push_back(frame.emission);
+            majorant_emission = std::max(majorant_emission, frame.majorant_emission);
+        }
+    };
+    if (stream) {
+        // streaming: only the current frame is used, upcoming frames are prefetched
+        BrickFrame frame = stream->acquire(stream_frame)->bricks;
+        add(frame);
+        majorant_emission = stream->majorant_emission();
+        return;
+    }
+    std::cout << "Preparing brick grids for CPU..." << std::endl;
+    convert_frames_parallel(volume, [&](size_t i, BrickFrame& frame) { add(frame); }, n_threads);
+}
+
+void RendererCPU::trace() {
+    TimingScope scope("trace");
+    if (density_grids.empty() || resolution.x == 0 || resolution.y == 0) return;
+    environment->build_host_data();
+
+    // setup trace context
+    TraceContext ctx;
+    // camera
+    const glm::mat4 view = glm::lookAt(current_camera()->pos, current_camera()->pos + current_camera()->dir, current_camera()->up);
+    ctx.cam_pos = current_camera()->pos;
+    ctx.cam_fov = current_camera()->fov_degree;
+    ctx.cam_transform = glm::inverse(glm::mat3(view));
+    // volume
+    const auto [min, maj] = volume->minorant_majorant();
+    ctx.vol_majorant = maj * density_scale;
+    ctx.vol_inv_majorant = 1.f / (maj * density_scale);
+    ctx.vol_albedo = albedo;
+    ctx.vol_phase_g = phase;
+    ctx.vol_density_scale = density_scale;
+    ctx.vol_emission_scale = emission_scale;
+    ctx.vol_emission_norm = majorant_emission > 0.f ? 1.f / fmaxf(majorant_emission, 1e-4f) : 1.f;
+    // density brick grid data
+    const auto& density = density_grids[volume->grid_frame_counter];
+    ctx.density = &density->view;
+    ctx.vol_density_transform = volume->transform * density->transform;
+    ctx.vol_density_inv_transform = glm::inverse(ctx.vol_density_transform);
+    // emission brick grid data
+    ctx.emission = nullptr;
+    if (volume->grid_frame_counter < emission_grids.size()) {
+        const auto& emission = emission_grids[volume->grid_frame_counter];
+        ctx.emission = &emission->view;
+        ctx.vol_emission_transform = volume->transform * emission->transform;
+        ctx.vol_emission_inv_transform = glm::inverse(ctx.vol_emission_transform);
+    }
+    // transfer function
+    const std::vector<glm::vec4> lut_cdf = transferfunc ? TransferFunction::compute_lut_cdf(transferfunc->lut) : std::vector<glm::vec4>();
+    ctx.tf_lut = lut_cdf.empty() ? nullptr : &lut_cdf;
+    ctx.tf_window_left = transferfunc ? transferfunc->window_left : 0.f;
+    ctx.tf_window_width = transferfunc ? transferfunc->window_width : 1.f;
+    if (ctx.tf_lut) {
+        // rebuild transfer function majorants when the transfer function or frame changed
+        std::vector<float> key = { ctx.tf_window_left, ctx.tf_window_width, 1.f / maj };
+        for (const auto& rgba : lut_cdf)
+            key.push_back(rgba.a);
+        if (key != tf_majorant_key || tf_majorant_grid != ctx.density) {
+            tf_majorant = build_tf_majorant(ctx, *ctx.density, 1.f / maj);
+            tf_majorant_key = key;
+            tf_majorant_grid = ctx.density;
+            tf_occupied = brick_occupied_bounds(tf_majorant[0].data(), ctx.density->range_stride[0]);
+        }
+    }
+    ctx.tf_majorant = &tf_majorant;
+    const auto [bb_min, bb_max] = trace_bounds(ctx.vol_density_transform, ctx.tf_lut ? tf_occupied : density->occupied);
+    ctx.vol_bb_min = bb_min;
+    ctx.vol_bb_max = bb_max;
+    // environment
+    ctx.env = environment.get();
+    ctx.env_transform = environment->transform;
+    ctx.env_inv_transform = glm::inverse(environment->transform);
+    ctx.env_strength = environment->strength;
+    ctx.env_imp_inv_dim = glm::vec2(1.f / environment->dimension());
+    ctx.env_imp_base_mip = int(floor(log2(environment->dimension())));
+    // path tracing
+    ctx.bounces = bounces;
+    ctx.show_environment = show_environment;
+
+    // adaptive sampling: update active tiles, stop early once all converged
+    const glm::uvec2 n_tiles = (resolution + TILE_SIZE - 1u) / TILE_SIZE;
+    std::vector<uint32_t> tiles;
+    if (adaptive_check_due() || (adaptive && adaptive_last_check > 0 && tile_active.size() != n_tiles.x * n_tiles.y)) {
+        adaptive_last_check = sample;
+        if (find_active_tiles() == 0) {
+            sample = sppx;
+            return;
+        }
+    }
+    if (adaptive && adaptive_last_check > 0) {
+        for (uint32_t i = 0; i < tile_active.size(); ++i)
+            if (tile_active[i]) tiles.push_back(i);
+    } else {
+        tiles.resize(n_tiles.x * n_tiles.y);
+        for (uint32_t i = 0; i < tiles.size(); ++i) tiles[i] = i;
+        tiles_total = tiles_active = tiles.size();
+    }
+
+    // trace tiles in parallel
+    const uint32_t first_sample = sample + 1;
+    const int n_samples = batch_size();
+    const glm::ivec2 image_res = image_size.x > 0 ? image_size : glm::ivec2(resolution);
+    const uint32_t n_workers = start_workers();
+    TileScheduler scheduler(n_workers, tiles.size());
+    const auto worker = [&](uint32_t id) {
+        uint32_t index;
+        while (scheduler.next(id, index)) {
+            const uint32_t tile = tiles[index];
+            const glm::uvec2 tile_min = glm::uvec2(tile % n_tiles.x, tile / n_tiles.x) * TILE_SIZE;
+            const glm::uvec2 tile_max = glm::min(tile_min + TILE_SIZE, resolution);
+            for (uint32_t y = tile_min.y; y < tile_max.y; ++y) {
+                for (uint32_t x = tile_min.x; x < tile_max.x; ++x) {
+                    glm::vec4& s = stats[size_t(y) * resolution.x + x];
+                    glm::vec4& c = color[size_t(y) * resolution.x + x];
+                    if (first_sample == 1) s = glm::vec4(0);
+                    for (int i = 0; i < n_samples; ++i) {
+                        // setup random seed and camera ray (from the pixel position in the full image)
+                        const glm::ivec2 xy = image_offset + glm::ivec2(x, y);
+                        uint32_t pixel_seed = tea(uint32_t(seed) * uint32_t(xy.y * image_res.x + xy.x), first_sample + i, 32);
+                        const glm::vec3 dir = view_dir(ctx, xy, image_res, rng2(pixel_seed));
+                        // trace ray
+                        const glm::vec4 L = sanitize(trace_path(ctx, ctx.cam_pos, dir, pixel_seed));
+                        // update running luminance statistics (Welford, as in the shader)
+                        const float n = s.z + 1.f;
+                        const float delta = luma(glm::vec3(L)) - s.x;
+                        s.x += delta / n;
+                        s.y += delta * (luma(glm::vec3(L)) - s.x);
+                        s.z = n;
+                        // accumulate
+                        c = glm::mix(c, L, 1.f / n);
+                    }
+                }
+            }
+        }
+    };
+    std::vector<std::future<void>> workers;
+    for (uint32_t i = 1; i < n_workers; ++i)
+        workers.push_back(pool->enqueue([&worker, i]() { worker(i); }));
+    worker(0);
+    for (auto& w : workers)
+        w.get();
+    for (const uint32_t tile : tiles) {
+        const glm::uvec2 tile_min = glm::uvec2(tile % n_tiles.x, tile / n_tiles.x) * TILE_SIZE;
+        const glm::uvec2 tile_size = glm::min(tile_min + TILE_SIZE, resolution) - tile_min;
+        pixel_samples += uint64_t(n_samples) * tile_size.x * tile_size.y;
+    }
+    sample += n_samples;
+}
+
+uint32_t RendererCPU::find_active_tiles() {
+    const glm::uvec2 n_tiles = (resolution + TILE_SIZE - 1u) / TILE_SIZE;
+    tiles_total = n_tiles.x * n_tiles.y;
+    tile_active.assign(tiles_total, 0);
+    tiles_active = 0;
+    for (uint32_t tile = 0; tile < tiles_total; ++tile) {
+        // max. relative standard error of the mean pixel luminance in tile (same as shader/adaptive.glsl)
+        const glm::uvec2 tile_min = glm::uvec2(tile % n_tiles.x, tile / n_tiles.x) * TILE_SIZE;
+        const glm::uvec2 tile_max = glm::min(tile_min + TILE_SIZE, resolution);
+        float tile_error = 0.f;
+        for (uint32_t y = tile_min.y; y < tile_max.y; ++y) {
+            for (uint32_t x = tile_min.x; x < tile_max.x; ++x) {
+                const glm::vec4& s = stats[size_t(y) * resolution.x + x];
+                const float variance = s.z > 1.f ? s.y / (s.z - 1.f) : 1e30f;
+                const float error = std::sqrt(std::max(variance, 0.f) / std::max(s.z, 1.f)) / std::max(s.x, 1e-3f);
+                tile_error = std::max(tile_error, std::min(error, 1e30f));
+            }
+        }
+        if (tile_error > adaptive_threshold) {
+            tile_active[tile] = 1;
+            ++tiles_active;
+        }
+    }
+    return tiles_active;
+}
+
+void RendererCPU::draw() {
+    if (!gl_context_current() || color.empty()) return;
+    // upload to display texture
+    if (!preview || preview->w != int(resolution.x) || preview->h != int(resolution.y))
+        preview = Texture2D("color_cpu", resolution.x, resolution.y, GL_RGBA32F, GL_RGBA, GL_FLOAT, color.data());
+    else {
+        preview->bind(0);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution.x, resolution.y, GL_RGBA, GL_FLOAT, color.data());
+        preview->unbind();
+    }
+    if (tonemapping)
+        ::tonemap(preview, tonemap_exposure, tonemap_gamma);
+    else
+        blit(preview);
+}
+
+void RendererCPU::reset() {
+    sample = 0;
+    pixel_samples = 0;
+    adaptive_last_check = 0;
+}
+
+void RendererCPU::save(const std::string& filename, bool tonemap) {
+    std::vector<uint8_t> pixels(color.size() * 4);
+    {
+        TimingScope scope("tonemap");
+        tonemap_ldr(color.data(), color.size(), pixels.data(), tonemap, tonemap_exposure, tonemap_gamma);
+    }
+    TimingScope scope("save_ldr");
+    image_store_ldr(fs::path(filename), pixels.data(), resolution.x, resolution.y, 4);
+}
+
+void RendererCPU::save_heatmap(const std::string& filename) {
+    std::vector<float> counts(stats.size());
+    for (size_t i = 0; i < stats.size(); ++i)
+        counts[i] = sample > 0 ? stats[i].z : 0.f;
+    save_sample_heatmap(filename, counts, resolution.x, resolution.y, sppx);
+}
+
+glm::uvec2 RendererCPU::get_accumulation(std::vector<glm::vec4>& color_data, std::vector<glm::vec4>& stats_data) {
+    color_data = color;
+    stats_data = stats;
+    return resolution;
+}
+
+bool RendererCPU::set_accumulation(const std::vector<glm::vec4>& color_data, const std::vector<glm::vec4>& stats_data, const glm::uvec2& size) {
+    if (size != resolution || color_data.size() != size_t(size.x) * size.y || stats_data.size() != color_data.size()) return false;
+    color = color_data;
+    stats = stats_data;
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "renderer.h"
+#include "brick_lookup.h"
+#include "thread_pool.h"
+
+#include <memory>
+
+struct RendererCPU : public Renderer {
+    ~RendererCPU();
+
+    // Renderer interface
+    void init();
+    void resize(uint32_t w, uint32_t h);
+    void commit();
+    void trace();
+    void draw();
+    void reset();
+    void save(const std::string& filename, bool tonemap = true);
+    void save_heatmap(const std::string& filename);
+    glm::uvec2 get_accumulation(std::vector<glm::vec4>& color_data, std::vector<glm::vec4>& stats_data);
+    bool set_accumulation(const std::vector<glm::vec4>& color_data, const std::vector<glm::vec4>& stats_data, const glm::uvec2& size);
+
+    // adaptive sampling: flag unconverged tiles, returns their count
+    uint32_t find_active_tiles();
+    // (re)start the persistent worker pool if the number of threads changed, returns the number of workers
+    uint32_t start_workers();
+
+    // CPU settings
+    uint32_t n_threads = 0;             // number of worker threads (0: all cores)
+    std::unique_ptr<ThreadPool> pool;   // persistent workers for trace(), the calling thread is the first worker
+
+    // CPU data
+    glm::uvec2 resolution = glm::uvec2(0);
+    std::vector<glm::vec4> color;       // accumulation buffer (rows bottom-up, as in OpenGL)
+    std::vector<glm::vec4> stats;       // running luminance mean, M2 and sample count per pixel
+    std::vector<uint8_t> tile_active;   // adaptive sampling: tiles still receiving samples
+    std::vector<std::shared_ptr<HostBrickGrid>> density_grids;
+    std::vector<std::shared_ptr<HostBrickGrid>> emission_grids;
+    float majorant_emission = 0.f;
+    std::vector<std::vector<float>> tf_majorant;    // max. transfer function opacity per brick and range mip level
+    std::vector<float> tf_majorant_key;             // transfer function state it was built for
+    const BrickGridView* tf_majorant_grid = nullptr;
+    std::pair<glm::vec3, glm::vec3> tf_occupied;    // index-space bounds of bricks with non-zero opacity
+
+    // OpenGL data (for display only, if a context is available)
+    cppgl::Texture2D preview;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <unistd.h>
+
+// --------------------------------------------------------------
+// helpers for machine-readable reports (telemetry and benchmarks)
+
+// quoted JSON string, control characters are dropped
+inline std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for (const char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (c >= 0 && c < 0x20) continue;
+        out += c;
+    }
+    return out + "\"";
+}
+
+// quoted CSV field
+inline std::string csv_string(const std::string& s) {
+    std::string out = "\"";
+    for (const char c : s)
+        out += c == '"' ? std::string("\"\"") : std::string(1, c);
+    return out + "\"";
+}
+
+// CPU model name from /proc/cpuinfo
+inline std::string cpu_model() {
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos)
+            return line.substr(line.find(':') + 2);
+    }
+    return "unknown";
+}
+
+inline std::string hostname() {
+    char name[256] = { 0 };
+    gethostname(name, sizeof(name) - 1);
+    return name;
+}
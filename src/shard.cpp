@@ -0,0 +1,217 @@
+#include "shard.h"
+#include "image_io.h"
+#include "frame_output.h"
+#include <map>
+#include <deque>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+// -----------------------------------------------------------
+// FrameRange
+
+FrameRange FrameRange::parse(const std::string& str) {
+    std::vector<std::string> fields(1);
+    for (const char c : str) {
+        if (c == ':') fields.emplace_back();
+        else fields.back() += c;
+    }
+    if (fields.size() > 3)
+        throw std::runtime_error("invalid frame range: " + str + " (expected first:last:step)");
+    FrameRange range;
+    if (!fields[0].empty()) range.first = std::stoul(fields[0]);
+    if (fields.size() == 1) // single frame
+        range.last = range.first + 1;
+    else if (!fields[1].empty())
+        range.last = std::stoul(fields[1]);
+    if (fields.size() == 3 && !fields[2].empty())
+        range.step = std::stoul(fields[2]);
+    if (range.step == 0)
+        throw std::runtime_error("invalid frame range: " + str + " (step must be positive)");
+    return range;
+}
+
+std::string FrameRange::str() const {
+    return std::to_string(first) + ":" + (last == SIZE_MAX ? "" : std::to_string(last)) + ":" + std::to_string(step);
+}
+
+// -----------------------------------------------------------
+// ShardCoordinator
+
+static std::string shell_quote(const std::string& s) {
+    std::string out = "'";
+    for (const char c : s)
+        out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    return out + "'";
+}
+
+void ShardCoordinator::launch(Shard& shard, size_t index) {
+    std::vector<std::string> args = { executable };
+    args.insert(args.end(), worker_args.begin(), worker_args.end());
+    args.insert(args.end(), { "--frames", shard.frames.str() });
+    if (n_tiles > 1)
+        args.insert(args.end(), { "--tile", std::to_string(shard.tile) + "/" + std::to_string(n_tiles) });
+    if (shard.attempts > 0) // continue from checkpoints of the failed attempt (if written), skip its finished frames
+        args.push_back("--resume");
+    std::string description = "shard " + std::to_string(index) + " (frames " + shard.frames.str();
+    if (n_tiles > 1) description += ", tile " + std::to_string(shard.tile) + "/" + std::to_string(n_tiles);
+    description += ")";
+    if (!hosts.empty()) {
+        // remote worker in the same working directory
+        const std::string host = hosts[n_launched % hosts.size()];
+        std::string command = "cd " + shell_quote(fs::current_path().string()) + " &&";
+        for (const auto& arg : args)
+            command += " " + shell_quote(arg);
+        args = { "ssh", host, command };
+        description += " on " + host;
+    }
+    ++n_launched;
+    // log output of each shard to a file, so concurrent workers do not garble the console
+    const std::string log = out_stem + "_shard" + std::to_string(index) + ".log";
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    std::vector<char*> argv;
+    for (auto& arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    const int err = posix_spawnp(&shard.pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0)
+        throw std::runtime_error("unable to spawn worker " + std::string(argv[0]) + ": " + strerror(err));
+    ++shard.attempts;
+    std::cout << description << ": started (attempt " << shard.attempts << ", log: " << log << ")" << std::endl;
+}
+
+int ShardCoordinator::run() {
+    // interleaved frame ranges, each split into tiles; tiles of a frame range are scheduled together
+    // (no more frame ranges than frames, so every worker has something to render)
+    size_t n_parts = std::max(size_t(1), n_workers / std::max(1, n_tiles));
+    const size_t last = n_frames > 0 ? std::min(frames.last, n_frames) : frames.last;
+    if (last != SIZE_MAX)
+        n_parts = std::min(n_parts, std::max(size_t(1), (last - std::min(frames.first, last) + frames.step - 1) / frames.step));
+    shards.clear();
+    for (size_t k = 0; k < n_parts; ++k)
+        for (int t = 0; t < n_tiles; ++t)
+            shards.push_back(Shard{ frames.part(k, n_parts), t });
+    for (size_t i = 0; i < shards.size(); ++i)
+        fs::remove(out_stem + "_shard" + std::to_string(i) + ".log");
+    if (n_tiles > 1 && !resume)
+        remove_stale_tiles();
+
+    // run at most n_workers shards at once, retry failed ones
+    std::deque<size_t> pending;
+    for (size_t i = 0; i < shards.size(); ++i)
+        pending.push_back(i);
+    std::map<pid_t, size_t> running;
+    size_t n_failed = 0;
+    while (!pending.empty() || !running.empty()) {
+        while (!pending.empty() && running.size() < std::max(size_t(1), n_workers)) {
+            const size_t index = pending.front();
+            pending.pop_front();
+            launch(shards[index], index);
+            running[shards[index].pid] = index;
+        }
+        int status = 0;
+        const pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) break;
+        auto it = running.find(pid);
+        if (it == running.end()) continue;
+        const size_t index = it->second;
+        running.erase(it);
+        Shard& shard = shards[index];
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            std::cout << "shard " << index << ": finished" << std::endl;
+            continue;
+        }
+        std::cout << "shard " << index << ": failed (" << (WIFSIGNALED(status) ? "signal " + std::to_string(WTERMSIG(status)) :
+            "exit code " + std::to_string(WEXITSTATUS(status))) << ")";
+        if (shard.attempts <= max_retries) {
+            std::cout << ", retrying" << std::endl;
+            pending.push_back(index);
+        } else {
+            std::cout << ", giving up after " << shard.attempts << " attempts" << std::endl;
+            ++n_failed;
+        }
+    }
+
+    // gather tiles
+    const size_t n_incomplete = n_tiles > 1 ? stitch() : 0;
+    if (n_failed || n_incomplete) {
+        std::cerr << n_failed << " of " << shards.size() << " shards failed, " << n_incomplete << " frames incomplete" << std::endl;
+        return 1;
+    }
+    std::cout << shards.size() << " shards finished." << std::endl;
+    return 0;
+}
+
+void ShardCoordinator::remove_stale_tiles() const {
+    // <stem>_tile<i>_<frame>.exr, of any tile count
+    const std::string prefix = out_stem + "_tile";
+    std::vector<fs::path> stale;
+    for (const auto& entry : fs::directory_iterator(fs::current_path())) {
+        const std::string name = entry.path().filename().string();
+        if (entry.path().extension() == ".exr" && name.compare(0, prefix.size(), prefix) == 0)
+            stale.push_back(entry.path());
+    }
+    for (const auto& path : stale)
+        fs::remove(path);
+    if (!stale.empty())
+        std::cout << "removed " << stale.size() << " tiles of an earlier run" << std::endl;
+}
+
+size_t ShardCoordinator::stitch() const {
+    // frames present as tile 0: <stem>_tile0_<frame>.exr
+    const std::string prefix = tile_stem(out_stem, 0) + "_";
+    std::vector<std::string> frame_ids;
+    for (const auto& entry : fs::directory_iterator(fs::current_path())) {
+        const std::string name = entry.path().filename().string();
+        if (entry.path().extension() == ".exr" && entry.path().stem().extension() != ".tmp" && name.compare(0, prefix.size(), prefix) == 0)
+            frame_ids.push_back(entry.path().stem().string().substr(prefix.size()));
+    }
+    std::sort(frame_ids.begin(), frame_ids.end());
+    FrameOutput output;
+    output.format.png = png;
+    output.format.exr = exr;
+    output.format.exr_half = exr_half;
+    output.format.exposure = exposure;
+    output.format.gamma = gamma;
+    size_t n_incomplete = 0;
+    std::vector<std::string> stitched;  // tiles of queued frames, removed once all writes succeeded
+    for (const auto& id : frame_ids) {
+        std::vector<std::string> files;
+        for (int t = 0; t < n_tiles; ++t)
+            files.push_back(tile_stem(out_stem, t) + "_" + id + ".exr");
+        const auto missing = std::find_if(files.begin(), files.end(), [](const std::string& f) { return !fs::exists(f); });
+        if (missing != files.end()) {
+            std::cerr << "frame " << id << ": missing " << *missing << ", not stitched" << std::endl;
+            ++n_incomplete;
+            continue;
+        }
+        // rows bottom-up: the last (bottom) tile comes first
+        std::vector<glm::vec4> rgba;
+        uint32_t w = 0, h = 0;
+        for (int t = n_tiles - 1; t >= 0; --t) {
+            uint32_t tile_w, tile_h;
+            const std::vector<glm::vec4> tile = image_load_exr(files[t], tile_w, tile_h);
+            if (w && tile_w != w)
+                throw std::runtime_error("tile " + files[t] + " has width " + std::to_string(tile_w) + " instead of " + std::to_string(w));
+            rgba.insert(rgba.end(), tile.begin(), tile.end());
+            w = tile_w;
+            h += tile_h;
+        }
+        output.write(std::move(rgba), w, h, out_stem + "_" + id);
+        stitched.insert(stitched.end(), files.begin(), files.end());
+    }
+    output.finish();
+    for (const auto& file : stitched)
+        fs::remove(file);
+    return n_incomplete;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <sys/types.h>
+
+// --------------------------------------------------------------
+// sharded offline rendering: a render is split into interleaved frame ranges and horizontal image strips (tiles),
+// rendered by worker processes (local, or via ssh on hosts sharing the working directory). failed shards are retried,
+// the tiles of each frame are stitched back together from their raw accumulation buffers (OpenEXR)
+
+// range of frames as in python slices: first:last:step (last exclusive, empty: up to the last frame)
+struct FrameRange {
+    size_t first = 0;
+    size_t last = SIZE_MAX;
+    size_t step = 1;
+
+    // parse "a:b:step", "a:b", "a:" or "a" (single frame)
+    static FrameRange parse(const std::string& str);
+    std::string str() const;
+    bool all() const { return first == 0 && last == SIZE_MAX && step == 1; }
+    // k-th of n interleaved parts of the range
+    FrameRange part(size_t k, size_t n) const { return FrameRange{ first + k * step, last, step * n }; }
+};
+
+// horizontal strip i of n (top to bottom) of an image of given height: first row (bottom-up, as in OpenGL) and row count
+inline std::pair<int, int> tile_rows(int height, int i, int n) {
+    const int top = height * i / n, bottom = height * (i + 1) / n;
+    return { height - bottom, bottom - top };
+}
+
+// file name stem of the output of tile i
+inline std::string tile_stem(const std::string& stem, int i) {
+    return stem + "_tile" + std::to_string(i);
+}
+
+struct ShardCoordinator {
+    struct Shard {
+        FrameRange frames;
+        int tile = 0;
+        int attempts = 0;
+        pid_t pid = 0;
+    };
+
+    // run all shards and stitch their tiles, returns the process exit code (0: all shards succeeded)
+    int run();
+
+    // settings
+    std::string executable;                 // worker executable (default: this one)
+    std::vector<std::string> worker_args;   // command line of all workers (without --frames and --tile)
+    std::vector<std::string> hosts;         // ssh hosts workers run on in turns (empty: local processes)
+    size_t n_workers = 1;                   // concurrent worker processes
+    int n_tiles = 1;                        // horizontal strips per frame
+    int max_retries = 2;                    // additional attempts per failed shard
+    FrameRange frames;
+    size_t n_frames = 0;                    // frames of the input (0: unknown), to not launch workers without frames
+    bool resume = false;                    // workers resume (--resume): keep tiles of earlier runs
+    std::string out_stem = "output";        // outputs as written by the workers: <stem>[_tile<i>]_<frame>.*
+    bool png = true;                        // write stitched frames as PNG
+    bool exr = false;                       // write stitched frames as OpenEXR
+    bool exr_half = true;
+    float exposure = 5.f, gamma = 2.2f;
+
+private:
+    // spawn worker process for shard, its output goes to <stem>_shard<index>.log
+    void launch(Shard& shard, size_t index);
+    // remove tiles of earlier runs, so they are not stitched into this one
+    void remove_stale_tiles() const;
+    // stitch the tiles of all frames found on disk, returns number of frames with missing tiles
+    size_t stitch() const;
+
+    std::vector<Shard> shards;
+    size_t n_launched = 0;
+};
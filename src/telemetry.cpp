@@ -0,0 +1,145 @@
+#include "telemetry.h"
+#include "glcontext.h"
+#include "report.h"
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+
+bool Telemetry::enabled = false;
+thread_local int64_t Telemetry::frame = -1;
+std::mutex Telemetry::mutex;
+std::vector<Telemetry::Record> Telemetry::records;
+
+// stage path of the innermost open scope on this thread
+static thread_local std::string scope_path;
+
+// -----------------------------------------------------------
+// TimingScope
+
+TimingScope::TimingScope(const char* name) {
+    if (!Telemetry::enabled) return;
+    active = true;
+    parent_length = scope_path.size();
+    scope_path += (scope_path.empty() ? "" : "/") + std::string(name);
+    if (gl_context_current()) {
+        glGenQueries(2, queries);
+        glQueryCounter(queries[0], GL_TIMESTAMP);
+    }
+    start = std::chrono::steady_clock::now();
+}
+
+TimingScope::~TimingScope() {
+    if (!active) return;
+    const double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (queries[1])
+        glQueryCounter(queries[1], GL_TIMESTAMP);
+    {
+        std::lock_guard<std::mutex> lock(Telemetry::mutex);
+        Telemetry::records.push_back(Telemetry::Record{ scope_path, Telemetry::frame, cpu_ms, { queries[0], queries[1] } });
+    }
+    scope_path.resize(parent_length);
+}
+
+// -----------------------------------------------------------
+// Telemetry
+
+std::vector<Telemetry::Stage> Telemetry::collect() {
+    std::vector<Record> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.swap(records);
+    }
+    std::vector<Stage> stages;
+    for (const Record& record : finished) {
+        Stage stage{ record.stage, record.frame, 1, record.cpu_ms };
+        if (record.queries[0]) {
+            GLuint64 t0 = 0, t1 = 0;
+            glGetQueryObjectui64v(record.queries[0], GL_QUERY_RESULT, &t0);
+            glGetQueryObjectui64v(record.queries[1], GL_QUERY_RESULT, &t1);
+            glDeleteQueries(2, record.queries);
+            stage.gpu_ms = (t1 - t0) / 1e6;
+        }
+        merge(stages, { stage });
+    }
+    return stages;
+}
+
+void Telemetry::merge(std::vector<Stage>& into, const std::vector<Stage>& stages) {
+    for (const Stage& stage : stages) {
+        auto it = std::find_if(into.begin(), into.end(), [&](const Stage& s) { return s.frame == stage.frame && s.stage == stage.stage; });
+        if (it == into.end()) {
+            into.push_back(stage);
+            continue;
+        }
+        it->calls += stage.calls;
+        it->cpu_ms += stage.cpu_ms;
+        if (stage.gpu_ms >= 0)
+            it->gpu_ms = std::max(0.0, it->gpu_ms) + stage.gpu_ms;
+    }
+}
+
+static std::string gl_string(GLenum name) {
+    const GLubyte* str = gl_context_current() ? glGetString(name) : nullptr;
+    return str ? (const char*)str : "";
+}
+
+std::string Telemetry::machine_json() {
+    std::stringstream ss;
+    ss << "{ \"hostname\": " << json_string(hostname()) << ", \"cpu\": " << json_string(cpu_model()) <<
+        ", \"hardware_threads\": " << std::thread::hardware_concurrency() << ", \"compiler\": " << json_string(__VERSION__) << " }";
+    return ss.str();
+}
+
+std::string Telemetry::gl_json() {
+    if (!gl_context_current()) return "null";
+    return "{ \"vendor\": " + json_string(gl_string(GL_VENDOR)) + ", \"renderer\": " + json_string(gl_string(GL_RENDERER)) +
+        ", \"version\": " + json_string(gl_string(GL_VERSION)) + " }";
+}
+
+void Telemetry::append_csv(const std::string& filename, const std::vector<Stage>& stages) {
+    const bool header = !std::filesystem::exists(filename);
+    std::ofstream out(filename, std::ios::app);
+    if (!out) throw std::runtime_error("unable to write " + filename);
+    if (header)
+        out << "hostname,gl_renderer,frame,stage,calls,cpu_ms,gpu_ms" << std::endl;
+    // machine and GL implementation per row, so logs of several machines can simply be concatenated
+    const std::string machine = csv_string(hostname()) + "," + csv_string(gl_string(GL_RENDERER));
+    out << std::setprecision(9);
+    for (const Stage& s : stages) {
+        out << machine << "," << s.frame << "," << s.stage << "," << s.calls << "," << s.cpu_ms << ",";
+        if (s.gpu_ms >= 0) out << s.gpu_ms;
+        out << std::endl;
+    }
+}
+
+void Telemetry::write_json(const std::string& filename, const std::vector<Stage>& stages) {
+    std::ofstream out(filename);
+    if (!out) throw std::runtime_error("unable to write " + filename);
+    out << std::setprecision(9) << "{" << std::endl;
+    out << "  \"machine\": " << machine_json() << "," << std::endl;
+    out << "  \"gl\": " << gl_json() << "," << std::endl;
+    out << "  \"frames\": [";
+    // one entry per frame (-1: setup), stages in order of first appearance
+    std::vector<int64_t> frames;
+    for (const Stage& s : stages)
+        if (std::find(frames.begin(), frames.end(), s.frame) == frames.end())
+            frames.push_back(s.frame);
+    std::sort(frames.begin(), frames.end());
+    for (size_t i = 0; i < frames.size(); ++i) {
+        out << (i ? "," : "") << std::endl << "    { \"frame\": " << frames[i] << ", \"stages\": [";
+        bool first = true;
+        for (const Stage& s : stages) {
+            if (s.frame != frames[i]) continue;
+            out << (first ? "" : ",") << std::endl << "        { \"stage\": " << json_string(s.stage) << ", \"calls\": " << s.calls <<
+                ", \"cpu_ms\": " << s.cpu_ms << ", \"gpu_ms\": ";
+            if (s.gpu_ms >= 0) out << s.gpu_ms; else out << "null";
+            out << " }";
+            first = false;
+        }
+        out << std::endl << "    ] }";
+    }
+    out << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cppgl.h>
+
+// --------------------------------------------------------------
+// timing telemetry: nestable scopes measure CPU wall clock time and, on threads with a current OpenGL context,
+// GPU time via timestamp queries. finished scopes are logged per frame and aggregated per stage
+// disabled by default, a scope then costs a single branch
+
+struct Telemetry {
+    // finished scope
+    struct Record {
+        std::string stage;              // names of enclosing scopes on the same thread, joined by '/'
+        int64_t frame;                  // frame the scope was opened for (-1: setup)
+        double cpu_ms;
+        GLuint queries[2];              // pending GPU timestamps (0: no context)
+    };
+
+    // time per stage and frame
+    struct Stage {
+        std::string stage;
+        int64_t frame;
+        uint32_t calls = 0;
+        double cpu_ms = 0;
+        double gpu_ms = -1;             // -1: no GPU time measured
+    };
+
+    static bool enabled;
+    static thread_local int64_t frame;  // frame attributed to scopes opened on this thread
+
+    // collect finished scopes, aggregated by frame and stage in order of first appearance
+    // (waits for pending GPU timestamps, call from the thread with the OpenGL context)
+    static std::vector<Stage> collect();
+    // add stages to the matching (frame and stage) entries of into
+    static void merge(std::vector<Stage>& into, const std::vector<Stage>& stages);
+
+    // machine and OpenGL implementation (if a context is current) as JSON objects
+    static std::string machine_json();
+    static std::string gl_json();
+
+    // append stages as CSV rows (writes header to new files), or write all stages as JSON
+    static void append_csv(const std::string& filename, const std::vector<Stage>& stages);
+    static void write_json(const std::string& filename, const std::vector<Stage>& stages);
+
+    static std::mutex mutex;
+    static std::vector<Record> records;
+};
+
+struct TimingScope {
+    TimingScope(const char* name);
+    ~TimingScope();
+
+    TimingScope(const TimingScope&) = delete;
+    TimingScope& operator=(const TimingScope&) = delete;
+
+    bool active = false;
+    size_t parent_length = 0;           // length of the stage path of the enclosing scope
+    std::chrono::steady_clock::time_point start;
+    GLuint queries[2] = { 0, 0 };
+};
@@ -1,4 +1,5 @@
 #include "transferfunc.h"
+#include "glcontext.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -55,12 +56,51 @@ std::vector<glm::vec4> TransferFunction::compute_lut_cdf(const std::vector<glm::
     return lut_cdf;
 }
 
+std::vector<glm::vec4> TransferFunction::compute_preintegrated(const std::vector<glm::vec4>& lut, uint32_t size) {
+    // (rgb * a, a) at window coordinate t, as tf_lookup()
+    const auto f = [&](double t) {
+        const double tc = std::min(t, 1.0 - 1e-6) * lut.size();
+        const size_t idx = size_t(tc);
+        const glm::dvec4 rgba = glm::mix(glm::dvec4(lut[idx]), glm::dvec4(lut[std::min(idx + 1, lut.size() - 1)]), tc - idx);
+        return glm::dvec4(glm::dvec3(rgba) * rgba.a, rgba.a);
+    };
+    // integral from 0 to the table sample positions (midpoint rule, at least 8 steps per lut entry)
+    const uint32_t steps = std::max<uint32_t>(16, (8 * lut.size() + size - 2) / (size - 1));
+    const double dt = 1.0 / ((size - 1) * steps);
+    std::vector<glm::dvec4> integral(size, glm::dvec4(0));
+    for (uint32_t i = 1; i < size; ++i) {
+        integral[i] = integral[i - 1];
+        for (uint32_t s = 0; s < steps; ++s)
+            integral[i] += f(((i - 1) * steps + s + .5) * dt) * dt;
+    }
+    // mean over [front, back]
+    std::vector<glm::vec4> table(size_t(size) * size);
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x) {
+            const double front = x / double(size - 1), back = y / double(size - 1);
+            table[size_t(y) * size + x] = glm::vec4(x == y ? f(front) : (integral[y] - integral[x]) / (back - front));
+        }
+    }
+    return table;
+}
+
 void TransferFunction::upload_gpu() {
+    if (!gl_context_current()) return; // CPU rendering only
     // prepare lut
     const std::vector<glm::vec4> lut_cdf = compute_lut_cdf(lut);
     // setup SSBO
     lut_ssbo = SSBO("transferfunc_ssbo");
     lut_ssbo->upload_data(lut_cdf.data(), lut_cdf.size() * sizeof(glm::vec4));
+    // setup pre-integrated table
+    const uint32_t size = 256;
+    const std::vector<glm::vec4> table = compute_preintegrated(lut_cdf, size);
+    preint = Texture2D("transferfunc_preint", size, size, GL_RGBA32F, GL_RGBA, GL_FLOAT, table.data());
+    preint->bind(0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    preint->unbind();
 }
 
 static inline float randf() { return rand() / (RAND_MAX + 1.f); }
@@ -19,8 +19,11 @@ public:
 
     // compute density-CDF lut from given lut
     static std::vector<glm::vec4> compute_lut_cdf(const std::vector<glm::vec4>& lut);
+    // compute pre-integrated table (size x size) of the given lut as evaluated by tf_lookup():
+    // mean (rgb * a, a) over window coordinates from front (x) to back (y), both in [0, 1]
+    static std::vector<glm::vec4> compute_preintegrated(const std::vector<glm::vec4>& lut, uint32_t size = 256);
 
-    // push cdf lut data to GPU texture
+    // push cdf lut data and its pre-integrated table to GPU
     void upload_gpu();
 
     // randomize contents
@@ -35,4 +38,5 @@ public:
     float window_left, window_width;
     std::vector<glm::vec4> lut;
     cppgl::SSBO lut_ssbo;
+    cppgl::Texture2D preint;    // pre-integrated cdf lut, see compute_preintegrated()
 };
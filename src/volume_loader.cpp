@@ -0,0 +1,120 @@
+#include "volume_loader.h"
+#include "thread_pool.h"
+#include "brick_cache.h"
+
+#include <deque>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// -----------------------------------------------------------
+// helper funcs
+
+void print_progress(const std::string& stage, size_t done, size_t total) {
+    std::cout << "\r" << stage << ": " << done << " / " << total << std::flush;
+    if (done == total) std::cout << std::endl;
+}
+
+voldata::Volume::GridPtr find_emission_grid(const GridFrame& frame) {
+    for (const auto& name : EMISSION_GRID_NAMES) {
+        const auto it = frame.find(name);
+        if (it != frame.end()) return it->second;
+    }
+    return nullptr;
+}
+
+std::vector<std::string> list_frame_files(const std::string& path) {
+    std::vector<std::string> files;
+    for (const auto& entry : fs::directory_iterator(path))
+        if (entry.is_regular_file()) files.push_back(entry.path().string());
+    std::sort(files.begin(), files.end());
+    if (files.empty()) throw std::runtime_error("no grid files found in " + path);
+    return files;
+}
+
+GridFrame load_frame(const std::string& file, const std::vector<std::string>& gridnames) {
+    GridFrame frame;
+    for (const auto& name : gridnames) {
+        try {
+            frame[name] = voldata::Volume::load_grid(file, name);
+            BrickCache::register_source(frame[name], file, name);
+        } catch (std::runtime_error& e) {}
+        // non-vdb formats only store a single (density) grid
+        if (fs::path(file).extension() != ".vdb") break;
+    }
+    return frame;
+}
+
+float load_emission_majorant(const std::string& file, const std::vector<std::string>& gridnames) {
+    // non-vdb formats only store a single (density) grid
+    if (fs::path(file).extension() != ".vdb") return 0.f;
+    for (const auto& name : EMISSION_GRID_NAMES) {
+        if (std::find(gridnames.begin(), gridnames.end(), name) == gridnames.end()) continue;
+        try {
+            return voldata::Volume::load_grid(file, name)->minorant_majorant().second;
+        } catch (std::runtime_error& e) {}
+    }
+    return 0.f;
+}
+
+BrickFrame convert_frame(const GridFrame& frame) {
+    BrickFrame result;
+    result.density = BrickCache::get_or_convert(frame.at("density"));
+    const voldata::Volume::GridPtr emission_grid = find_emission_grid(frame);
+    if (emission_grid) {
+        result.emission = BrickCache::get_or_convert(emission_grid);
+        result.majorant_emission = emission_grid->minorant_majorant().second;
+    }
+    return result;
+}
+
+// -----------------------------------------------------------
+// parallel folder loading
+
+std::shared_ptr<voldata::Volume> load_folder_parallel(const std::string& path, const std::vector<std::string>& gridnames, uint32_t n_threads, const ProgressCallback& progress) {
+    const std::vector<std::string> files = list_frame_files(path);
+
+    // decode all files in parallel, each task returns the frame's grids
+    ThreadPool pool(n_threads);
+    std::vector<std::future<GridFrame>> futures;
+    for (const auto& file : files)
+        futures.push_back(pool.enqueue([file, &gridnames]() { return load_frame(file, gridnames); }));
+
+    // collect in file order
+    auto volume = std::make_shared<voldata::Volume>();
+    for (size_t i = 0; i < futures.size(); ++i) {
+        const GridFrame frame = futures[i].get();
+        if (!frame.empty()) volume->add_grid_frame(frame);
+        if (progress) progress("Loading frames", i + 1, futures.size());
+    }
+    if (volume->grids.empty()) throw std::runtime_error("unable to load any grid from " + path);
+    return volume;
+}
+
+// -----------------------------------------------------------
+// parallel brick grid conversion
+
+void convert_frames_parallel(const std::shared_ptr<voldata::Volume>& volume, const std::function<void(size_t, BrickFrame&)>& consume, uint32_t n_threads, const ProgressCallback& progress) {
+    const size_t n_frames = volume->grids.size();
+    const auto convert = [&volume](size_t i) { return convert_frame(volume->grids[i]); };
+    ThreadPool pool(n_threads); // declared after convert, so pending tasks are joined before it goes out of scope
+
+    // keep a bounded number of converted frames in flight to limit host memory
+    const size_t window = 2 * pool.size();
+    std::deque<std::future<BrickFrame>> in_flight;
+    size_t submitted = 0;
+    for (; submitted < std::min(window, n_frames); ++submitted)
+        in_flight.push_back(pool.enqueue([&convert, submitted]() { return convert(submitted); }));
+    for (size_t i = 0; i < n_frames; ++i) {
+        BrickFrame frame = in_flight.front().get();
+        in_flight.pop_front();
+        if (submitted < n_frames) {
+            in_flight.push_back(pool.enqueue([&convert, submitted]() { return convert(submitted); }));
+            ++submitted;
+        }
+        consume(i, frame);
+        if (progress) progress("Converting frames", i + 1, n_frames);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <voldata.h>
+
+#include "brick_lookup.h"
+
+// --------------------------------------------------------------
+// parallel load-and-convert pipeline for volume animations
+// (frames are decoded and converted on a thread pool, results are always delivered in frame order)
+
+// grid names loaded from animation frames
+const std::vector<std::string> FRAME_GRID_NAMES = { "density", "temperature", "flame", "flames" };
+
+// grid names considered for emission, in order of preference
+const std::vector<std::string> EMISSION_GRID_NAMES = { "flame", "flames", "temperature" };
+
+// grids of a single frame, by name
+using GridFrame = std::map<std::string, voldata::Volume::GridPtr>;
+
+// progress report, called on the calling thread: stage name, finished items, total items
+using ProgressCallback = std::function<void(const std::string&, size_t, size_t)>;
+
+// default progress report to stdout
+void print_progress(const std::string& stage, size_t done, size_t total);
+
+// load all grid files in a folder (alphanumerical order) as frames of a volume, in parallel
+std::shared_ptr<voldata::Volume> load_folder_parallel(const std::string& path, const std::vector<std::string>& gridnames,
+        uint32_t n_threads = 0, const ProgressCallback& progress = print_progress);
+
+// emission grid of a frame, or nullptr
+voldata::Volume::GridPtr find_emission_grid(const GridFrame& frame);
+
+// grid files in a folder, in alphanumerical order
+std::vector<std::string> list_frame_files(const std::string& path);
+
+// load given grids from a single file (missing grids are skipped)
+GridFrame load_frame(const std::string& file, const std::vector<std::string>& gridnames);
+
+// max. value of the emission grid in a file (0 if there is none), only loads the emission grid
+float load_emission_majorant(const std::string& file, const std::vector<std::string>& gridnames);
+
+// brick grids of a single frame
+struct BrickFrame {
+    std::shared_ptr<HostBrickGrid> density;
+    std::shared_ptr<HostBrickGrid> emission;        // may be nullptr
+    float majorant_emission = 0.f;
+};
+
+// convert a single frame to brick grids (or fetch them from the brick cache)
+BrickFrame convert_frame(const GridFrame& frame);
+
+// convert all frames of a volume to brick grids in parallel (or fetch them from the brick cache)
+// consume() is called on the calling thread in frame order as soon as the respective frame is ready,
+// so e.g. GPU uploads of frame i overlap with the conversion of frames > i
+void convert_frames_parallel(const std::shared_ptr<voldata::Volume>& volume, const std::function<void(size_t, BrickFrame&)>& consume,
+        uint32_t n_threads = 0, const ProgressCallback& progress = print_progress);